@@ -15,83 +15,115 @@
 import web3
 import json
 import sys
-import pyinotify
+import time
 import traceback
 import utils
 import argparse
 from ccf.clients import CCFClient
+from mock_chain import MockChain
 
 
 class Handler(object):
     def __init__(self, args):
         self.ccf_client = utils.get_ccf_client(args)
-        self.w3 = web3.Web3(web3.HTTPProvider(args.blockchain_http_uri))
+        if getattr(args, "mock_chain", False):
+            self.eth = MockChain.from_args(args)
+        else:
+            self.eth = web3.Web3(web3.HTTPProvider(args.blockchain_http_uri)).eth
+
+    def call(self, method: str, params):
+        res = self.ccf_client.call(method, params)
+        if res.status_code != 200:
+            raise Exception(f"{method} failed with {res.status_code}: {res.body}")
+        return res.body.json()["result"]
 
     def handle_request_old_state(self, msg):
-        res = self.w3.eth.call({"to": msg["to"], "from": msg["from"], "data": msg["data"]})
-        self.ccf_client.call("/app/eth_sync_old_states", {"tx_hash": msg["tx_hash"], "data": res.hex()})
+        res = self.eth.call({"to": msg["to"], "from": msg["from"], "data": msg["data"]})
+        self.call("/app/eth_sync_old_states", {"tx_hash": msg["tx_hash"], "data": res.hex()})
 
     def handle_request_public_keys(self, msg):
-        res = self.w3.eth.call({"to": msg["to"], "from": msg["from"], "data": msg["data"]})
-        self.ccf_client.call("/app/eth_sync_public_keys", {"tx_hash": msg["tx_hash"], "data": res.hex()})
+        res = self.eth.call({"to": msg["to"], "from": msg["from"], "data": msg["data"]})
+        self.call("/app/eth_sync_public_keys", {"tx_hash": msg["tx_hash"], "data": res.hex()})
 
     def handle_sync_result(self, msg):
+        # a rejected transaction is handled once reported, only a failed
+        # report makes the message fail
         try:
-            self.w3.eth.send_raw_transaction(msg["data"])
-            self.ccf_client.call("/app/cloak_sync_report", {"id": msg["tx_hash"], "result": "SYNCED"})
+            self.eth.send_raw_transaction(msg["data"])
+            result = "SYNCED"
         except Exception as err:
-            self.ccf_client.call("/app/cloak_sync_report", {"id": msg["tx_hash"], "result": "FAILED"})
-            raise
+            print(f"sync of {msg['tx_hash']} failed: {err}")
+            result = "FAILED"
+        self.call("/app/cloak_sync_report", {"id": msg["tx_hash"], "result": result})
 
     def handle_register_tee_addr(self, msg):
-        self.w3.eth.send_raw_transaction(msg)
-
-    def handle_agent_log(self, info: str):
-        info_json = json.loads(info)
-        if info_json["tag"] == "request_old_state":
-            self.handle_request_old_state(info_json["message"])
-        elif info_json["tag"] == "request_public_keys":
-            self.handle_request_public_keys(info_json["message"])
-        elif info_json["tag"] == "sync_result":
-            self.handle_sync_result(info_json["message"])
-        elif info_json["tag"] == "register_tee_addr":
-            self.handle_register_tee_addr(info_json["message"])
+        self.eth.send_raw_transaction(msg)
+
+    def handle_agent_message(self, tag: str, msg):
+        if tag == "request_old_state":
+            self.handle_request_old_state(msg)
+        elif tag == "request_public_keys":
+            self.handle_request_public_keys(msg)
+        elif tag == "sync_result":
+            self.handle_sync_result(msg)
+        elif tag == "register_tee_addr":
+            self.handle_register_tee_addr(msg)
         else:
-            raise Exception(f"invalid tag: {info_json['tag']}");
-        print(f"{info_json['tag']} succeeded")
-
-class EventHandler(pyinotify.ProcessEvent):
-    def __init__(self, cmd_args, *args, **kwargs):
-        super(EventHandler, self).__init__(*args, **kwargs)
-        self.args = cmd_args
-        self.file = open(cmd_args.build_path + "/workspace/sandbox_0/out", "r")
-        self.file.seek(0, 2)
-        self.decode_lines()
-
-    def process_IN_MODIFY(self, event):
-        print('event received')
-        self.decode_lines()
-
-    def decode_lines(self):
-        while line:= self.file.readline():
-            pos = line.find("ShouokOn")
-            if pos == -1:
-                continue
-            new_line = line[pos+8:]
-            pos = new_line.find("ShouokOn")
-            if pos == -1:
-                continue
-            try:
-                Handler(self.args).handle_agent_log(new_line[:pos])
-            except Exception as err:
-                traceback.print_exc()
-                print(f"ERROR: {err}")
-        print("read end")
+            raise Exception(f"invalid tag: {tag}");
+        print(f"{tag} succeeded")
 
-def loop_for_log(args: argparse.Namespace):
-    wm = pyinotify.WatchManager()
-    handler = EventHandler(args)
-    notifier = pyinotify.Notifier(wm, handler)
-    wm.add_watch(args.build_path + "/workspace/sandbox_0/out", pyinotify.IN_MODIFY, rec=True)
-    notifier.loop()
+    def fetch(self, max_messages: int):
+        return self.call("/app/cloak_agent_fetch", {"max": max_messages})
 
+    def ack(self, seq: int):
+        if self.call("/app/cloak_agent_ack", {"seq": seq}) is not True:
+            raise Exception(f"ack of {seq} was refused")
+
+
+FETCH_BATCH = 100
+IDLE_WAIT_SECONDS = 0.2
+HANDLE_ATTEMPTS = 3
+RETRY_WAIT_SECONDS = 1
+
+
+def handle_with_retries(handler: Handler, msg) -> bool:
+    for attempt in range(1, HANDLE_ATTEMPTS + 1):
+        try:
+            handler.handle_agent_message(msg["tag"], json.loads(msg["message"]))
+            return True
+        except Exception as err:
+            traceback.print_exc()
+            print(f"ERROR: {msg['tag']} {msg['seq']}, attempt {attempt}: {err}")
+            time.sleep(RETRY_WAIT_SECONDS * attempt)
+    return False
+
+
+def loop_for_messages(args: argparse.Namespace):
+    """Polls cloak-tee's agent queue. Each message is acknowledged once handled,
+    so a restarted agent resumes after the last handled message. Acks cover
+    every message up to their seq, so a message that still fails after
+    retrying is not acked: the batch stops there and the message is fetched
+    again on the next poll."""
+    handler = Handler(args)
+    while True:
+        try:
+            fetched = handler.fetch(FETCH_BATCH)
+        except Exception as err:
+            print(f"fetch failed: {err}")
+            time.sleep(IDLE_WAIT_SECONDS)
+            continue
+
+        if not fetched["messages"]:
+            time.sleep(IDLE_WAIT_SECONDS)
+            continue
+
+        for msg in fetched["messages"]:
+            if not handle_with_retries(handler, msg):
+                time.sleep(IDLE_WAIT_SECONDS)
+                break
+            try:
+                handler.ack(msg["seq"])
+            except Exception as err:
+                print(f"ack failed: {err}")
+                time.sleep(IDLE_WAIT_SECONDS)
+                break
@@ -26,6 +26,7 @@ import web3
 from multiprocessing import Process
 from ccf.clients import CCFClient, Identity
 
+MOCK_CLOAK_SERVICE_ADDR = "0x" + "00" * 19 + "01"
 
 def get_args():
     parser = argparse.ArgumentParser(description='cloak manager')
@@ -36,6 +37,16 @@ def get_args():
     setup_service.add_argument('--cloak-tee-port', type=int, help='cloak tee port', default=8000)
     setup_service.add_argument('--blockchain-http-uri', help='blockchain http uri', default="http://127.0.0.1:8545")
     setup_service.add_argument('--cloak-service-address', help='deployed cloak service address', default=None)
+    setup_service.add_argument('--mock-chain', action='store_true',
+                               help='run the agent against an in-process chain instead of --blockchain-http-uri')
+    setup_service.add_argument('--mock-policy', action='append',
+                               help='privacy policy of verifier contracts on the mock chain, as [ADDRESS=]FILE, '
+                                    'without an address it applies to any verifier')
+    setup_service.add_argument('--mock-accounts', help='json list of private keys announced on the mock chain')
+    setup_service.add_argument('--mock-call-latency', type=float, default=0.0,
+                               help='seconds added to each mock chain call')
+    setup_service.add_argument('--mock-tx-latency', type=float, default=0.0,
+                               help='seconds added to each mock chain transaction')
 
     args = parser.parse_args()
     return args
@@ -52,6 +63,10 @@ class Cloak:
             self.setup_cloak_service()
 
     def deploy_sol_contracts(self):
+        if self.args.mock_chain:
+            # the mock chain serves CloakService at any address
+            self.cloak_service_addr = self.cloak_service_addr or MOCK_CLOAK_SERVICE_ADDR
+            return
         current_dir = os.path.dirname(os.path.abspath(__file__))
         cloak_service_file = current_dir + "/solidity/CloakService.sol"
         w3 = web3.Web3(web3.HTTPProvider(args.blockchain_http_uri))
@@ -92,7 +107,7 @@ class Cloak:
         return process
 
     def run_cloak_tee_agent(self):
-        p = Process(target=agent.loop_for_log, args=(self.args,))
+        p = Process(target=agent.loop_for_messages, args=(self.args,))
         p.start()
         time.sleep(1)
         print("cloak-tee-agent started")
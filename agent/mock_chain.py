@@ -0,0 +1,225 @@
+# Copyright (c) 2020 Oxford-Hainan Blockchain Research Institute
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+"""In-process stand-in for the chain the agent talks to.
+
+MockChain takes the place of w3.eth in the agent. It answers the calls
+cloak-tee asks the agent to make: CloakService.getPk and the verifier
+get_states. It applies the transactions cloak-tee asks the agent to send:
+CloakService.setTEEAddress and announcePk, and the verifier set_states. The
+contracts are modelled by their storage rather than run as bytecode, so no
+solc, node or verifier contract is needed:
+
+- CloakService keeps the public key announced by each address.
+- A verifier keeps the encrypted states of its contract, as set_states
+  wrote them. Proofs are not checked.
+
+Verifiers are generated from each contract's privacy policy, which also
+tells how states are laid out in the state lists. Policies are given as
+files, either for one verifier address or as the default for any address.
+
+call_latency and tx_latency are added to every call and transaction, to
+model the round trip to a real node and the time to mine a transaction.
+"""
+
+import json
+import threading
+import time
+
+import eth_abi
+import eth_keys
+import rlp
+import web3
+from eth_hash.auto import keccak as keccak_256
+from hexbytes import HexBytes
+
+
+def selector(signature: str) -> bytes:
+    return keccak_256(signature.encode())[:4]
+
+
+GET_STATES = selector("get_states(bytes[],uint256)")
+SET_STATES = selector("set_states(bytes[],uint256,bytes[],uint256[])")
+GET_PK = selector("getPk(address[])")
+SET_TEE_ADDRESS = selector("setTEEAddress(bytes)")
+ANNOUNCE_PK = selector("announcePk(bytes)")
+
+
+def word(v: int) -> bytes:
+    return v.to_bytes(32, "big")
+
+
+def to_int(b: bytes) -> int:
+    return int.from_bytes(b, "big")
+
+
+class Verifier:
+    """States of one contract: a value list per state id, and per mapping
+    state a value list per key. Values are stored as the state lists carry
+    them: one word for states owned by all, or a cipher, tag and iv, and
+    sender for the others."""
+
+    def __init__(self, policy):
+        self.states = policy["states"]
+        self.scalars = {}
+        self.mappings = {}
+
+    def factor(self, sid):
+        return 1 if self.states[sid]["owner"]["owner"] == "all" else 3
+
+    def empty(self, sid):
+        # a zero sender tells cloak-tee the state was never written
+        return [word(0)] if self.factor(sid) == 1 else [b"", b"", word(0)]
+
+    def depth(self, sid):
+        return self.states[sid]["structural_type"]["depth"]
+
+    def is_mapping(self, sid):
+        return self.states[sid]["structural_type"]["type"] == "mapping"
+
+    def read_keys(self, read):
+        """Mapping keys in a get_states or set_states read list, by state id"""
+        keys = {}
+        i = 0
+        while i < len(read):
+            sid, n = to_int(read[i]), to_int(read[i + 1])
+            depth = self.depth(sid)
+            words = read[i + 2:i + 2 + n * depth]
+            keys[sid] = [tuple(words[k * depth:(k + 1) * depth]) for k in range(n)]
+            i += 2 + n * depth
+        return keys
+
+    def get_states(self, read):
+        keys = self.read_keys(read)
+        res = []
+        for sid in range(len(self.states)):
+            res.append(word(sid))
+            if not self.is_mapping(sid):
+                res.extend(self.scalars.get(sid, self.empty(sid)))
+                continue
+            values = self.mappings.get(sid, {})
+            res.append(word(len(keys.get(sid, []))))
+            for key in keys.get(sid, []):
+                res.extend(key)
+                res.extend(values.get(key, self.empty(sid)))
+        return res
+
+    def set_states(self, data):
+        i = 0
+        while i < len(data):
+            sid = to_int(data[i])
+            factor = self.factor(sid)
+            if not self.is_mapping(sid):
+                self.scalars[sid] = list(data[i + 1:i + 1 + factor])
+                i += 1 + factor
+                continue
+            n, depth = to_int(data[i + 1]), self.depth(sid)
+            values = self.mappings.setdefault(sid, {})
+            i += 2
+            for _ in range(n):
+                values[tuple(data[i:i + depth])] = list(data[i + depth:i + depth + factor])
+                i += depth + factor
+
+
+class MockChain:
+    def __init__(self, policies, call_latency=0.0, tx_latency=0.0):
+        """policies maps a verifier address, or None for the default, to a
+        policy as cloak-compiler writes it"""
+        self.policies = {k.lower() if k else None: v for k, v in policies.items()}
+        self.call_latency = call_latency
+        self.tx_latency = tx_latency
+        self.lock = threading.Lock()
+        self.verifiers = {}
+        self.pks = {}
+        self.tee_addr = None
+        self.nonces = {}
+
+    @staticmethod
+    def from_args(args):
+        policies = {}
+        for item in args.mock_policy or []:
+            addr, _, path = item.rpartition("=")
+            with open(path) as f:
+                policies[addr or None] = json.load(f)
+        chain = MockChain(policies, args.mock_call_latency, args.mock_tx_latency)
+        if args.mock_accounts:
+            with open(args.mock_accounts) as f:
+                for key in json.load(f):
+                    chain.announce(web3.Account.from_key(key).address, public_key(key))
+        return chain
+
+    def announce(self, addr, pk):
+        if len(pk) != 65 or pk[0] != 0x04:
+            raise Exception("Invalid public key")
+        self.pks[addr.lower()] = pk
+
+    def verifier(self, addr):
+        addr = addr.lower()
+        if addr not in self.verifiers:
+            policy = self.policies.get(addr, self.policies.get(None))
+            if policy is None:
+                raise Exception(f"No policy for verifier {addr}")
+            self.verifiers[addr] = Verifier(policy)
+        return self.verifiers[addr]
+
+    # The subset of w3.eth the agent uses
+
+    def call(self, tx):
+        time.sleep(self.call_latency)
+        data = bytes(HexBytes(tx["data"]))
+        with self.lock:
+            if data[:4] == GET_STATES:
+                read, _ = eth_abi.decode_abi(["bytes[]", "uint256"], data[4:])
+                res = self.verifier(tx["to"]).get_states(list(read))
+                return HexBytes(eth_abi.encode_abi(["bytes[]"], [res]))
+            if data[:4] == GET_PK:
+                (addrs,) = eth_abi.decode_abi(["address[]"], data[4:])
+                missing = [a for a in addrs if a.lower() not in self.pks]
+                if missing:
+                    raise Exception(f"Address has no announced: {missing}")
+                return HexBytes(eth_abi.encode_abi(["bytes[]"], [[self.pks[a.lower()] for a in addrs]]))
+        raise Exception(f"Unknown call {data[:4].hex()}")
+
+    def send_raw_transaction(self, raw):
+        raw = bytes(HexBytes(raw))
+        nonce, _, _, to, _, data, _, _, _ = rlp.decode(raw)
+        sender = web3.Account.recover_transaction(raw).lower()
+        time.sleep(self.tx_latency)
+        with self.lock:
+            nonce = to_int(nonce)
+            if nonce < self.nonces.get(sender, 0):
+                raise Exception(f"Nonce too low for {sender}: {nonce}")
+            if data[:4] == SET_STATES:
+                if sender != self.tee_addr:
+                    raise Exception(f"set_states from {sender}, not the TEE")
+                _, _, states, _ = eth_abi.decode_abi(["bytes[]", "uint256", "bytes[]", "uint256[]"], data[4:])
+                self.verifier("0x" + to.hex()).set_states(list(states))
+            elif data[:4] == SET_TEE_ADDRESS:
+                if self.tee_addr is not None:
+                    raise Exception("TEE has already register")
+                (pk,) = eth_abi.decode_abi(["bytes"], data[4:])
+                self.announce(sender, pk)
+                self.tee_addr = sender
+            elif data[:4] == ANNOUNCE_PK:
+                (pk,) = eth_abi.decode_abi(["bytes"], data[4:])
+                self.announce(sender, pk)
+            else:
+                raise Exception(f"Unknown transaction {data[:4].hex()}")
+            self.nonces[sender] = nonce + 1
+        return HexBytes(keccak_256(raw))
+
+
+def public_key(private_key) -> bytes:
+    """The 65 byte uncompressed key CloakService expects"""
+    return b"\x04" + eth_keys.keys.PrivateKey(bytes(HexBytes(private_key))).public_key.to_bytes()
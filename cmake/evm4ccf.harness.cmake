@@ -0,0 +1,29 @@
+# Host executable that runs the cloak transaction path against an in-memory
+# store, see src/harness/host_harness.cpp. Built with frame pointers and debug
+# info so perf can unwind it.
+
+add_executable(cloak_host_harness ${CMAKE_CURRENT_LIST_DIR}/../src/harness/host_harness.cpp)
+target_compile_options(cloak_host_harness PRIVATE -stdlib=libc++ -O2 -g -fno-omit-frame-pointer)
+target_link_libraries(
+  cloak_host_harness
+  PRIVATE
+  -lc++ -lc++abi -lc++fs -stdlib=libc++
+  keccak_host
+  intx::intx
+  evm4ccf.virtual
+)
+target_include_directories(cloak_host_harness
+  PRIVATE
+  /opt/openenclave/include
+  ${CMAKE_CURRENT_LIST_DIR}/../include
+  ${CMAKE_CURRENT_SOURCE_DIR}/src
+  ${EVM_DIR}/include
+  ${CCF_DIR}/include/3rdparty
+  ${CCF_DIR}/include/ccf
+  ${OE_LIBCXX_INCLUDE_DIR}
+  ${OE_LIBC_INCLUDE_DIR}
+  ${OE_INCLUDE_DIR}
+  ${EVM_DIR}/3rdparty
+  ${EVM_DIR}/3rdparty/intx
+)
+use_client_mbedtls(cloak_host_harness)
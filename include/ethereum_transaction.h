@@ -2,6 +2,7 @@
 // Licensed under the MIT License.
 #pragma once
 
+#include "ethereum/rlp_view.h"
 #include "ethereum/types.h"
 
 // CCF
@@ -158,8 +159,7 @@ inline eevm::Address get_address_from_public_key_asn1(const std::vector<uint8_t>
             "Expected ASN.1 key to begin with {}, not {}", MBEDTLS_ASN1_OCTET_STRING, asn1[0]));
     }
 
-    const std::vector<uint8_t> bytes(asn1.begin() + 1, asn1.end());
-    const auto hashed = eevm::keccak_256(bytes);
+    const auto hashed = eevm::keccak_256(asn1.data() + 1, asn1.size() - 1);
 
     // Address is the last 20 bytes of 32-byte hash, so skip first 12
     return eevm::from_big_endian(hashed.data() + 12, 20u);
@@ -191,19 +191,7 @@ struct EthereumTransaction {
     }
 
     explicit EthereumTransaction(const eevm::rlp::ByteString& encoded) {
-        auto tup = eevm::rlp::decode<size_t,
-                                     uint256_t,
-                                     uint256_t,
-                                     eevm::rlp::ByteString,
-                                     uint256_t,
-                                     eevm::rlp::ByteString>(encoded);
-
-        nonce = std::get<0>(tup);
-        gas_price = std::get<1>(tup);
-        gas = std::get<2>(tup);
-        to = std::get<3>(tup);
-        value = std::get<4>(tup);
-        data = std::get<5>(tup);
+        from_items(Ethereum::rlp::decode_list(encoded, 6));
     }
 
     eevm::rlp::ByteString encode() const {
@@ -211,12 +199,12 @@ struct EthereumTransaction {
     }
 
     virtual eevm::KeccakHash to_be_signed() const {
-        return eevm::keccak_256(encode());
+        return Ethereum::rlp::keccak_list({nonce, gas_price, gas, to, value, data});
     }
 
     eevm::KeccakHash to_be_signed_with_chain_id() const {
-        return eevm::keccak_256(
-            eevm::rlp::encode(nonce, gas_price, gas, to, value, data, current_chain_id, 0, 0));
+        return Ethereum::rlp::keccak_list(
+            {nonce, gas_price, gas, to, value, data, current_chain_id, 0, 0});
     }
 
     virtual void to_transaction_call(MessageCall& tc) const {
@@ -230,6 +218,17 @@ struct EthereumTransaction {
         tc.value = value;
         tc.data = eevm::to_hex_string(data);
     }
+
+ protected:
+    // Copies the fields out of decoded RLP items, each exactly once
+    void from_items(const std::vector<Ethereum::rlp::Slice>& items) {
+        nonce = items[0].to_uint<size_t>();
+        gas_price = items[1].to_uint<uint256_t>();
+        gas = items[2].to_uint<uint256_t>();
+        to = items[3].to_bytes();
+        value = items[4].to_uint<uint256_t>();
+        data = items[5].to_bytes();
+    }
 };
 
 struct EthereumTransactionWithSignature : public EthereumTransaction {
@@ -263,25 +262,11 @@ struct EthereumTransactionWithSignature : public EthereumTransaction {
     }
 
     explicit EthereumTransactionWithSignature(const eevm::rlp::ByteString& encoded) {
-        auto tup = eevm::rlp::decode<size_t,
-                                     uint256_t,
-                                     uint256_t,
-                                     eevm::rlp::ByteString,
-                                     uint256_t,
-                                     eevm::rlp::ByteString,
-                                     uint8_t,
-                                     PointCoord,
-                                     PointCoord>(encoded);
-
-        nonce = std::get<0>(tup);
-        gas_price = std::get<1>(tup);
-        gas = std::get<2>(tup);
-        to = std::get<3>(tup);
-        value = std::get<4>(tup);
-        data = std::get<5>(tup);
-        v = std::get<6>(tup);
-        r = std::get<7>(tup);
-        s = std::get<8>(tup);
+        const auto items = Ethereum::rlp::decode_list(encoded, 9);
+        from_items(items);
+        v = items[6].to_uint<uint8_t>();
+        r = items[7].to_uint<PointCoord>();
+        s = items[8].to_uint<PointCoord>();
     }
 
     eevm::rlp::ByteString encode() const {
@@ -304,8 +289,7 @@ struct EthereumTransactionWithSignature : public EthereumTransaction {
         // EIP-155 adds (CHAIN_ID, 0, 0) to the data which is hashed, but _only_
         // for signing/recovering. The canonical transaction hash (produced by
         // encode(), used as transaction ID) is unaffected
-        return eevm::keccak_256(
-            eevm::rlp::encode(nonce, gas_price, gas, to, value, data, current_chain_id, 0, 0));
+        return to_be_signed_with_chain_id();
     }
 
     void to_transaction_call(MessageCall& tc) const override {
@@ -0,0 +1,495 @@
+# Copyright (c) 2020 Oxford-Hainan Blockchain Research Institute
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+"""Multi party workload generator for a local cloak-tee sandbox.
+
+Creates N signers, deploys a cloak contract and its privacy policy, then
+sends a weighted mix of multi party transactions and plain Ethereum
+transactions at a target rate. A stub agent takes the place of
+cloak-tee-agent and the public chain: it answers request_old_state with
+never written states, request_public_keys with the signers' keys, and
+reports every sync_result as SYNCED. No blockchain node is needed.
+
+At the end it prints throughput, p50/p99 client latency per method, the
+time each multi party transaction spent in each stage, and p50/p99 of the
+node's phases from cloak_metrics.
+
+The contract and policy come from cloak-compiler. Each --mpt file is a
+multi party transaction body in which $sender and $peer are replaced by the
+sending signer and another signer, e.g.
+
+    {"function": "transfer",
+     "inputs": [{"name": "to", "value": "$peer"}, {"name": "value", "value": "10"}]}
+
+Only transactions that supply every input complete, as the stub agent does
+not add parties.
+"""
+
+import argparse
+import bisect
+import json
+import math
+import os
+import random
+import re
+import string
+import threading
+import time
+from collections import defaultdict
+from concurrent.futures import ThreadPoolExecutor
+
+import eth_abi
+import eth_keys
+import rlp
+import web3
+from ccf.clients import CCFClient, Identity
+from eth_hash.auto import keccak as keccak_256
+
+
+def get_args():
+    parser = argparse.ArgumentParser(description="cloak-tee multi party load generator")
+    parser.add_argument("--build-path", help="cloak-tee build path", required=True)
+    parser.add_argument("--cloak-tee-port", type=int, help="cloak tee port", default=8000)
+    parser.add_argument("--contract", help="solc --combined-json output of the contract", required=True)
+    parser.add_argument("--contract-name", help="contract key in the combined json", required=True)
+    parser.add_argument("--policy", help="privacy policy json from cloak-compiler", required=True)
+    parser.add_argument("--mpt", action="append", help="multi party transaction template", required=True)
+    parser.add_argument("--signers", type=int, default=16, help="number of signers")
+    parser.add_argument("--rate", type=float, default=10.0, help="target operations per second")
+    parser.add_argument("--duration", type=float, default=60.0, help="seconds to send for")
+    parser.add_argument("--mix", default="mpt=1", help="weights of mpt and eth operations, e.g. mpt=3,eth=1")
+    parser.add_argument("--concurrency", type=int, default=32, help="requests in flight")
+    parser.add_argument("--drain", type=float, default=30.0, help="seconds to wait for open transactions")
+    parser.add_argument("--poll-interval", type=float, default=0.01, help="stub agent idle wait")
+    parser.add_argument("--cloak-service-address", default="0x" + "00" * 19 + "01",
+                        help="service address given to cloak_prepare, skipped if already prepared")
+    parser.add_argument("--signer-keys", help="json list of signer private keys, written if it does not exist")
+    parser.add_argument("--no-stub-agent", action="store_true",
+                        help="leave the agent queue to a running agent, e.g. with --mock-chain --mock-accounts")
+    parser.add_argument("--record", help="append every request sent to this file, for cloak_host_harness")
+    return parser.parse_args()
+
+
+def get_ccf_client(args):
+    sandbox_common = args.build_path + "/workspace/sandbox_common/"
+    ca = sandbox_common + "networkcert.pem"
+    user0 = Identity(sandbox_common + "user0_privk.pem", sandbox_common + "user0_cert.pem", "")
+    return CCFClient("127.0.0.1", args.cloak_tee_port, ca, user0)
+
+
+def sign_mpt(private_key, to, data, nonce):
+    msg_hash = keccak_256(rlp.encode([nonce, to, data]))
+    signed = web3.eth.Account.signHash(msg_hash, private_key=private_key)
+    return "0x" + rlp.encode([nonce, to, data, signed.v, signed.r, signed.s]).hex()
+
+
+def sign_privacy(private_key, to, verifier_addr, code_hash, policy):
+    msg_hash = keccak_256(rlp.encode([to, verifier_addr, code_hash, policy]))
+    signed = web3.eth.Account.signHash(msg_hash, private_key=private_key)
+    return "0x" + rlp.encode([to, verifier_addr, code_hash, policy, signed.v, signed.r, signed.s]).hex()
+
+
+def contract_address(sender: str, nonce: int) -> str:
+    raw = keccak_256(rlp.encode([bytes.fromhex(sender[2:]), nonce]))[12:]
+    return web3.Web3.toChecksumAddress(raw)
+
+
+def percentile(values, q):
+    if not values:
+        return float("nan")
+    values = sorted(values)
+    return values[max(0, math.ceil(q * len(values)) - 1)]
+
+
+class Stats:
+    """Client side timings, shared by the senders and the stub agent"""
+
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.latency = defaultdict(list)
+        self.errors = defaultdict(int)
+        # mpt hash -> stage -> time it was reached
+        self.mpts = {}
+
+    def call(self, method, seconds, ok):
+        with self.lock:
+            self.latency[method].append(seconds)
+            if not ok:
+                self.errors[method] += 1
+
+    def stage(self, mpt_hash, stage):
+        with self.lock:
+            self.mpts.setdefault(mpt_hash.lower(), {})[stage] = time.monotonic()
+
+    def open_mpts(self):
+        with self.lock:
+            return sum(1 for s in self.mpts.values() if "synced" not in s and "failed" not in s)
+
+
+class Rpc:
+    """One CCF client per thread, timing every call into stats"""
+
+    def __init__(self, args, stats):
+        self.args = args
+        self.stats = stats
+        self.local = threading.local()
+        self.record_lock = threading.Lock()
+        self.record = open(args.record, "a") if args.record else None
+
+    def call(self, method, params, verb="POST"):
+        if not hasattr(self.local, "client"):
+            self.local.client = get_ccf_client(self.args)
+        if self.record:
+            with self.record_lock:
+                self.record.write(json.dumps({"jsonrpc": "2.0", "method": method, "params": params}) + "\n")
+
+        start = time.monotonic()
+        ok = False
+        try:
+            response = self.local.client.call("/app/" + method, params, verb)
+            body = response.body.json()
+            if response.status_code != 200:
+                raise RuntimeError(f"{method} failed: {body}")
+            ok = True
+            return body["result"] if isinstance(body, dict) and "result" in body else body
+        finally:
+            self.stats.call(method, time.monotonic() - start, ok)
+
+    def metrics(self):
+        """cloak_metrics is Prometheus text rather than JSON"""
+        if not hasattr(self.local, "client"):
+            self.local.client = get_ccf_client(self.args)
+        return self.local.client.call("/app/cloak_metrics", {}, "GET").body.text()
+
+
+class StubAgent(threading.Thread):
+    """Handles the agent queue without a chain, see the module comment"""
+
+    def __init__(self, rpc, stats, policy, signers, poll_interval):
+        super().__init__(daemon=True)
+        self.rpc = rpc
+        self.stats = stats
+        self.states = policy["states"]
+        self.poll_interval = poll_interval
+        self.stopped = threading.Event()
+        self.pks = {}
+        for s in signers:
+            pk = eth_keys.keys.PrivateKey(bytes(s.key)).public_key.to_bytes()
+            self.pks[s.address.lower()] = b"\x04" + pk
+        self.default_pk = next(iter(self.pks.values()))
+
+    def run(self):
+        while not self.stopped.is_set():
+            try:
+                messages = self.rpc.call("cloak_agent_fetch", {"max": 100})["messages"]
+            except Exception as err:
+                print(f"stub agent fetch failed: {err}")
+                time.sleep(self.poll_interval)
+                continue
+            if not messages:
+                time.sleep(self.poll_interval)
+                continue
+            # as in agent.py: acks are cumulative, so a message that keeps
+            # failing is left unacked and fetched again on the next poll
+            for msg in messages:
+                if not self.handle_with_retries(msg):
+                    time.sleep(self.poll_interval)
+                    break
+                try:
+                    if self.rpc.call("cloak_agent_ack", {"seq": msg["seq"]}) is not True:
+                        raise RuntimeError(f"ack of {msg['seq']} was refused")
+                except Exception as err:
+                    print(f"stub agent ack failed: {err}")
+                    time.sleep(self.poll_interval)
+                    break
+
+    def handle_with_retries(self, msg, attempts=3):
+        for attempt in range(1, attempts + 1):
+            try:
+                self.handle(msg["tag"], json.loads(msg["message"]))
+                return True
+            except Exception as err:
+                print(f"stub agent {msg['tag']} {msg['seq']}, attempt {attempt}: {err}")
+                time.sleep(self.poll_interval * attempt)
+        return False
+
+    def handle(self, tag, msg):
+        if tag == "request_old_state":
+            self.stats.stage(msg["tx_hash"], "old_states_requested")
+            read, _ = eth_abi.decode_abi(["bytes[]", "uint256"], bytes.fromhex(msg["data"][10:]))
+            data = eth_abi.encode_abi(["bytes[]"], [self.old_states(list(read))])
+            self.rpc.call("eth_sync_old_states", {"tx_hash": msg["tx_hash"], "data": "0x" + data.hex()})
+        elif tag == "request_public_keys":
+            self.stats.stage(msg["tx_hash"], "public_keys_requested")
+            (addrs,) = eth_abi.decode_abi(["address[]"], bytes.fromhex(msg["data"][10:]))
+            pks = [self.pks.get(a.lower(), self.default_pk) for a in addrs]
+            data = eth_abi.encode_abi(["bytes[]"], [pks])
+            self.rpc.call("eth_sync_public_keys", {"tx_hash": msg["tx_hash"], "data": "0x" + data.hex()})
+        elif tag == "sync_result":
+            self.stats.stage(msg["tx_hash"], "result_ready")
+            self.rpc.call("cloak_sync_report", {"id": msg["tx_hash"], "result": "SYNCED"})
+            self.stats.stage(msg["tx_hash"], "synced")
+        elif tag != "register_tee_addr":
+            raise Exception(f"invalid tag: {tag}")
+
+    def old_states(self, read):
+        """States as get_states returns them before anything was written: an
+        encrypted value with a zero sender for states not owned by all"""
+        word = lambda v: v.to_bytes(32, "big")
+        keys = {}
+        i = 0
+        while i < len(read):
+            sid, n = int.from_bytes(read[i], "big"), int.from_bytes(read[i + 1], "big")
+            depth = self.states[sid]["structural_type"]["depth"]
+            keys[sid] = (n, read[i + 2:i + 2 + n * depth])
+            i += 2 + n * depth
+
+        res = []
+        for sid, state in enumerate(self.states):
+            value = [word(0)] if state["owner"]["owner"] == "all" else [b"", b"", word(0)]
+            res.append(word(sid))
+            if state["structural_type"]["type"] != "mapping":
+                res.extend(value)
+                continue
+            n, key_words = keys.get(sid, (0, []))
+            depth = state["structural_type"]["depth"]
+            res.append(word(n))
+            for k in range(n):
+                res.extend(key_words[k * depth:(k + 1) * depth])
+                res.extend(value)
+        return res
+
+
+class MptWatcher(threading.Thread):
+    """Follows status changes with cloak_watch_mpts when a running agent
+    handles the queue instead of the stub agent"""
+
+    STAGES = {"REQUESTING_OLD_STATES": "old_states_requested", "SYNCING": "result_ready",
+              "SYNCED": "synced", "SYNC_FAILED": "failed", "DROPPED": "failed"}
+
+    def __init__(self, rpc, stats, poll_interval):
+        super().__init__(daemon=True)
+        self.rpc = rpc
+        self.stats = stats
+        self.poll_interval = poll_interval
+        self.stopped = threading.Event()
+
+    def run(self):
+        since = []
+        while not self.stopped.is_set():
+            try:
+                res = self.rpc.call("cloak_watch_mpts", {"ids": [], "since": since})
+            except Exception as err:
+                print(f"watch failed: {err}")
+                time.sleep(self.poll_interval)
+                continue
+            for change in res["changes"]:
+                if change["status"] in self.STAGES:
+                    self.stats.stage(change["id"], self.STAGES[change["status"]])
+            since = res["next"]
+            if not res["changes"]:
+                time.sleep(self.poll_interval)
+
+
+class Signer:
+    def __init__(self, account, nonce):
+        self.account = account
+        self.nonce = nonce
+        # multi party transactions only need a nonce no lower than the
+        # account's, which they do not increment. Counting them on top of it
+        # gives every one a distinct digest.
+        self.mpts = 0
+        self.lock = threading.Lock()
+
+    def mpt_nonce(self):
+        self.mpts += 1
+        return self.nonce + self.mpts
+
+
+class LoadGenerator:
+    def __init__(self, args):
+        self.args = args
+        self.stats = Stats()
+        self.rpc = Rpc(args, self.stats)
+        self.templates = [string.Template(open(f).read()) for f in args.mpt]
+        self.mix = self.parse_mix(args.mix)
+        with open(args.contract) as f:
+            self.bytecode = json.load(f)["contracts"][args.contract_name]["bin"]
+        with open(args.policy, "rb") as f:
+            self.policy_bytes = f.read()
+        self.signers = [Signer(account, 0) for account in self.load_accounts(args)]
+
+    @staticmethod
+    def load_accounts(args):
+        if args.signer_keys and os.path.exists(args.signer_keys):
+            with open(args.signer_keys) as f:
+                return [web3.Account.from_key(k) for k in json.load(f)][:args.signers]
+        accounts = [web3.Account.create() for _ in range(args.signers)]
+        if args.signer_keys:
+            with open(args.signer_keys, "w") as f:
+                json.dump([a.key.hex() for a in accounts], f)
+        return accounts
+
+    @staticmethod
+    def parse_mix(mix):
+        weights = {}
+        for item in mix.split(","):
+            name, weight = item.split("=")
+            if name not in ("mpt", "eth"):
+                raise ValueError(f"unknown operation {name}")
+            weights[name] = float(weight)
+        return weights
+
+    def setup(self):
+        try:
+            self.rpc.call("cloak_prepare", {"cloak_service_addr": self.args.cloak_service_address})
+        except RuntimeError as err:
+            print(f"cloak_prepare skipped: {err}")
+
+        owner = self.signers[0]
+        self.contract = contract_address(owner.account.address, owner.nonce)
+        self.send_eth(owner, data="0x" + self.bytecode)
+        code_hash = keccak_256(bytes.fromhex(self.bytecode))
+        verifier = bytes.fromhex(self.contract[2:])
+        raw = sign_privacy(owner.account.key, verifier, verifier, code_hash, self.policy_bytes)
+        self.rpc.call("cloak_sendRawPrivacyTransaction", [raw])
+        print(f"contract {self.contract} deployed with its policy")
+
+    def send_eth(self, signer, to=None, data="0x"):
+        with signer.lock:
+            tx = {"nonce": signer.nonce, "gas": 0, "gasPrice": 0, "value": 0, "data": data}
+            if to is not None:
+                tx["to"] = to
+            signed = signer.account.signTransaction(tx)
+            self.rpc.call("eth_sendRawTransaction", [signed.rawTransaction.hex()])
+            signer.nonce += 1
+
+    def send_mpt(self, signer):
+        peer = random.choice(self.signers)
+        body = random.choice(self.templates).substitute(sender=signer.account.address, peer=peer.account.address)
+        with signer.lock:
+            raw = sign_mpt(signer.account.key, bytes.fromhex(self.contract[2:]), body, signer.mpt_nonce())
+        start = time.monotonic()
+        mpt_hash = self.rpc.call("cloak_sendRawMultiPartyTransaction", [raw])
+        with self.stats.lock:
+            self.stats.mpts.setdefault(mpt_hash.lower(), {})["submitted"] = start
+
+    def operation(self, name):
+        signer = random.choice(self.signers)
+        try:
+            if name == "mpt":
+                self.send_mpt(signer)
+            else:
+                # a redeployment, as cloak-tee only runs calls to contracts
+                self.send_eth(signer, data="0x" + self.bytecode)
+        except Exception as err:
+            print(f"{name} failed: {err}")
+
+    def run(self):
+        self.setup()
+        before = self.rpc.metrics()
+        if self.args.no_stub_agent:
+            agent = MptWatcher(self.rpc, self.stats, self.args.poll_interval)
+        else:
+            agent = StubAgent(self.rpc, self.stats, json.loads(self.policy_bytes),
+                              [s.account for s in self.signers], self.args.poll_interval)
+        agent.start()
+
+        names, weights = list(self.mix), list(self.mix.values())
+        sent = 0
+        start = time.monotonic()
+        with ThreadPoolExecutor(max_workers=self.args.concurrency) as pool:
+            while True:
+                due = start + sent / self.args.rate
+                if due - start >= self.args.duration:
+                    break
+                time.sleep(max(0, due - time.monotonic()))
+                pool.submit(self.operation, random.choices(names, weights)[0])
+                sent += 1
+        elapsed = time.monotonic() - start
+
+        deadline = time.monotonic() + self.args.drain
+        while self.stats.open_mpts() > 0 and time.monotonic() < deadline:
+            time.sleep(0.1)
+        agent.stopped.set()
+        after = self.rpc.metrics()
+        self.report(sent, elapsed, before, after)
+
+    def report(self, sent, elapsed, before, after):
+        ms = lambda s: s * 1e3
+        print(f"\nsent {sent} operations in {elapsed:.1f}s, {sent / elapsed:.1f}/s "
+              f"(target {self.args.rate}/s)")
+
+        print(f"\n{'method':<40} {'calls':>7} {'errors':>7} {'p50 ms':>9} {'p99 ms':>9}")
+        for method, values in sorted(self.stats.latency.items()):
+            print(f"{method:<40} {len(values):>7} {self.stats.errors[method]:>7} "
+                  f"{ms(percentile(values, 0.5)):>9.2f} {ms(percentile(values, 0.99)):>9.2f}")
+
+        stages = ["submitted", "old_states_requested", "public_keys_requested", "result_ready", "synced"]
+        print(f"\n{'mpt stage':<40} {'count':>7} {'p50 ms':>9} {'p99 ms':>9}")
+        for i, stage in enumerate(stages[1:], 1):
+            # from the last stage seen before it, a watched run has no public key stage
+            d = [m[stage] - max(m[s] for s in stages[:i] if s in m)
+                 for m in self.stats.mpts.values() if stage in m and "submitted" in m]
+            print(f"{'-> ' + stage:<40} {len(d):>7} "
+                  f"{ms(percentile(d, 0.5)):>9.2f} {ms(percentile(d, 0.99)):>9.2f}")
+        done = [m["synced"] - m["submitted"] for m in self.stats.mpts.values() if "synced" in m and "submitted" in m]
+        print(f"{'completion':<40} {len(done):>7} {ms(percentile(done, 0.5)):>9.2f} "
+              f"{ms(percentile(done, 0.99)):>9.2f}")
+        failed = sum(1 for m in self.stats.mpts.values() if "failed" in m)
+        print(f"{failed} multi party transactions failed, {self.stats.open_mpts()} did not complete")
+
+        print(f"\n{'node phase':<40} {'count':>7} {'p50 ms':>9} {'p99 ms':>9}")
+        for phase, (bounds, counts) in sorted(phase_deltas(before, after).items()):
+            print(f"{phase:<40} {counts[-1]:>7} {ms(bucket_quantile(bounds, counts, 0.5)):>9.2f} "
+                  f"{ms(bucket_quantile(bounds, counts, 0.99)):>9.2f}")
+
+
+BUCKET = re.compile(r'cloak_phase_latency_seconds_bucket\{phase="([^"]+)",le="([^"]+)"\} (\d+)')
+
+
+def phase_buckets(text):
+    res = defaultdict(list)
+    for phase, le, count in BUCKET.findall(text):
+        res[phase].append((math.inf if le == "+Inf" else float(le), int(count)))
+    return res
+
+
+def phase_deltas(before, after):
+    """Cumulative bucket counts observed between two cloak_metrics scrapes"""
+    old = phase_buckets(before)
+    res = {}
+    for phase, buckets in phase_buckets(after).items():
+        prev = dict(old.get(phase, []))
+        bounds = [b for b, _ in buckets]
+        res[phase] = (bounds, [c - prev.get(b, 0) for b, c in buckets])
+    return res
+
+
+def bucket_quantile(bounds, counts, q):
+    """Linear interpolation within the bucket, as Prometheus histogram_quantile"""
+    if not counts or counts[-1] == 0:
+        return float("nan")
+    rank = q * counts[-1]
+    i = bisect.bisect_left(counts, rank)
+    if bounds[i] == math.inf:
+        return bounds[i - 1] if i > 0 else float("nan")
+    lower = bounds[i - 1] if i > 0 else 0.0
+    below = counts[i - 1] if i > 0 else 0
+    in_bucket = counts[i] - below
+    return lower + (bounds[i] - lower) * ((rank - below) / in_bucket if in_bucket else 1)
+
+
+if __name__ == "__main__":
+    LoadGenerator(get_args()).run()
@@ -59,8 +59,8 @@ class Decoder {
         return decoder.decode(inputs);
     }
 
-    static std::vector<std::string> decode_bytes_array(const std::vector<uint8_t>& inputs) {
-        std::vector<std::string> res;
+    static BytesList decode_bytes_array(const std::vector<uint8_t>& inputs) {
+        BytesList res;
         Decoder decoder;
         decoder.add_params("", "bytes[]", make_array_type(common_type("bytes")));
         auto arr_ptr = std::dynamic_pointer_cast<DynamicArray>(decoder.decode(inputs)[0]);
@@ -68,7 +68,7 @@ class Decoder {
             throw std::logic_error("Internal Error");
         }
         for (auto bytes_ptr : arr_ptr->get_parameters()) {
-            res.push_back(eevm::to_hex_string(bytes_ptr->get_value()));
+            res.push_back(bytes_ptr->get_value());
         }
         return res;
     }
@@ -17,6 +17,7 @@
 #include "abi/parse_types.h"
 #include "abi/types/array.h"
 #include "abi/types/type.h"
+#include "ethereum/keccak.h"
 
 namespace abicoder {
 
@@ -37,6 +38,11 @@ class Encoder {
         paramsCoder(_type_value, _value);
     }
 
+    void add_bytes_array(const std::string& _name, const BytesList& _value) {
+        add_params(_name, "bytes[]");
+        coders.push_back(std::make_shared<BytesArray>(_value));
+    }
+
     std::vector<uint8_t> encode() {
         return Coder::pack(coders);
     }
@@ -65,15 +71,18 @@ class Encoder {
     }
 
     std::vector<uint8_t> build_method_signature() {
-        std::string params;
+        Ethereum::Keccak256 k;
+        k.update(entry);
+        k.update("(");
         for (size_t i = 0; i < abi.size(); i++) {
-            params += abi[i].type;
-            if (i != abi.size() - 1) {
-                params += ",";
+            if (i != 0) {
+                k.update(",");
             }
+            k.update(abi[i].type);
         }
+        k.update(")");
 
-        auto sha3 = eevm::keccak_256(entry + "(" + params + ")");
+        auto sha3 = k.final();
         return std::vector<uint8_t>(sha3.begin(), sha3.begin() + 4);
     }
 
@@ -217,6 +217,63 @@ class StaticArray : public ArrayType {
     bool dynamic;
 };
 
+using BytesList = std::vector<std::vector<uint8_t>>;
+
+// bytes[] built from raw byte strings rather than hex JSON values
+class BytesArray : public Type {
+ public:
+    explicit BytesArray(const BytesList& _value = {}) {
+        for (auto&& v : _value) {
+            parameters.push_back(std::make_shared<DynamicBytes>(v));
+        }
+    }
+
+    std::vector<uint8_t> encode() override {
+        auto result = NumericType(parameters.size()).encode();
+        auto data = Coder::pack(parameters);
+        result.insert(result.end(), data.begin(), data.end());
+        return result;
+    }
+
+    void decode(const std::vector<uint8_t>& inputs) override {
+        auto arr = std::dynamic_pointer_cast<DynamicArray>(entry_identity(make_bytes_array()));
+        arr->decode(inputs);
+        parameters = arr->get_parameters();
+    }
+
+    std::string getTypeAsString() override {
+        return "bytes[]";
+    }
+
+    std::vector<uint8_t> get_value() override {
+        std::vector<uint8_t> data;
+        for (auto&& parameter : parameters) {
+            auto val = parameter->get_value();
+            data.insert(data.end(), val.begin(), val.end());
+        }
+        return data;
+    }
+
+    bool dynamicType() override {
+        return true;
+    }
+
+    size_t offset() override {
+        return MAX_BYTE_LENGTH;
+    }
+
+    BytesList get_bytes() {
+        BytesList res;
+        for (auto&& parameter : parameters) {
+            res.push_back(parameter->get_value());
+        }
+        return res;
+    }
+
+ private:
+    TypePtrLst parameters;
+};
+
 inline TypePrt generate_coders(const std::string& rawType,
                                const size_t& length,
                                const std::string& value = "") {
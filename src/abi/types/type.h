@@ -417,12 +417,13 @@ class DynamicBytes : public BytesType {
 
     explicit DynamicBytes(const std::string& src) : DynamicBytes(bytes_strip(src)) {}
 
+    explicit DynamicBytes(const std::vector<uint8_t>& _value) : BytesType(BYTES, _value) {}
+
     bool dynamicType() override {
         return true;
     }
 
  private:
-    explicit DynamicBytes(const std::vector<uint8_t>& _value) : BytesType(BYTES, _value) {}
 
     void isValid(const std::string& src) {
         if (src.size() == 0) {
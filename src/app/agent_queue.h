@@ -0,0 +1,137 @@
+// Copyright (c) 2020 Oxford-Hainan Blockchain Research Institute
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#include "ds/json.h"
+
+#include <algorithm>
+#include <kv/map.h>
+#include <kv/tx.h>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace cloak4ccf {
+namespace agent {
+
+// A work item for cloak-tee-agent. message holds JSON text, so that the KV
+// value stays a plain msgpack struct; the agent parses it.
+struct Message {
+    uint64_t seq = 0;
+    std::string tag;
+    std::string message;
+
+    MSGPACK_DEFINE(seq, tag, message);
+};
+
+DECLARE_JSON_TYPE(Message)
+DECLARE_JSON_REQUIRED_FIELDS(Message, seq, tag, message)
+
+struct Fetch {
+    // fetch at most max messages, capped at Queue::max_fetch
+    uint64_t max = 0;
+};
+
+DECLARE_JSON_TYPE(Fetch)
+DECLARE_JSON_REQUIRED_FIELDS(Fetch, max)
+
+struct Fetched {
+    std::vector<Message> messages;
+    // highest acknowledged and highest assigned sequence numbers
+    uint64_t acked = 0;
+    uint64_t last = 0;
+};
+
+DECLARE_JSON_TYPE(Fetched)
+DECLARE_JSON_REQUIRED_FIELDS(Fetched, messages, acked, last)
+
+struct Ack {
+    // acknowledges every message up to and including seq
+    uint64_t seq = 0;
+};
+
+DECLARE_JSON_TYPE(Ack)
+DECLARE_JSON_REQUIRED_FIELDS(Ack, seq)
+
+namespace tables {
+
+inline constexpr auto MESSAGES = "cloak.agent.messages";
+inline constexpr auto CURSORS = "cloak.agent.cursors";
+
+using Messages = kv::Map<uint64_t, Message>;
+// "last" and "acked" sequence numbers
+using Cursors = kv::Map<std::string, uint64_t>;
+
+struct Table {
+    Messages messages;
+    Cursors cursors;
+    Table() : messages(MESSAGES), cursors(CURSORS) {}
+};
+
+} // namespace tables
+
+// Outbound queue of agent work items. Messages are numbered from 1 in the
+// order their transactions commit, and stay in the KV until the agent
+// acknowledges them. Acks are cumulative and idempotent, so an agent that
+// records the last sequence number it handled sees every message exactly
+// once, also across restarts.
+class Queue {
+ public:
+    static constexpr auto LAST = "last";
+    static constexpr auto ACKED = "acked";
+    static constexpr uint64_t max_fetch = 1000;
+
+    Queue(kv::Tx& tx, tables::Table& table) :
+        messages(tx.get_view(table.messages)), cursors(tx.get_view(table.cursors)) {}
+
+    uint64_t push(const std::string& tag, const nlohmann::json& msg) {
+        const auto seq = cursors->get(LAST).value_or(0) + 1;
+        messages->put(seq, {seq, tag, msg.dump()});
+        cursors->put(LAST, seq);
+        return seq;
+    }
+
+    void ack(uint64_t seq) {
+        const auto acked = cursors->get(ACKED).value_or(0);
+        if (seq > cursors->get(LAST).value_or(0)) {
+            throw std::logic_error(fmt::format("Message {} has not been sent", seq));
+        }
+        for (auto s = acked + 1; s <= seq; s++) {
+            messages->remove(s);
+        }
+        cursors->put(ACKED, std::max(acked, seq));
+    }
+
+    template <typename TX>
+    static Fetched fetch(TX& tx, tables::Table& table, uint64_t max) {
+        auto messages = tx.get_read_only_view(table.messages);
+        auto cursors = tx.get_read_only_view(table.cursors);
+
+        Fetched res;
+        res.acked = cursors->get(ACKED).value_or(0);
+        res.last = cursors->get(LAST).value_or(0);
+        const auto end = std::min(res.last, res.acked + std::min(max, max_fetch));
+        for (auto s = res.acked + 1; s <= end; s++) {
+            res.messages.push_back(messages->get(s).value());
+        }
+        return res;
+    }
+
+ private:
+    tables::Messages::TxView* messages;
+    tables::Cursors::TxView* cursors;
+};
+
+} // namespace agent
+} // namespace cloak4ccf
@@ -0,0 +1,220 @@
+// Copyright (c) 2020 Oxford-Hainan Blockchain Research Institute
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <fmt/format.h>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace cloak4ccf {
+namespace metrics {
+
+using Clock = std::chrono::steady_clock;
+
+// Latency histogram with fixed buckets, updated without locking
+class Histogram {
+ public:
+    // upper bounds in microseconds, the last bucket is +Inf
+    static constexpr std::array<uint64_t, 15> bounds_us = {
+        100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000,
+        1000000, 2500000, 5000000};
+
+    void observe(uint64_t ns) {
+        const auto us = ns / 1000;
+        size_t i = 0;
+        while (i < bounds_us.size() && us > bounds_us[i]) {
+            i++;
+        }
+        buckets[i].fetch_add(1, std::memory_order_relaxed);
+        sum_ns.fetch_add(ns, std::memory_order_relaxed);
+    }
+
+    uint64_t count() const {
+        uint64_t n = 0;
+        for (auto&& b : buckets) {
+            n += b.load(std::memory_order_relaxed);
+        }
+        return n;
+    }
+
+    uint64_t total_ns() const {
+        return sum_ns.load(std::memory_order_relaxed);
+    }
+
+    // Prometheus text exposition, buckets are cumulative. labels must not be
+    // empty.
+    void write(std::string& out, const std::string& name, const std::string& labels) const {
+        uint64_t cumulative = 0;
+        for (size_t i = 0; i < bounds_us.size(); i++) {
+            cumulative += buckets[i].load(std::memory_order_relaxed);
+            out += fmt::format(
+                "{}_bucket{{{},le=\"{}\"}} {}\n", name, labels, bounds_us[i] / 1e6, cumulative);
+        }
+        cumulative += buckets[bounds_us.size()].load(std::memory_order_relaxed);
+        out += fmt::format("{}_bucket{{{},le=\"+Inf\"}} {}\n", name, labels, cumulative);
+        out += fmt::format(
+            "{}_sum{{{}}} {}\n", name, labels, sum_ns.load(std::memory_order_relaxed) / 1e9);
+        out += fmt::format("{}_count{{{}}} {}\n", name, labels, cumulative);
+    }
+
+ private:
+    std::array<std::atomic<uint64_t>, bounds_us.size() + 1> buckets = {};
+    std::atomic<uint64_t> sum_ns{0};
+};
+
+struct EndpointStats {
+    Histogram latency;
+    std::atomic<uint64_t> calls{0};
+    std::atomic<uint64_t> errors{0};
+};
+
+// Node-local metrics. Entries are created once, when an endpoint is installed
+// or a phase is first timed, and are never removed, so references to them
+// stay valid and recording does not take the lock.
+class Registry {
+ public:
+    static Registry& instance() {
+        static Registry r;
+        return r;
+    }
+
+    EndpointStats& endpoint(const std::string& method) {
+        std::lock_guard<std::mutex> guard(lock);
+        return endpoints[method];
+    }
+
+    Histogram& phase(const std::string& name) {
+        std::lock_guard<std::mutex> guard(lock);
+        return phases[name];
+    }
+
+    // Calls f(name, stats) for each endpoint and f(name, histogram) for each
+    // phase, in name order
+    template <typename E, typename P>
+    void visit(E&& on_endpoint, P&& on_phase) {
+        std::lock_guard<std::mutex> guard(lock);
+        for (auto&& [method, s] : endpoints) {
+            on_endpoint(method, s);
+        }
+        for (auto&& [name, h] : phases) {
+            on_phase(name, h);
+        }
+    }
+
+    std::string prometheus() {
+        std::lock_guard<std::mutex> guard(lock);
+        std::string out;
+        out += "# TYPE cloak_endpoint_calls_total counter\n";
+        for (auto&& [method, s] : endpoints) {
+            out += fmt::format("cloak_endpoint_calls_total{{method=\"{}\"}} {}\n",
+                               method,
+                               s.calls.load(std::memory_order_relaxed));
+        }
+        out += "# TYPE cloak_endpoint_errors_total counter\n";
+        for (auto&& [method, s] : endpoints) {
+            out += fmt::format("cloak_endpoint_errors_total{{method=\"{}\"}} {}\n",
+                               method,
+                               s.errors.load(std::memory_order_relaxed));
+        }
+        out += "# TYPE cloak_endpoint_latency_seconds histogram\n";
+        for (auto&& [method, s] : endpoints) {
+            s.latency.write(
+                out, "cloak_endpoint_latency_seconds", fmt::format("method=\"{}\"", method));
+        }
+        out += "# TYPE cloak_phase_latency_seconds histogram\n";
+        for (auto&& [name, h] : phases) {
+            h.write(out, "cloak_phase_latency_seconds", fmt::format("phase=\"{}\"", name));
+        }
+        return out;
+    }
+
+ private:
+    Registry() = default;
+
+    std::mutex lock;
+    std::map<std::string, EndpointStats> endpoints;
+    std::map<std::string, Histogram> phases;
+};
+
+// Times a scope into a histogram
+class Timer {
+ public:
+    explicit Timer(Histogram& h_) : h(h_), start(Clock::now()) {}
+
+    ~Timer() {
+        h.observe(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+    }
+
+ private:
+    Histogram& h;
+    Clock::time_point start;
+};
+
+// Runs f, timing it into h, and returns its result. See CLOAK_TIMED for
+// timing it as a named phase.
+template <typename F>
+decltype(auto) timed(Histogram& h, F&& f) {
+    Timer timer(h);
+    return f();
+}
+
+// Times one endpoint call. Calls that throw, or that are not marked ok, count
+// as errors.
+class Call {
+ public:
+    explicit Call(EndpointStats& s_) : s(s_), start(Clock::now()) {}
+
+    ~Call() {
+        s.latency.observe(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+        s.calls.fetch_add(1, std::memory_order_relaxed);
+        if (!ok) {
+            s.errors.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    bool ok = false;
+
+ private:
+    EndpointStats& s;
+    Clock::time_point start;
+};
+
+} // namespace metrics
+} // namespace cloak4ccf
+
+#define CLOAK_METRICS_CONCAT_(a, b) a##b
+#define CLOAK_METRICS_CONCAT(a, b) CLOAK_METRICS_CONCAT_(a, b)
+
+// Times the rest of the enclosing scope as the named phase
+#define CLOAK_PHASE(name)                                                                      \
+    static auto& CLOAK_METRICS_CONCAT(cloak_phase_histogram_, __LINE__) =                      \
+        cloak4ccf::metrics::Registry::instance().phase(name);                                  \
+    cloak4ccf::metrics::Timer CLOAK_METRICS_CONCAT(cloak_phase_timer_, __LINE__)(              \
+        CLOAK_METRICS_CONCAT(cloak_phase_histogram_, __LINE__))
+
+// The histogram of the named phase, looked up once per call site
+#define CLOAK_PHASE_HISTOGRAM(name)                                                            \
+    ([]() -> cloak4ccf::metrics::Histogram& {                                                  \
+        static auto& h = cloak4ccf::metrics::Registry::instance().phase(name);                 \
+        return h;                                                                              \
+    }())
+
+// Runs the callable as the named phase and returns its result
+#define CLOAK_TIMED(name, ...) cloak4ccf::metrics::timed(CLOAK_PHASE_HISTOGRAM(name), __VA_ARGS__)
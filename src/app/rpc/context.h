@@ -13,6 +13,7 @@
 // limitations under the License.
 
 #pragma once
+#include "app/agent_queue.h"
 #include "ethereum/tables.h"
 #include "ethereum/tee_account.h"
 #include "transaction/tables.h"
@@ -23,9 +24,11 @@ using SeqNo = int64_t;
 struct CloakTables {
     TransactionTables txTables;
     Ethereum::tables::AccountsState acc_state;
-    Ethereum::tables::Results tx_results;
+    Ethereum::tables::ResultsState tx_results;
+    Ethereum::tables::BlocksState blocks;
     TeeManager::tables::Table tee_table;
-    CloakTables() : txTables(), acc_state(), tx_results("eth.txresults"), tee_table() {}
+    agent::tables::Table agent;
+    CloakTables() : txTables(), acc_state(), tx_results(), blocks(), tee_table(), agent() {}
 };
 
 template <typename TX>
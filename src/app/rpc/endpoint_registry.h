@@ -14,8 +14,11 @@
 
 #pragma once
 #include "app/rpc/json_handler.h"
+#include "ethereum/code.h"
 #include "ethereum/execute_transaction.h"
+#include "ethereum/historical.h"
 #include "ethereum/json_rpc.h"
+#include "ethereum/speculative.h"
 #include "ethereum/types.h"
 #include "node/rpc/user_frontend.h"
 
@@ -27,7 +30,91 @@ class AbstractEndpointRegistry : public ccf::UserEndpointRegistry {
     CloakTables cloakTables;
     // account state
     explicit AbstractEndpointRegistry(ccf::NetworkTables& nwt) :
-        ccf::UserEndpointRegistry(nwt), cloakTables() {}
+        ccf::UserEndpointRegistry(nwt), cloakTables(), network(nwt) {
+        make_endpoint("cloak_batch",
+                      HTTP_POST,
+                      json_batch_adapter(json_handlers, json_read_only_handlers, cloakTables))
+            .install();
+        // batches of read-only calls, answered by the receiving node
+        make_read_only_endpoint(
+            "cloak_batch",
+            HTTP_GET,
+            json_read_only_batch_adapter(json_handlers, json_read_only_handlers, cloakTables))
+            .install();
+
+        // Prometheus text exposition of the node's metrics, served as is so
+        // that it can be scraped directly
+        make_read_only_endpoint("cloak_metrics", HTTP_GET, [](ccf::ReadOnlyEndpointContext& args) {
+            args.rpc_ctx->set_response_status(HTTP_STATUS_OK);
+            args.rpc_ctx->set_response_body(metrics::Registry::instance().prometheus());
+            args.rpc_ctx->set_response_header(http::headers::CONTENT_TYPE,
+                                              "text/plain; version=0.0.4");
+        }).install();
+    }
+
+ protected:
+    // Installs a JSON endpoint that can also be called from cloak_batch
+    decltype(auto) make_json_endpoint(const std::string& method,
+                                      RESTVerb verb,
+                                      const HandlerJsonParamsAndForward& f) {
+        const auto timed = instrument(method, f);
+        json_handlers.emplace(method, timed);
+        return make_endpoint(method, verb, json_adapter(timed, cloakTables));
+    }
+
+    decltype(auto) make_sax_endpoint(const std::string& method,
+                                     RESTVerb verb,
+                                     const HandlerSaxParams& f) {
+        const auto timed = instrument(method, f);
+        json_handlers.emplace(method, [timed](CloakContext& ctx, const nlohmann::json& params) {
+            return timed(ctx, sax::Params::from_json(params));
+        });
+        return make_endpoint(method, verb, sax_adapter(timed, cloakTables));
+    }
+
+    decltype(auto) make_json_read_only_endpoint(const std::string& method,
+                                                RESTVerb verb,
+                                                const ReadOnlyHandlerWithJson& f) {
+        const auto timed = instrument(method, f);
+        json_read_only_handlers.emplace(method, timed);
+        return make_read_only_endpoint(method, verb, json_read_only_adapter(timed, cloakTables));
+    }
+
+    // Installs a JSON endpoint only active members can call. Members are not
+    // users, so the caller's certificate is checked here instead of by the
+    // frontend. These endpoints cannot be called from cloak_batch.
+    decltype(auto) make_member_json_endpoint(const std::string& method,
+                                             RESTVerb verb,
+                                             const HandlerJsonParamsAndForward& f) {
+        auto adapter = json_adapter(instrument(method, f), cloakTables);
+        return make_endpoint(method,
+                             verb,
+                             [this, adapter](ccf::EndpointContext& args) {
+                                 if (!is_active_member(args.tx,
+                                                       args.rpc_ctx->session->caller_cert)) {
+                                     args.rpc_ctx->set_response_status(HTTP_STATUS_FORBIDDEN);
+                                     args.rpc_ctx->set_response_body(
+                                         "Only active members can call this endpoint");
+                                     return;
+                                 }
+                                 adapter(args);
+                             })
+            .set_require_client_identity(false);
+    }
+
+ private:
+    bool is_active_member(kv::Tx& tx, const std::vector<uint8_t>& cert) {
+        const auto id = tx.get_view(network.member_certs)->get(cert);
+        if (!id.has_value()) {
+            return false;
+        }
+        const auto info = tx.get_view(network.members)->get(id.value());
+        return info.has_value() && info->status == ccf::MemberStatus::ACTIVE;
+    }
+
+    ccf::NetworkTables& network;
+    JsonHandlers json_handlers;
+    ReadOnlyJsonHandlers json_read_only_handlers;
 };
 
 class EVMHandlers : public AbstractEndpointRegistry {
@@ -39,10 +126,20 @@ class EVMHandlers : public AbstractEndpointRegistry {
 
         auto get_gasPrice = [](CloakContext&, const nlohmann::json&) { return 0; };
 
+        auto get_block_number = [this](ReadOnlyCloakContext& ctx, const nlohmann::json&) {
+            const auto number = Ethereum::BlockProducer::open_number(ctx.tx, cloakTables.blocks);
+            return eevm::to_hex_string(number);
+        };
+
         auto get_balance = [this](CloakContext& ctx, const nlohmann::json& params) {
             auto gb = params.get<Ethereum::AddressWithBlock>();
-            if (gb.block_id != "latest") {
-                return ccf::make_error(HTTP_STATUS_BAD_REQUEST, "Can only request latest block");
+            const auto block = resolve_block(ctx.tx, gb.block_id);
+            if (block.has_value()) {
+                return historical_read<uint256_t>(ctx.tx,
+                                                  cloakTables.acc_state.accounts.balances,
+                                                  Ethereum::tables::AccountField::BALANCE,
+                                                  gb.address,
+                                                  block.value());
             }
 
             auto es = make_state(ctx.tx);
@@ -53,8 +150,13 @@ class EVMHandlers : public AbstractEndpointRegistry {
 
         auto get_transaction_count = [this](CloakContext& ctx, const nlohmann::json& params) {
             auto gtc = params.get<Ethereum::GetTransactionCount>();
-            if (gtc.block_id != "latest") {
-                return ccf::make_error(HTTP_STATUS_BAD_REQUEST, "Can only request latest block");
+            const auto block = resolve_block(ctx.tx, gtc.block_id);
+            if (block.has_value()) {
+                return historical_read<eevm::Account::Nonce>(ctx.tx,
+                                                             cloakTables.acc_state.accounts.nonces,
+                                                             Ethereum::tables::AccountField::NONCE,
+                                                             gtc.address,
+                                                             block.value());
             }
 
             auto es = make_state(ctx.tx);
@@ -63,17 +165,55 @@ class EVMHandlers : public AbstractEndpointRegistry {
             return ccf::make_success(eevm::to_hex_string(nonce));
         };
 
-        auto send_raw_transaction = [this](CloakContext& ctx, const nlohmann::json& params) {
-            auto srtp = params.get<Ethereum::SendRawTransaction>();
+        auto get_code = [this](CloakContext& ctx, const nlohmann::json& params) {
+            auto gc = params.get<Ethereum::AddressWithBlock>();
+            const auto block = resolve_block(ctx.tx, gc.block_id);
+            if (block.has_value()) {
+                return historical_code(ctx.tx, gc.address, block.value());
+            }
 
-            eevm::rlp::ByteString in = eevm::to_bytes(srtp.raw_transaction);
-            evm4ccf::EthereumTransactionWithSignature eth_tx(in);
+            const auto views = cloakTables.acc_state.accounts.get_views(ctx.tx);
+            const auto code = Ethereum::CodeStore::get(views, gc.address);
+            return ccf::make_success(eevm::to_hex_string(code != nullptr ? *code : eevm::Code{}));
+        };
 
-            Ethereum::MessageCall tc;
-            eth_tx.to_transaction_call(tc);
-            auto es = make_state(ctx.tx);
-            auto tx_result = Ethereum::EVMC(tc, es, ctx.tx.get_view(cloakTables.tx_results)).run();
-            return eevm::to_hex_string(tx_result);
+        auto send_raw_transaction = [](CloakContext& ctx, const sax::Params& params) {
+            return eevm::to_hex_string(Ethereum::send_raw_transaction(ctx, params.bytes(0)));
+        };
+
+        auto send_raw_transactions = [this](CloakContext& ctx, const sax::Params& params) {
+            std::vector<Ethereum::MessageCall> calls;
+            for (size_t i = 0; i < params.items.size(); i++) {
+                evm4ccf::EthereumTransactionWithSignature eth_tx(params.bytes(i));
+                eth_tx.to_transaction_call(calls.emplace_back());
+            }
+
+            Ethereum::BlockProducer blocks(ctx.tx, cloakTables.blocks);
+            Ethereum::speculative::SpeculativeExecutor executor(
+                ctx.tx,
+                cloakTables.acc_state,
+                blocks.current(),
+                ctx.tx.get_view(cloakTables.blocks.headers),
+                tables);
+            Ethereum::ReceiptStore receipts(ctx.tx, cloakTables.tx_results, &blocks);
+            auto executions = executor.run(calls, receipts);
+            for (auto&& ex : executions) {
+                // failed executions keep their partial writes, but none of
+                // them were applied, as for receipts
+                if (!ex.error.has_value()) {
+                    blocks.touch(ex.writes.accounts());
+                }
+            }
+
+            auto res = nlohmann::json::array();
+            for (auto&& ex : executions) {
+                if (ex.error.has_value()) {
+                    res.push_back({{"error", ex.error.value()}});
+                } else {
+                    res.push_back(eevm::to_hex_string(ex.tx_hash));
+                }
+            }
+            return res;
         };
 
         auto get_transaction_receipt = [this](ReadOnlyCloakContext& ctx,
@@ -82,8 +222,7 @@ class EVMHandlers : public AbstractEndpointRegistry {
 
             const evm4ccf::TxHash& tx_hash = gtrp.tx_hash;
 
-            auto results_view = ctx.tx.get_read_only_view(cloakTables.tx_results);
-            const auto r = results_view->get(tx_hash);
+            const auto r = Ethereum::ReceiptStore::get(ctx.tx, cloakTables.tx_results, tx_hash);
 
             // "or null when no receipt was found"
             Ethereum::ReceiptResponse response = std::nullopt;
@@ -97,47 +236,166 @@ class EVMHandlers : public AbstractEndpointRegistry {
                 } else {
                     response->to = 0x0;
                 }
+                const auto loc =
+                    Ethereum::BlockProducer::locate(ctx.tx, cloakTables.blocks, tx_hash);
+                if (loc.has_value()) {
+                    response->block_number = loc->first;
+                    response->transaction_index = loc->second;
+                    const auto header =
+                        Ethereum::BlockProducer::header(ctx.tx, cloakTables.blocks, loc->first);
+                    if (header.has_value()) {
+                        response->block_hash = header->block_hash;
+                    }
+                }
                 response->logs = tx_result.logs;
+                response->logs_bloom = Ethereum::logs::make_bloom(tx_result.logs);
                 response->status = 1;
             }
             return response;
         };
 
-        make_endpoint(
-            Ethereum::ethrpc::GetChainId::name, HTTP_GET, json_adapter(get_chainId, cloakTables))
+        auto get_logs = [this](ReadOnlyCloakContext& ctx, const nlohmann::json& params) {
+            auto glp = params.get<Ethereum::GetLogs>();
+            return Ethereum::find_logs(
+                ctx.tx, cloakTables.tx_results, cloakTables.blocks, glp.filter);
+        };
+
+        auto set_receipt_retention = [this](CloakContext& ctx, const nlohmann::json& params) {
+            auto retention = params.get<Ethereum::ReceiptRetention>();
+            Ethereum::ReceiptStore(ctx.tx, cloakTables.tx_results).set_retention(retention);
+            return true;
+        };
+
+        // The profiler is node-local and writes nothing to the KV, so it is
+        // switched by a read-only call, which the receiving node runs itself
+        // instead of forwarding it to the primary. Call it on every node to
+        // profile.
+        auto set_profiler = [](ReadOnlyCloakContext&, const nlohmann::json& params) {
+            auto sp = params.get<Ethereum::profiler::SetProfiler>();
+            auto& profiler = Ethereum::profiler::Profiler::instance();
+            if (sp.reset) {
+                profiler.reset();
+            }
+            profiler.set_sample_every(sp.sample_every);
+            profiler.set_enabled(sp.enabled);
+            return true;
+        };
+
+        auto get_profile = [](ReadOnlyCloakContext&, const nlohmann::json&) {
+            return Ethereum::profiler::Profiler::instance().get();
+        };
+
+        make_json_endpoint(Ethereum::ethrpc::GetChainId::name, HTTP_GET, get_chainId).install();
+
+        make_json_endpoint(Ethereum::ethrpc::GetGasPrice::name, HTTP_GET, get_gasPrice).install();
+
+        make_json_read_only_endpoint(Ethereum::ethrpc::GetBlockNumber::name,
+                                     HTTP_GET,
+                                     get_block_number)
             .install();
 
-        make_endpoint(
-            Ethereum::ethrpc::GetGasPrice::name, HTTP_GET, json_adapter(get_gasPrice, cloakTables))
+        make_json_endpoint(Ethereum::ethrpc::GetBalance::name, HTTP_GET, get_balance).install();
+
+        make_json_endpoint(Ethereum::ethrpc::GetCode::name, HTTP_GET, get_code).install();
+
+        make_json_endpoint(Ethereum::ethrpc::GetTransactionCount::name,
+                           HTTP_GET,
+                           get_transaction_count)
             .install();
 
-        make_endpoint(
-            Ethereum::ethrpc::GetBalance::name, HTTP_GET, json_adapter(get_balance, cloakTables))
+        make_sax_endpoint(Ethereum::ethrpc::SendRawTransaction::name,
+                          HTTP_POST,
+                          send_raw_transaction)
             .install();
 
-        make_endpoint(Ethereum::ethrpc::GetTransactionCount::name,
-                      HTTP_GET,
-                      json_adapter(get_transaction_count, cloakTables))
+        make_sax_endpoint("cloak_sendRawTransactions", HTTP_POST, send_raw_transactions).install();
+
+        make_json_read_only_endpoint(Ethereum::ethrpc::GetTransactionReceipt::name,
+                                     HTTP_GET,
+                                     get_transaction_receipt)
             .install();
 
-        make_endpoint(Ethereum::ethrpc::SendRawTransaction::name,
-                      HTTP_POST,
-                      json_adapter(send_raw_transaction, cloakTables))
+        make_json_read_only_endpoint(Ethereum::ethrpc::GetLogs::name, HTTP_GET, get_logs).install();
+
+        make_member_json_endpoint("cloak_set_receipt_retention", HTTP_POST, set_receipt_retention)
+            .set_auto_schema<Ethereum::ReceiptRetention, bool>()
+            .install();
+
+        make_json_read_only_endpoint("cloak_set_profiler", HTTP_POST, set_profiler)
+            .set_auto_schema<Ethereum::profiler::SetProfiler, bool>()
             .install();
 
-        make_read_only_endpoint(Ethereum::ethrpc::GetTransactionReceipt::name,
-                                HTTP_GET,
-                                json_read_only_adapter(get_transaction_receipt, cloakTables))
+        make_json_read_only_endpoint("cloak_get_profile", HTTP_GET, get_profile)
+            .set_auto_schema<void, Ethereum::profiler::Profile>()
             .install();
     }
 
  protected:
+    std::unique_ptr<Ethereum::HistoricalState> historical;
+
+    // nullopt for the open pseudo-block, whose state is the current state. An
+    // open block that has aged out is sealed first.
+    std::optional<uint64_t> resolve_block(kv::Tx& tx, const Ethereum::BlockID& id) {
+        Ethereum::BlockProducer(tx, cloakTables.blocks).seal_aged();
+        return Ethereum::BlockProducer::resolve(
+            id, Ethereum::BlockProducer::open_number(tx, cloakTables.blocks));
+    }
+
+    // Reads an account field at the end of a sealed pseudo-block. Answers 202
+    // while the historical stores are still being fetched.
+    template <typename V, typename M>
+    JsonAdapterResponse historical_read(kv::Tx& tx,
+                                        M& map,
+                                        Ethereum::tables::AccountField field,
+                                        const eevm::Address& addr,
+                                        uint64_t block) {
+        if (historical == nullptr) {
+            return ccf::make_error(HTTP_STATUS_BAD_REQUEST, "Historical state is not available");
+        }
+
+        const auto v = historical->get<V>(tx, map, field, addr, block);
+        if (!v.has_value()) {
+            return ccf::make_error(HTTP_STATUS_ACCEPTED,
+                                   "Historical state is not yet available, retry later");
+        }
+        return ccf::make_success(eevm::to_hex_string(v->value_or(V{})));
+    }
+
+    // Code is content addressed, so only the account's code hash is read from
+    // the historical stores and the code itself from the live KV
+    JsonAdapterResponse historical_code(kv::Tx& tx, const eevm::Address& addr, uint64_t block) {
+        auto& accounts = cloakTables.acc_state.accounts;
+        if (historical == nullptr) {
+            return ccf::make_error(HTTP_STATUS_BAD_REQUEST, "Historical state is not available");
+        }
+
+        const auto h = historical->get<uint256_t>(
+            tx, accounts.code_hashes, Ethereum::tables::AccountField::CODE, addr, block);
+        if (!h.has_value()) {
+            return ccf::make_error(HTTP_STATUS_ACCEPTED,
+                                   "Historical state is not yet available, retry later");
+        }
+        if (!h->has_value()) {
+            return historical_read<eevm::Code>(
+                tx, accounts.codes, Ethereum::tables::AccountField::CODE, addr, block);
+        }
+
+        const auto code = Ethereum::CodeStore::get_by_hash(accounts.get_views(tx), h->value());
+        return ccf::make_success(eevm::to_hex_string(*code));
+    }
+
     Ethereum::EthereumState make_state(kv::Tx& tx) {
         return Ethereum::EthereumState::make_state(tx, cloakTables.acc_state);
     }
 
  public:
-    explicit EVMHandlers(ccf::NetworkTables& nwt) : AbstractEndpointRegistry(nwt) {
+    explicit EVMHandlers(ccf::NetworkTables& nwt,
+                         ccf::historical::AbstractStateCache* historical_cache = nullptr) :
+        AbstractEndpointRegistry(nwt) {
+        if (historical_cache != nullptr) {
+            historical =
+                std::make_unique<Ethereum::HistoricalState>(*historical_cache, cloakTables.blocks);
+        }
         install_standard_rpcs();
     }
 };
@@ -13,11 +13,16 @@
 // limitations under the License.
 
 #pragma once
+#include "app/metrics.h"
 #include "app/rpc/context.h"
+#include "app/rpc/sax_params.h"
 #include "cloak_exception.h"
 #include "jsonrpc.h"
 #include "node/rpc/json_handler.h"
 
+#include <map>
+#include <optional>
+
 namespace cloak4ccf {
 
 using JsonAdapterResponse = ccf::jsonhandler::JsonAdapterResponse;
@@ -30,28 +35,43 @@ static JsonAdapterResponse make_error(const T& ctx,
     return ccf::jsonhandler::ErrorDetails{status, error_reason};
 }
 
-static void set_response(JsonAdapterResponse&& res, std::shared_ptr<enclave::RpcContext>& ctx) {
+static nlohmann::json to_response(SeqNo id, JsonAdapterResponse&& res) {
     auto error = std::get_if<ccf::jsonhandler::ErrorDetails>(&res);
     if (error != nullptr) {
-        ctx->set_response_status(error->status);
-        auto s = jsonrpc::error_response(0, std::move(error->msg));
-        ctx->set_response_body(s.dump());
+        return jsonrpc::error_response(id, std::move(error->msg));
+    }
+    return jsonrpc::result_response(id, std::get<nlohmann::json>(res));
+}
+
+// Responses use the same pack as the request. Bodies are moved into the
+// context rather than copied.
+static void set_response_body(const nlohmann::json& body,
+                              std::shared_ptr<enclave::RpcContext>& ctx,
+                              serdes::Pack pack) {
+    if (pack == serdes::Pack::MsgPack) {
+        ctx->set_response_body(serdes::pack(body, pack));
+        ctx->set_response_header(http::headers::CONTENT_TYPE,
+                                 http::headervalues::contenttype::MSGPACK);
     } else {
-        const auto body = std::get_if<nlohmann::json>(&res);
-        ctx->set_response_status(HTTP_STATUS_OK);
-        const auto s = fmt::format("{}\n", jsonrpc::result_response(0, *body).dump());
-        ctx->set_response_body(std::vector<uint8_t>(s.begin(), s.end()));
+        ctx->set_response_body(fmt::format("{}\n", body.dump()));
         ctx->set_response_header(http::headers::CONTENT_TYPE,
                                  http::headervalues::contenttype::TEXT);
     }
 }
 
+static void set_response(JsonAdapterResponse&& res,
+                         std::shared_ptr<enclave::RpcContext>& ctx,
+                         serdes::Pack pack) {
+    auto error = std::get_if<ccf::jsonhandler::ErrorDetails>(&res);
+    ctx->set_response_status(error != nullptr ? error->status : HTTP_STATUS_OK);
+    set_response_body(to_response(0, std::move(res)), ctx, pack);
+}
+
+// The request pack is taken from Content-Type, bodies without one are JSON
 static std::pair<serdes::Pack, nlohmann::json> get_json_params(
     const std::shared_ptr<enclave::RpcContext>& ctx) {
-    // Unsupport json input in client
-    // const auto pack = ccf::jsonhandler::detect_json_pack(ctx);
-    nlohmann::json params = nlohmann::json::parse(ctx->get_request_body());
-    return std::pair(serdes::Pack::Text, params);
+    const auto pack = ccf::jsonhandler::detect_json_pack(ctx).value_or(serdes::Pack::Text);
+    return std::pair(pack, serdes::unpack(ctx->get_request_body(), pack));
 }
 
 template <typename T>
@@ -74,10 +94,10 @@ using HandlerJsonParamsAndForward =
 static ccf::EndpointFunction json_adapter(const HandlerJsonParamsAndForward& f,
                                           CloakTables& table) {
     return [f, &table](ccf::EndpointContext& args) {
-        auto params = get_json_params(args.rpc_ctx).second;
+        auto [pack, params] = get_json_params(args.rpc_ctx);
         CloakContext ctx(args.tx, table);
         JsonAdapterResponse result = func([&]() { return f(ctx, params); }, ctx);
-        set_response(std::move(result), args.rpc_ctx);
+        set_response(std::move(result), args.rpc_ctx, pack);
     };
 }
 
@@ -87,11 +107,194 @@ using ReadOnlyHandlerWithJson =
 static ccf::ReadOnlyEndpointFunction json_read_only_adapter(const ReadOnlyHandlerWithJson& f,
                                                             CloakTables& table) {
     return [f, &table](ccf::ReadOnlyEndpointContext& args) {
-        auto params = get_json_params(args.rpc_ctx).second;
+        auto [pack, params] = get_json_params(args.rpc_ctx);
         ReadOnlyCloakContext ctx(args.tx, table);
         JsonAdapterResponse result = func([&]() { return f(ctx, params); }, ctx);
 
-        set_response(std::move(result), args.rpc_ctx);
+        set_response(std::move(result), args.rpc_ctx, pack);
+    };
+}
+
+using HandlerSaxParams =
+    std::function<JsonAdapterResponse(CloakContext& ctx, const sax::Params& params)>;
+
+// For handlers whose params are a flat list of strings: JSON bodies are decoded
+// by sax::parse without building a DOM, hex strings straight into bytes.
+// msgpack bodies are still unpacked into a DOM first.
+static ccf::EndpointFunction sax_adapter(const HandlerSaxParams& f, CloakTables& table) {
+    return [f, &table](ccf::EndpointContext& args) {
+        const auto pack =
+            ccf::jsonhandler::detect_json_pack(args.rpc_ctx).value_or(serdes::Pack::Text);
+        CloakContext ctx(args.tx, table);
+        JsonAdapterResponse result = func(
+            [&]() {
+                const auto& body = args.rpc_ctx->get_request_body();
+                const auto params = pack == serdes::Pack::Text ?
+                    sax::parse(body) :
+                    sax::Params::from_json(serdes::unpack(body, pack));
+                return f(ctx, params);
+            },
+            ctx);
+        set_response(std::move(result), args.rpc_ctx, pack);
+    };
+}
+
+// Wraps a handler so that its calls are recorded under method in the metrics
+// registry, both when called directly and from cloak_batch. Error results and
+// exceptions count as errors.
+template <typename Ctx, typename Params>
+std::function<JsonAdapterResponse(Ctx&, Params)> instrument(
+    const std::string& method, const std::function<JsonAdapterResponse(Ctx&, Params)>& f) {
+    auto& stats = metrics::Registry::instance().endpoint(method);
+    return [&stats, f](Ctx& ctx, Params params) {
+        metrics::Call call(stats);
+        auto res = f(ctx, std::forward<Params>(params));
+        call.ok = !std::holds_alternative<ccf::jsonhandler::ErrorDetails>(res);
+        return res;
+    };
+}
+
+using JsonHandlers = std::map<std::string, HandlerJsonParamsAndForward>;
+using ReadOnlyJsonHandlers = std::map<std::string, ReadOnlyHandlerWithJson>;
+
+// Runs the items of a JSON-RPC 2.0 batch in order and returns their
+// responses. Read-only items are answered by their handler, others by
+// write(i, call). Returns nullopt when items is not a non-empty array.
+template <typename Ctx, typename Write>
+static std::optional<nlohmann::json> run_batch(nlohmann::json& items,
+                                               const ReadOnlyJsonHandlers& read_only_handlers,
+                                               ReadOnlyCloakContext& ro_ctx,
+                                               Ctx& ctx,
+                                               Write&& write) {
+    if (!items.is_array() || items.empty()) {
+        return std::nullopt;
+    }
+
+    auto responses = nlohmann::json::array();
+    for (size_t i = 0; i < items.size(); i++) {
+        jsonrpc::ProcedureCall<nlohmann::json> call;
+        JsonAdapterResponse result = func(
+            [&]() -> JsonAdapterResponse {
+                // params may be omitted for methods that take none
+                auto& item = items[i];
+                if (item.is_object() && !item.contains(jsonrpc::PARAMS)) {
+                    item[jsonrpc::PARAMS] = nlohmann::json::object();
+                }
+                call = item.get<jsonrpc::ProcedureCall<nlohmann::json>>();
+                auto ro = read_only_handlers.find(call.method);
+                if (ro != read_only_handlers.end()) {
+                    return ro->second(ro_ctx, call.params);
+                }
+                return write(i, call);
+            },
+            ctx);
+        responses.push_back(to_response(call.id, std::move(result)));
+    }
+    return responses;
+}
+
+template <typename Ctx>
+static void set_batch_response(std::optional<nlohmann::json>&& responses,
+                               Ctx& ctx,
+                               std::shared_ptr<enclave::RpcContext>& rpc_ctx,
+                               serdes::Pack pack) {
+    if (!responses.has_value()) {
+        set_response(make_error(ctx, HTTP_STATUS_BAD_REQUEST, "Batch must be a non-empty array"),
+                     rpc_ctx,
+                     pack);
+        return;
+    }
+    rpc_ctx->set_response_status(HTTP_STATUS_OK);
+    set_response_body(responses.value(), rpc_ctx, pack);
+}
+
+// Runs a JSON-RPC 2.0 batch in a single KV transaction. Items run in order and
+// see the writes of earlier items. Read-only items are answered individually.
+// The write items are all or nothing: their partial writes cannot be undone
+// on their own, so the first failing write item discards the writes of the
+// whole batch. The other write items are then reported as rolled back or not
+// executed, and read-only items after a write may have seen discarded writes.
+// A batch without write items is not committed. Sent as GET it instead runs
+// in a read-only transaction on the node that received it, see
+// json_read_only_batch_adapter.
+static ccf::EndpointFunction json_batch_adapter(const JsonHandlers& handlers,
+                                                const ReadOnlyJsonHandlers& read_only_handlers,
+                                                CloakTables& table) {
+    return [&handlers, &read_only_handlers, &table](ccf::EndpointContext& args) {
+        auto [pack, items] = get_json_params(args.rpc_ctx);
+        CloakContext ctx(args.tx, table);
+        ReadOnlyCloakContext ro_ctx(args.tx, table);
+        std::vector<std::pair<size_t, SeqNo>> writes;
+        std::optional<size_t> failed;
+        auto responses = run_batch(
+            items,
+            read_only_handlers,
+            ro_ctx,
+            ctx,
+            [&](size_t i, const jsonrpc::ProcedureCall<nlohmann::json>& call)
+                -> JsonAdapterResponse {
+                auto rw = handlers.find(call.method);
+                if (rw == handlers.end()) {
+                    return make_error(ctx, HTTP_STATUS_NOT_FOUND, "Unknown method " + call.method);
+                }
+                if (failed.has_value()) {
+                    return make_error(ctx,
+                                      HTTP_STATUS_BAD_REQUEST,
+                                      fmt::format("Not executed, item {} failed", *failed));
+                }
+
+                writes.emplace_back(i, call.id);
+                auto res = func([&]() { return rw->second(ctx, call.params); }, ctx);
+                if (std::holds_alternative<ccf::jsonhandler::ErrorDetails>(res)) {
+                    failed = i;
+                }
+                return res;
+            });
+
+        if (writes.empty() || failed.has_value()) {
+            args.rpc_ctx->set_apply_writes(false);
+        }
+        if (failed.has_value()) {
+            for (auto&& [i, id] : writes) {
+                if (i != *failed) {
+                    (*responses)[i] = to_response(
+                        id,
+                        make_error(ctx,
+                                   HTTP_STATUS_BAD_REQUEST,
+                                   fmt::format("Rolled back, item {} failed", *failed)));
+                }
+            }
+        }
+        set_batch_response(std::move(responses), ctx, args.rpc_ctx, pack);
+    };
+}
+
+// Runs a JSON-RPC 2.0 batch of read-only calls in a read-only transaction, on
+// the node that received it. Items with a write method are answered with an
+// error, such batches go to json_batch_adapter.
+static ccf::ReadOnlyEndpointFunction json_read_only_batch_adapter(
+    const JsonHandlers& handlers,
+    const ReadOnlyJsonHandlers& read_only_handlers,
+    CloakTables& table) {
+    return [&handlers, &read_only_handlers, &table](ccf::ReadOnlyEndpointContext& args) {
+        auto [pack, items] = get_json_params(args.rpc_ctx);
+        ReadOnlyCloakContext ctx(args.tx, table);
+        auto responses = run_batch(
+            items,
+            read_only_handlers,
+            ctx,
+            ctx,
+            [&](size_t, const jsonrpc::ProcedureCall<nlohmann::json>& call)
+                -> JsonAdapterResponse {
+                if (handlers.find(call.method) == handlers.end()) {
+                    return make_error(ctx, HTTP_STATUS_NOT_FOUND, "Unknown method " + call.method);
+                }
+                return make_error(
+                    ctx,
+                    HTTP_STATUS_BAD_REQUEST,
+                    fmt::format("{} writes, send the batch with POST", call.method));
+            });
+        set_batch_response(std::move(responses), ctx, args.rpc_ctx, pack);
     };
 }
 
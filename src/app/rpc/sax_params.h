@@ -0,0 +1,197 @@
+// Copyright (c) 2020 Oxford-Hainan Blockchain Research Institute
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#include <cstdint>
+#include <nlohmann/json.hpp>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace cloak4ccf {
+namespace sax {
+
+// One positional parameter. 0x-prefixed strings are decoded into bytes while
+// parsing, anything else is kept as text.
+struct Param {
+    std::string text;
+    std::vector<uint8_t> bytes;
+    bool is_hex = false;
+};
+
+struct Params {
+    std::vector<Param> items;
+
+    const Param& at(size_t i) const {
+        if (i >= items.size()) {
+            throw std::logic_error("Missing parameter " + std::to_string(i));
+        }
+        return items[i];
+    }
+
+    const std::vector<uint8_t>& bytes(size_t i) const {
+        const auto& p = at(i);
+        if (!p.is_hex) {
+            throw std::logic_error("Parameter " + std::to_string(i) + " is not a hex string");
+        }
+        return p.bytes;
+    }
+
+    inline static Params from_json(const nlohmann::json& j);
+};
+
+inline uint8_t hex_digit(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    throw std::logic_error(std::string("Invalid hex digit ") + c);
+}
+
+inline void assign(Param& p, std::string&& s) {
+    if (s.size() < 2 || s[0] != '0' || (s[1] != 'x' && s[1] != 'X')) {
+        p.text = std::move(s);
+        return;
+    }
+
+    // an odd number of digits has an implicit leading zero
+    p.is_hex = true;
+    const size_t digits = s.size() - 2;
+    p.bytes.resize((digits + 1) / 2);
+    size_t in = 2;
+    size_t out = 0;
+    if (digits % 2 == 1) {
+        p.bytes[out++] = hex_digit(s[in++]);
+    }
+    for (; in < s.size(); in += 2) {
+        p.bytes[out++] = static_cast<uint8_t>(hex_digit(s[in]) << 4 | hex_digit(s[in + 1]));
+    }
+}
+
+// Accepts the same shapes as ParamsDecoder below: strings, in an array or in
+// arrays nested once more
+inline void collect(Params& params, const nlohmann::json& j, size_t depth) {
+    for (const auto& v : j) {
+        if (v.is_array()) {
+            if (depth == 2) {
+                throw std::logic_error("Unexpected nested array in parameters");
+            }
+            collect(params, v, depth + 1);
+            continue;
+        }
+        if (!v.is_string()) {
+            throw std::logic_error(std::string("Unexpected ") + v.type_name() + " in parameters");
+        }
+        assign(params.items.emplace_back(), v.get<std::string>());
+    }
+}
+
+inline Params Params::from_json(const nlohmann::json& j) {
+    Params params;
+    if (!j.is_array()) {
+        throw std::logic_error("Expected positional parameters");
+    }
+    collect(params, j, 1);
+    return params;
+}
+
+// SAX handler for a flat array of strings, either the params themselves or
+// an array nested once more, as in cloak_sendRawTransactions. No DOM is
+// built: each string token goes straight into its Param.
+class ParamsDecoder {
+ public:
+    explicit ParamsDecoder(Params& params_) : params(params_) {}
+
+    bool null() {
+        return fail("null");
+    }
+    bool boolean(bool) {
+        return fail("boolean");
+    }
+    bool number_integer(nlohmann::json::number_integer_t) {
+        return fail("number");
+    }
+    bool number_unsigned(nlohmann::json::number_unsigned_t) {
+        return fail("number");
+    }
+    bool number_float(nlohmann::json::number_float_t, const std::string&) {
+        return fail("number");
+    }
+    template <typename B>
+    bool binary(B&) {
+        return fail("binary");
+    }
+
+    bool string(std::string& val) {
+        if (depth == 0) {
+            return fail("string");
+        }
+        assign(params.items.emplace_back(), std::move(val));
+        return true;
+    }
+
+    bool start_object(std::size_t) {
+        return fail("object");
+    }
+    bool key(std::string&) {
+        return fail("object");
+    }
+    bool end_object() {
+        return fail("object");
+    }
+
+    bool start_array(std::size_t) {
+        return ++depth <= 2 || fail("nested array");
+    }
+    bool end_array() {
+        --depth;
+        return true;
+    }
+
+    bool parse_error(std::size_t position,
+                     const std::string&,
+                     const nlohmann::detail::exception& e) {
+        error = "Invalid JSON at " + std::to_string(position) + ": " + e.what();
+        return false;
+    }
+
+    std::string error;
+
+ private:
+    bool fail(const std::string& what) {
+        error = "Unexpected " + what + " in parameters";
+        return false;
+    }
+
+    Params& params;
+    size_t depth = 0;
+};
+
+template <typename Input>
+Params parse(const Input& body) {
+    Params params;
+    ParamsDecoder decoder(params);
+    if (!nlohmann::json::sax_parse(body.begin(), body.end(), &decoder)) {
+        throw std::logic_error(decoder.error);
+    }
+    return params;
+}
+
+} // namespace sax
+} // namespace cloak4ccf
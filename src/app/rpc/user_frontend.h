@@ -28,36 +28,30 @@ namespace cloak4ccf {
 class CloakEndpointRegistry : public EVMHandlers {
  public:
     CloakEndpointRegistry(ccf::NetworkTables& nwt, ccfapp::AbstractNodeContext& context) :
-        EVMHandlers(nwt) {
-        context.get_historical_state();
+        EVMHandlers(nwt, &context.get_historical_state()) {
         // register rpc
         install_standard_rpcs();
     }
 
  private:
     void install_standard_rpcs() {
-        auto send_raw_privacy_transaction = [this](CloakContext& ctx,
-                                                   const nlohmann::json& params) {
-            auto srt = params.get<Ethereum::SendRawTransaction>();
-
-            eevm::rlp::ByteString in = eevm::to_bytes(srt.raw_transaction);
+        auto send_raw_privacy_transaction = [this](CloakContext& ctx, const sax::Params& params) {
             Transaction::Generator gen(ctx);
-            auto digest = gen.add_privacy(in);
+            auto digest = gen.add_privacy(params.bytes(0));
             return eevm::to_hex_string(digest);
         };
 
         auto send_raw_multiParty_transaction = [this](CloakContext& ctx,
-                                                      const nlohmann::json& params) {
-            auto srmp = params.get<Ethereum::SendRawTransaction>();
-            eevm::rlp::ByteString in = eevm::to_bytes(srmp.raw_transaction);
+                                                      const sax::Params& params) {
             Transaction::Generator gen(ctx);
-            auto ct_digest = gen.add_cloakTransaction(in);
+            auto ct_digest = gen.add_cloakTransaction(params.bytes(0));
             return eevm::to_hex_string(ct_digest);
         };
 
         auto call_prepare = [this](CloakContext& ctx, const nlohmann::json& params) {
             auto prepare = params.get<TeePrepare>();
-            cloak4ccf::TeeManager::prepare(ctx.tx, cloakTables.tee_table, prepare);
+            cloak4ccf::TeeManager::prepare(
+                ctx.tx, cloakTables.tee_table, cloakTables.agent, prepare);
             return true;
         };
 
@@ -85,14 +79,30 @@ class CloakEndpointRegistry : public EVMHandlers {
         auto get_mpt = [this](ReadOnlyCloakContext& ctx, const nlohmann::json& params) {
             auto mpc = params.get<evm4ccf::MPT_CALL::In>();
             auto tx_hash = Utils::to_KeccakHash(mpc.id);
-            auto cp_handler = ctx.tx.get_read_only_view(cloakTables.txTables.cloak_policys);
-            auto cpt_opt = cp_handler->get(tx_hash);
-            if (!cpt_opt.has_value()) {
+            Transaction::ReadOnlyCloakPolicyStore policies(ctx.tx, cloakTables.txTables);
+            auto status = policies.get_status(tx_hash);
+            if (!status.has_value()) {
                 throw std::logic_error(fmt::format("tx_hash:{} not found", tx_hash));
             }
 
-            return evm4ccf::MPT_CALL::Out{cpt_opt->get_status(),
-                                          eevm::to_hex_string(cpt_opt->function.raw_outputs)};
+            auto payload = policies.get_payload(tx_hash);
+            return evm4ccf::MPT_CALL::Out{status.value(),
+                                          eevm::to_hex_string(payload->function.raw_outputs)};
+        };
+
+        auto get_mpts = [this](ReadOnlyCloakContext& ctx, const nlohmann::json& params) {
+            return Transaction::MptIndex::bulk_get(
+                ctx.tx, cloakTables.txTables, params.get<evm4ccf::MPT_BULK::In>());
+        };
+
+        auto list_mpts = [this](ReadOnlyCloakContext& ctx, const nlohmann::json& params) {
+            return Transaction::MptIndex::list(
+                ctx.tx, cloakTables.txTables, params.get<evm4ccf::MPT_LIST::In>());
+        };
+
+        auto watch_mpts = [this](ReadOnlyCloakContext& ctx, const nlohmann::json& params) {
+            return Transaction::StatusLog::watch(
+                ctx.tx, cloakTables.txTables, params.get<evm4ccf::MPT_WATCH::In>());
         };
 
         auto get_cloak = [this](CloakContext& ctx, const nlohmann::json&) {
@@ -103,35 +113,61 @@ class CloakEndpointRegistry : public EVMHandlers {
                 tee_acc->get_address(), service_addr, tee_acc->get_public_Key());
         };
 
-        make_endpoint("cloak_sendRawPrivacyTransaction",
-                      HTTP_POST,
-                      json_adapter(send_raw_privacy_transaction, cloakTables))
+        // cloak-tee-agent polls for work items and acknowledges them once
+        // handled
+        auto agent_fetch = [this](ReadOnlyCloakContext& ctx, const nlohmann::json& params) {
+            const auto fetch = params.get<agent::Fetch>();
+            return agent::Queue::fetch(ctx.tx, cloakTables.agent, fetch.max);
+        };
+
+        auto agent_ack = [this](CloakContext& ctx, const nlohmann::json& params) {
+            agent::Queue(ctx.tx, cloakTables.agent).ack(params.get<agent::Ack>().seq);
+            return true;
+        };
+
+        make_sax_endpoint("cloak_sendRawPrivacyTransaction",
+                          HTTP_POST,
+                          send_raw_privacy_transaction)
             .install();
 
-        make_endpoint("cloak_sendRawMultiPartyTransaction",
-                      HTTP_POST,
-                      json_adapter(send_raw_multiParty_transaction, cloakTables))
+        make_sax_endpoint("cloak_sendRawMultiPartyTransaction",
+                          HTTP_POST,
+                          send_raw_multiParty_transaction)
             .install();
 
-        make_endpoint("eth_sync_old_states", HTTP_POST, json_adapter(sync_old_states, cloakTables))
+        make_json_endpoint("eth_sync_old_states", HTTP_POST, sync_old_states).install();
+
+        make_json_endpoint("eth_sync_public_keys", HTTP_POST, sync_public_keys).install();
+
+        make_json_endpoint("cloak_prepare", HTTP_POST, call_prepare).install();
+
+        make_json_read_only_endpoint("cloak_get_mpt", HTTP_GET, get_mpt)
+            .set_auto_schema<evm4ccf::MPT_CALL>()
             .install();
 
-        make_endpoint(
-            "eth_sync_public_keys", HTTP_POST, json_adapter(sync_public_keys, cloakTables))
+        make_json_read_only_endpoint("cloak_get_mpts", HTTP_POST, get_mpts)
+            .set_auto_schema<evm4ccf::MPT_BULK>()
             .install();
 
-        make_endpoint("cloak_prepare", HTTP_POST, json_adapter(call_prepare, cloakTables))
+        make_json_read_only_endpoint("cloak_list_mpts", HTTP_POST, list_mpts)
+            .set_auto_schema<evm4ccf::MPT_LIST>()
             .install();
 
-        make_read_only_endpoint(
-            "cloak_get_mpt", HTTP_GET, json_read_only_adapter(get_mpt, cloakTables))
-            .set_auto_schema<evm4ccf::MPT_CALL>()
+        make_json_read_only_endpoint("cloak_watch_mpts", HTTP_POST, watch_mpts)
+            .set_auto_schema<evm4ccf::MPT_WATCH>()
             .install();
 
-        make_endpoint("cloak_sync_report", HTTP_POST, json_adapter(sync_report, cloakTables))
+        make_json_endpoint("cloak_sync_report", HTTP_POST, sync_report).install();
+
+        make_json_endpoint("cloak_get_cloak", HTTP_GET, get_cloak).install();
+
+        make_json_read_only_endpoint("cloak_agent_fetch", HTTP_POST, agent_fetch)
+            .set_auto_schema<agent::Fetch, agent::Fetched>()
             .install();
 
-        make_endpoint("cloak_get_cloak", HTTP_GET, json_adapter(get_cloak, cloakTables)).install();
+        make_json_endpoint("cloak_agent_ack", HTTP_POST, agent_ack)
+            .set_auto_schema<agent::Ack, bool>()
+            .install();
     }
 };
 
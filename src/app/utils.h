@@ -103,6 +103,12 @@ inline T parse(const std::string& s) {
     return j.get<T>();
 }
 
+// parses JSON text given as raw bytes
+template <typename T>
+inline T parse(const std::vector<uint8_t>& data) {
+    return nlohmann::json::parse(data.begin(), data.end()).get<T>();
+}
+
 inline eevm::KeccakHash to_KeccakHash(const std::string& _s) {
     auto s = eevm::strip(_s);
     eevm::KeccakHash h;
@@ -134,15 +140,6 @@ inline std::vector<uint8_t> get_random_id() {
     return tls::create_entropy()->random(256);
 }
 
-inline void cloak_agent_log(const std::string& tag, const nlohmann::json& msg) {
-    std::string magic_str = "ShouokOn";
-    nlohmann::json j;
-    j["seq"] = 0;
-    j["tag"] = tag;
-    j["message"] = msg;
-    LOG_INFO_FMT("{}{}{}", magic_str, j.dump(), magic_str);
-}
-
 inline std::vector<uint8_t> make_function_selector(const std::string& sign) {
     auto sha3 = eevm::keccak_256(sign);
     return {sha3.begin(), sha3.begin() + 4};
@@ -218,13 +215,13 @@ inline std::vector<T> vector_filter(const std::vector<T>& vec, std::function<T(T
     return res;
 }
 
-inline std::string repeat_hex_string(const std::string& str, size_t n) {
-    std::vector<uint8_t> res;
-    auto tmp = eevm::to_bytes(str);
-    for (size_t i = 0; i < n; i++) {
-        res.insert(res.end(), tmp.begin(), tmp.end());
+inline std::vector<std::string> to_hex_strings(const std::vector<std::vector<uint8_t>>& v) {
+    std::vector<std::string> res;
+    res.reserve(v.size());
+    for (auto&& b : v) {
+        res.push_back(eevm::to_hex_string(b));
     }
-    return eevm::to_hex_string(res);
+    return res;
 }
 
 } // namespace Utils
@@ -3,6 +3,8 @@
 #pragma once
 
 // EVM-for-CCF
+#include "code.h"
+#include "profiler.h"
 #include "tables.h"
 
 // eEVM
@@ -15,6 +17,12 @@ struct AccountProxy : public eevm::Account, public eevm::Storage {
     eevm::Address address;
     mutable tables::Accounts::Views accounts_views;
     tables::Storage::TxView& storage;
+    // fields written through this proxy, see EthereumState::written_accounts
+    bool balance_written = false;
+    bool nonce_written = false;
+    bool code_written = false;
+    // shared with CodeCache, read on first use
+    mutable SharedCode code;
 
     AccountProxy(const eevm::Address& a,
                  const tables::Accounts::Views& av,
@@ -33,6 +41,7 @@ struct AccountProxy : public eevm::Account, public eevm::Storage {
 
     void set_balance(const uint256_t& b) override {
         accounts_views.balances->put(address, b);
+        balance_written = true;
     }
 
     Nonce get_nonce() const override {
@@ -43,28 +52,36 @@ struct AccountProxy : public eevm::Account, public eevm::Storage {
         auto nonce = get_nonce();
         ++nonce;
         accounts_views.nonces->put(address, nonce);
+        nonce_written = true;
     }
 
     eevm::Code get_code() const override {
-        return accounts_views.codes->get(address).value_or(eevm::Code{});
+        if (code == nullptr) {
+            code = CodeStore::get(accounts_views, address);
+        }
+        return code != nullptr ? *code : eevm::Code{};
     }
 
     void set_code(eevm::Code&& c) override {
-        accounts_views.codes->put(address, c);
+        CodeStore::put(accounts_views, address, c);
+        code = std::make_shared<const eevm::Code>(std::move(c));
+        code_written = true;
     }
 
     // Implementation of eevm::Storage
-    std::pair<eevm::Address, uint256_t> translate(const uint256_t& key) {
-        return std::make_pair(address, key);
+    tables::StorageKey translate(const uint256_t& key) {
+        return {address, key};
     }
 
     // SNIPPET_START: store_impl
     void store(const uint256_t& key, const uint256_t& value) override {
+        profiler::KvProbe probe(address, true);
         storage.put(translate(key), value);
     }
     // SNIPPET_END: store_impl
 
     uint256_t load(const uint256_t& key) override {
+        profiler::KvProbe probe(address, false);
         return storage.get(translate(key)).value_or(0);
     }
 
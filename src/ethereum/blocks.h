@@ -0,0 +1,251 @@
+// Copyright (c) 2020 Oxford-Hainan Blockchain Research Institute
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#include "ethereum/exception.h"
+#include "ethereum/rlp_view.h"
+#include "ethereum/tables.h"
+#include "enclave/enclave_time.h"
+
+#include <chrono>
+#include <eEVM/globalstate.h>
+#include <eEVM/rlp.h>
+#include <eEVM/util.h>
+#include <kv/tx.h>
+
+namespace Ethereum {
+
+// Position of a recorded transaction: (block number, index in block)
+using TxLocation = std::pair<uint64_t, uint64_t>;
+
+// Groups recorded transactions into pseudo-blocks. Transactions go into the
+// open block, which is sealed when the next KV transaction finds it full or
+// older than max_age_s. A KV transaction therefore never spans two blocks.
+// Readers of block ids also seal an aged block, see seal_aged. Sealing fixes
+// the block hash; until then receipts of its transactions report a zero hash.
+//
+// So that concurrent transactions do not all write the same keys, the count
+// and root of the open block's transactions are kept in `shards` counters,
+// picked by transaction hash. A transaction's index in the block is its
+// position in its shard times `shards` plus the shard, so indexes are unique
+// but not contiguous. The open block's number and timestamp are only written
+// when it is opened or sealed, and a shard that fills up sets FULL for the
+// next transaction to seal the block.
+//
+// The open block counts as "latest": its transactions are already committed
+// in CCF, so the current KV state is the state of the open block.
+class BlockProducer {
+ public:
+    static constexpr auto NUMBER = "number";
+    static constexpr auto TIMESTAMP = "timestamp";
+    static constexpr auto FULL = "full";
+    static constexpr auto TX_COUNT = "tx_count";
+    static constexpr auto TX_ROOT = "tx_root";
+    static constexpr auto PARENT = "parent";
+
+    static constexpr uint64_t shards = 10;
+    static constexpr uint64_t max_txs = 100;
+    static constexpr uint64_t max_age_s = 2;
+
+    BlockProducer(kv::Tx& tx_, tables::BlocksState& bs_) :
+        tx(tx_),
+        headers(tx_.get_view(bs_.headers)),
+        pending(tx_.get_view(bs_.pending)),
+        versions(tx_.get_view(bs_.versions)),
+        locations(tx_.get_view(bs_.locations)),
+        bs(bs_) {}
+
+    // The block the transactions of this KV transaction go into. Seals the
+    // open block first if it is full or has aged out.
+    eevm::Block current() {
+        const auto now = now_s();
+        auto number = static_cast<uint64_t>(get(NUMBER));
+        const bool opened = versions->get(number).has_value();
+        if (opened && (get(FULL) != 0 || aged(now))) {
+            seal();
+            number++;
+        }
+        if (!versions->get(number).has_value()) {
+            open(number, now);
+        }
+
+        eevm::Block b = {};
+        b.number = number;
+        b.timestamp = static_cast<uint64_t>(get(TIMESTAMP));
+        return b;
+    }
+
+    // Seals the open block if it has aged out and holds transactions. A block
+    // spans the KV versions up to the first one of the next block, so one
+    // left open until the next transaction would span every version written
+    // meanwhile, which historical reads of it fetch.
+    void seal_aged() {
+        const auto now = now_s();
+        const auto number = static_cast<uint64_t>(get(NUMBER));
+        if (!versions->get(number).has_value() || !aged(now) || tx_count() == 0) {
+            return;
+        }
+        seal();
+        open(number + 1, now);
+    }
+
+    TxLocation add(const TxHash& hash) {
+        const auto number = current().number;
+        const auto shard = static_cast<uint64_t>(hash % shards);
+        const auto count_key = shard_key(TX_COUNT, shard);
+        const auto root_key = shard_key(TX_ROOT, shard);
+        const auto n = static_cast<uint64_t>(get(count_key));
+
+        Keccak256 k;
+        k.update_word(get(root_key));
+        k.update_word(hash);
+        const auto root = k.final();
+        pending->put(root_key, eevm::from_big_endian(root.data(), root.size()));
+        pending->put(count_key, n + 1);
+        if (n + 1 >= max_txs / shards && get(FULL) == 0) {
+            pending->put(FULL, 1);
+        }
+
+        // a block opened before the shards kept a single count, which the
+        // shards' indexes start after
+        const TxLocation loc = {number, static_cast<uint64_t>(get(TX_COUNT)) + n * shards + shard};
+        locations->put(hash, loc);
+        return loc;
+    }
+
+    // Records which fields of which accounts changed in the open block, so
+    // that historical reads of a field only look at blocks that wrote it
+    void touch(const tables::AccountWrites& writes) {
+        const auto number = static_cast<uint64_t>(get(NUMBER));
+        using tables::AccountField;
+        for (auto field : {AccountField::BALANCE, AccountField::NONCE, AccountField::CODE}) {
+            const auto& addresses = writes.of(field);
+            if (addresses.empty()) {
+                continue;
+            }
+            auto& index = bs.index(field);
+            auto blocks = tx.get_view(index.blocks);
+            auto size = tx.get_view(index.size);
+            for (auto&& addr : addresses) {
+                const auto n = size->get(addr).value_or(0);
+                if (n > 0 && blocks->get({addr, n - 1}) == number) {
+                    continue;
+                }
+                blocks->put({addr, n}, number);
+                size->put(addr, n + 1);
+            }
+        }
+    }
+
+    // Pseudo-block numbers accepted in place of "latest" are "pending",
+    // "earliest" and hex numbers. Returns nullopt for the open block.
+    static std::optional<uint64_t> resolve(const BlockID& id, uint64_t open_number) {
+        if (id == "latest" || id == "pending") {
+            return std::nullopt;
+        }
+        if (id == "earliest") {
+            return 0;
+        }
+
+        const auto n = eevm::to_uint64(id);
+        if (n > open_number) {
+            throw Exception(fmt::format("Unknown block {}", id));
+        }
+        if (n == open_number) {
+            return std::nullopt;
+        }
+        return n;
+    }
+
+    template <typename TX>
+    static uint64_t open_number(TX& tx, tables::BlocksState& bs) {
+        return static_cast<uint64_t>(
+            tx.get_read_only_view(bs.pending)->get(NUMBER).value_or(0));
+    }
+
+    template <typename TX>
+    static std::optional<TxLocation> locate(TX& tx, tables::BlocksState& bs, const TxHash& hash) {
+        return tx.get_read_only_view(bs.locations)->get(hash);
+    }
+
+    template <typename TX>
+    static std::optional<BlockHeader> header(TX& tx, tables::BlocksState& bs, uint64_t number) {
+        return tx.get_read_only_view(bs.headers)->get(number);
+    }
+
+ private:
+    // host time, as the enclave has no clock of its own
+    static uint64_t now_s() {
+        return std::chrono::duration_cast<std::chrono::seconds>(enclave::get_enclave_time())
+            .count();
+    }
+
+    static std::string shard_key(const char* field, uint64_t shard) {
+        return fmt::format("{}.{}", field, shard);
+    }
+
+    uint256_t get(const std::string& key) {
+        return pending->get(key).value_or(0);
+    }
+
+    bool aged(uint64_t now) {
+        return now >= get(TIMESTAMP) + max_age_s;
+    }
+
+    uint256_t tx_count() {
+        uint256_t count = get(TX_COUNT);
+        for (uint64_t s = 0; s < shards; s++) {
+            count += get(shard_key(TX_COUNT, s));
+        }
+        return count;
+    }
+
+    void open(uint64_t number, uint64_t now) {
+        pending->put(TIMESTAMP, now);
+        versions->put(number, tx.get_read_version());
+    }
+
+    void seal() {
+        BlockHeader h = {};
+        h.number = static_cast<uint64_t>(get(NUMBER));
+        h.timestamp = static_cast<uint64_t>(get(TIMESTAMP));
+
+        const auto count = tx_count();
+        Keccak256 root;
+        root.update_word(get(TX_ROOT));
+        for (uint64_t s = 0; s < shards; s++) {
+            root.update_word(get(shard_key(TX_ROOT, s)));
+            pending->remove(shard_key(TX_COUNT, s));
+            pending->remove(shard_key(TX_ROOT, s));
+        }
+        h.block_hash = eevm::from_big_endian(
+            rlp::keccak_list({get(PARENT), h.number, h.timestamp, count, root.final()}).data());
+        headers->put(h.number, h);
+
+        pending->put(NUMBER, h.number + 1);
+        pending->put(PARENT, h.block_hash);
+        pending->remove(FULL);
+        pending->remove(TX_COUNT);
+        pending->remove(TX_ROOT);
+    }
+
+    kv::Tx& tx;
+    tables::Blocks::TxView* headers;
+    tables::BlocksPending::TxView* pending;
+    tables::BlocksVersion::TxView* versions;
+    tables::TxLocations::TxView* locations;
+    tables::BlocksState& bs;
+};
+
+} // namespace Ethereum
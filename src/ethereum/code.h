@@ -0,0 +1,149 @@
+// Copyright (c) 2020 Oxford-Hainan Blockchain Research Institute
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#include "ethereum/exception.h"
+#include "ethereum/tables.h"
+
+#include <eEVM/util.h>
+#include <fmt/format.h>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+
+namespace Ethereum {
+
+using SharedCode = std::shared_ptr<const eevm::Code>;
+
+// Decoded code by keccak hash, shared between transactions. Entries are
+// immutable since the key is the hash of the content, so an entry read from
+// an uncommitted transaction is still correct for any other reader. Once the
+// cache holds more than max_entries the least recently used entry is dropped;
+// readers still holding it keep their copy alive.
+class CodeCache {
+ public:
+    static constexpr size_t default_max_entries = 1024;
+
+    explicit CodeCache(size_t max_entries_ = default_max_entries) : max_entries(max_entries_) {}
+
+    static CodeCache& instance() {
+        static CodeCache cache;
+        return cache;
+    }
+
+    SharedCode find(const uint256_t& hash) {
+        std::lock_guard<std::mutex> guard(lock);
+        const auto it = entries.find(hash);
+        if (it == entries.end()) {
+            return nullptr;
+        }
+        touch(it->second);
+        return it->second.code;
+    }
+
+    SharedCode insert(const uint256_t& hash, eevm::Code&& code) {
+        std::lock_guard<std::mutex> guard(lock);
+        auto [it, inserted] = entries.try_emplace(hash);
+        auto& entry = it->second;
+        if (!inserted) {
+            touch(entry);
+            return entry.code;
+        }
+
+        entry.code = std::make_shared<const eevm::Code>(std::move(code));
+        entry.used = order.insert(order.begin(), hash);
+        if (entries.size() > max_entries) {
+            entries.erase(order.back());
+            order.pop_back();
+        }
+        return entry.code;
+    }
+
+    size_t size() {
+        std::lock_guard<std::mutex> guard(lock);
+        return entries.size();
+    }
+
+ private:
+    struct Entry {
+        SharedCode code;
+        // position in order, most recently used first
+        std::list<uint256_t>::iterator used;
+    };
+
+    void touch(Entry& entry) {
+        order.splice(order.begin(), order, entry.used);
+    }
+
+    const size_t max_entries;
+    std::mutex lock;
+    std::unordered_map<uint256_t, Entry> entries;
+    std::list<uint256_t> order;
+};
+
+// Contract code is stored once per keccak hash (eth.code) and accounts refer
+// to it by hash (eth.account.codehash). Accounts whose code was written before
+// that are still read from eth.account.code, and move to the new tables the
+// next time their code is written.
+struct CodeStore {
+    static uint256_t hash(const eevm::Code& code) {
+        const auto h = eevm::keccak_256(code);
+        return eevm::from_big_endian(h.data(), h.size());
+    }
+
+    static bool exists(const tables::Accounts::Views& views, const eevm::Address& addr) {
+        return views.code_hashes->get(addr).has_value() || views.codes->get(addr).has_value();
+    }
+
+    static SharedCode get(const tables::Accounts::Views& views, const eevm::Address& addr) {
+        const auto h = views.code_hashes->get(addr);
+        if (!h.has_value()) {
+            auto legacy = views.codes->get(addr);
+            return legacy.has_value() ? std::make_shared<const eevm::Code>(std::move(*legacy))
+                                      : nullptr;
+        }
+        return get_by_hash(views, h.value());
+    }
+
+    static SharedCode get_by_hash(const tables::Accounts::Views& views, const uint256_t& h) {
+        auto& cache = CodeCache::instance();
+        if (auto code = cache.find(h)) {
+            return code;
+        }
+        auto code = views.code_contents->get(h);
+        if (!code.has_value()) {
+            throw Exception(fmt::format("Code {} is missing", eevm::to_hex_string(h)));
+        }
+        return cache.insert(h, std::move(code.value()));
+    }
+
+    static void put(const tables::Accounts::Views& views,
+                    const eevm::Address& addr,
+                    const eevm::Code& code) {
+        const auto h = hash(code);
+        // the cache may hold code of transactions that did not commit, so
+        // only the KV tells whether the content is stored
+        if (!views.code_contents->get(h).has_value()) {
+            views.code_contents->put(h, code);
+        }
+        views.code_hashes->put(addr, h);
+        if (views.codes->get(addr).has_value()) {
+            views.codes->remove(addr);
+        }
+    }
+};
+
+} // namespace Ethereum
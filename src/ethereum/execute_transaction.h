@@ -13,10 +13,14 @@
 // limitations under the License.
 
 #pragma once
+#include "app/metrics.h"
 #include "app/rpc/context.h"
+#include "ethereum/profiler.h"
+#include "ethereum/receipts.h"
 #include "ethereum/state.h"
 #include "ethereum/tee_manager.h"
 #include "ethereum/types.h"
+#include "ethereum_transaction.h"
 
 #include <eEVM/address.h>
 #include <eEVM/processor.h>
@@ -28,7 +32,9 @@ using MessageCall = Ethereum::MessageCall;
 using Address = eevm::Address;
 class AbstractEVM {
  protected:
-    AbstractEVM(const MessageCall& _call_data, EthereumState& _es, eevm::LogHandler& _log_handler) :
+    AbstractEVM(const MessageCall& _call_data,
+                eevm::GlobalState& _es,
+                eevm::LogHandler& _log_handler) :
         call_data(_call_data), es(_es), log_handler(_log_handler) {}
 
     std::tuple<eevm::ExecResult, evm4ccf::TxHash, Address> run_in_evm() {
@@ -71,20 +77,25 @@ class AbstractEVM {
             throw Exception(
                 fmt::format("this address [{}] is a common address", eevm::to_hex_string(to)));
         }
+
+        eevm::Trace tr;
+        eevm::Trace* trace = nullptr;
 #ifdef RECORD_TRACE
-        Trace tr;
+        trace = &tr;
 #endif // RECORD_TRACE
+        profiler::CallProbe probe(to);
+        if (probe.traces()) {
+            trace = &tr;
+        }
+
         eevm::Processor proc(es);
         const auto result = proc.run(eth_tx,
                                      call_data.from,
                                      account_state,
                                      eevm::to_bytes(call_data.data),
-                                     call_data.value
-#ifdef RECORD_TRACE
-                                     ,
-                                     &tr
-#endif // RECORD_TRACE
-        ); // NOLINT
+                                     call_data.value,
+                                     trace);
+        probe.finish(tr);
 #ifdef RECORD_TRACE
         if (result.er == eevm::ExitReason::threw) {
             LOG_INFO_FMT("--- Trace of failing evm execution ---\n{}", tr);
@@ -93,20 +104,27 @@ class AbstractEVM {
         return std::make_pair(result, account_state);
     }
 
-    EthereumState& es;
+    eevm::GlobalState& es;
     eevm::LogHandler& log_handler;
 };
 
 class EVMC : public AbstractEVM {
  private:
-    // kv::Tx tx;
-    tables::Results::TxView* results_view;
+    ReceiptStore* receipts;
 
  public:
-    EVMC(const MessageCall& call_data, EthereumState& es, tables::Results::TxView* views) :
-        AbstractEVM(call_data, es, vlh), results_view(views) {}
+    // receipts may be null when the result is never recorded (run_with_result, execute)
+    EVMC(const MessageCall& call_data, eevm::GlobalState& es, ReceiptStore* receipts_) :
+        AbstractEVM(call_data, es, vlh), receipts(receipts_) {}
     eevm::VectorLogHandler vlh;
     evm4ccf::TxHash run() {
+        const auto [tx_hash, tx_result] = execute();
+        receipts->put(tx_hash, tx_result);
+        return tx_hash;
+    }
+
+    // run the call without recording its result, the caller decides where it goes
+    std::pair<evm4ccf::TxHash, TxResult> execute() {
         const auto [exec_result, tx_hash, to_address] = run_in_evm();
         if (exec_result.er == eevm::ExitReason::threw) {
             throw std::logic_error(exec_result.exmsg);
@@ -118,9 +136,7 @@ class EVMC : public AbstractEVM {
         }
 
         tx_result.logs = vlh.logs;
-
-        results_view->put(tx_hash, tx_result);
-        return tx_hash;
+        return std::make_pair(tx_hash, tx_result);
     }
 
     eevm::ExecResult run_with_result() {
@@ -134,14 +150,34 @@ class EVMC : public AbstractEVM {
     }
 };
 
+// eth_sendRawTransaction: runs the transaction in the open pseudo-block and
+// records its receipt. Shared by the endpoint and the host harness.
+inline TxHash send_raw_transaction(cloak4ccf::CloakContext& ctx,
+                                   const std::vector<uint8_t>& raw) {
+    auto& tables = ctx.cloakTables;
+    evm4ccf::EthereumTransactionWithSignature eth_tx(raw);
+    MessageCall tc;
+    eth_tx.to_transaction_call(tc);
+
+    auto es = EthereumState::make_state(ctx.tx, tables.acc_state);
+    BlockProducer blocks(ctx.tx, tables.blocks);
+    es.set_current_block(blocks.current(), ctx.tx.get_view(tables.blocks.headers));
+    ReceiptStore receipts(ctx.tx, tables.tx_results, &blocks);
+    const auto tx_hash = EVMC(tc, es, &receipts).run();
+    blocks.touch(es.written_accounts());
+    return tx_hash;
+}
+
 std::vector<uint8_t> execute_mpt(cloak4ccf::CloakContext& ctx,
                                  evm4ccf::CloakPolicyTransaction& ct,
                                  const Address& tee_addr,
-                                 const std::vector<std::string>& decryped_states) {
+                                 const evm4ccf::ByteStrings& decryped_states) {
     kv::Tx& tx = ctx.tx;
     auto encoder = abicoder::Encoder("set_states");
-    encoder.add_inputs("data", "bytes[]", decryped_states, abicoder::make_bytes_array());
-    auto set_states_call_data = encoder.encodeWithSignatrue();
+    auto set_states_call_data = CLOAK_TIMED("abi_encode", [&]() {
+        encoder.add_bytes_array("data", decryped_states);
+        return encoder.encodeWithSignatrue();
+    });
 
     CLOAK_DEBUG_FMT("splited decryped_states_packed:\n{}",
                     fmt::join(abicoder::split_abi_data(encoder.encode()), "\n"));
@@ -149,24 +185,26 @@ std::vector<uint8_t> execute_mpt(cloak4ccf::CloakContext& ctx,
     MessageCall set_states_mc(tee_addr, ct.to, set_states_call_data);
     CLOAK_DEBUG_FMT("call_data:{}", eevm::to_hex_string(set_states_call_data));
     auto es = EthereumState::make_state(tx, ctx.cloakTables.acc_state);
-    auto set_states_res =
-        EVMC(set_states_mc, es, tx.get_view(ctx.cloakTables.tx_results)).run_with_result();
+    auto run = [&](const MessageCall& call) {
+        return CLOAK_TIMED("evm", [&]() { return EVMC(call, es, nullptr).run_with_result(); });
+    };
+    auto set_states_res = run(set_states_mc);
 
     // run in evm
-    auto data = ct.function.packed_to_data();
+    auto data = CLOAK_TIMED("abi_encode", [&]() { return ct.function.packed_to_data(); });
     MessageCall mc(ct.from, ct.to, data);
 
     CLOAK_DEBUG_FMT("ct function data: {}", mc.data);
-    const auto res = EVMC(mc, es, tx.get_view(ctx.cloakTables.tx_results)).run_with_result();
-    ct.function.raw_outputs = res.output;
+    const auto res = run(mc);
+    ct.set_outputs(res.output);
 
     // == get new states ==
-    auto get_new_states_call_data = ct.get_states_call_data(false);
+    auto get_new_states_call_data =
+        CLOAK_TIMED("abi_encode", [&]() { return ct.get_states_call_data(false); });
     CLOAK_DEBUG_FMT("get_new_states_call_data:{}", eevm::to_hex_string(get_new_states_call_data));
     MessageCall get_new_states_mc(tee_addr, ct.to, get_new_states_call_data);
 
-    auto get_new_states_res =
-        EVMC(get_new_states_mc, es, tx.get_view(ctx.cloakTables.tx_results)).run_with_result();
+    auto get_new_states_res = run(get_new_states_mc);
     CLOAK_DEBUG_FMT("get_new_states res:{}, {}, {}, {}",
                     get_new_states_res.er,
                     get_new_states_res.ex,
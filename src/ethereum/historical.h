@@ -0,0 +1,185 @@
+// Copyright (c) 2020 Oxford-Hainan Blockchain Research Institute
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#include "ethereum/exception.h"
+#include "ethereum/tables.h"
+#include "node/historical_queries_interface.h"
+
+#include <deque>
+#include <kv/tx.h>
+#include <mutex>
+#include <set>
+
+namespace Ethereum {
+
+// Reads account fields as of the end of a sealed pseudo-block from CCF's
+// historical stores. A historical store only holds the writes of its own
+// transaction, so the reader finds the newest block at or before the
+// requested one that wrote the field, from the field's index
+// (eth.account.blocks.balance, .nonce or .code). It then looks through that
+// block's versions from the last one down. Only these index tables are read
+// from the live KV.
+//
+// Blocks sealed before the index was kept per field are only listed in
+// eth.account.blocks, which records a block when any of the three fields was
+// written. Those entries are scanned back to the first one when the field's
+// own index has nothing at or before the block.
+//
+// Stores are fetched asynchronously. While any store the answer depends on is
+// still missing, get() returns nullopt and the caller should retry. Every
+// store of the block is requested at once, together with the stores of the
+// next block when that block also wrote the field, so sequential scans over
+// a balance history rarely wait. The oldest requests are dropped once more
+// than max_cached_versions are held.
+class HistoricalState {
+ public:
+    static constexpr size_t max_cached_versions = 4096;
+
+    HistoricalState(ccf::historical::AbstractStateCache& cache_, tables::BlocksState& bs_) :
+        cache(cache_), bs(bs_) {}
+
+    // Outer nullopt: still fetching. Inner nullopt: never written before the
+    // end of block.
+    template <typename V, typename M>
+    std::optional<std::optional<V>> get(kv::Tx& tx,
+                                        M& map,
+                                        tables::AccountField field,
+                                        const eevm::Address& addr,
+                                        uint64_t block) {
+        using Result = std::optional<std::optional<V>>;
+        std::optional<V> value;
+
+        const Index index(tx, bs.index(field), addr);
+        const auto n = index.count_at_or_before(block);
+        const bool next_sealed = tx.get_view(bs.versions)->get(block + 2).has_value();
+        if (n < index.size && index.at(n) == block + 1 && next_sealed) {
+            request_block(tx, block + 1);
+        }
+
+        if (n > 0) {
+            // every block in the field's index wrote the field
+            switch (find_in_block(tx, map, addr, index.at(n - 1), value)) {
+                case Found::YES:
+                    return Result(value);
+                case Found::FETCHING:
+                    return std::nullopt;
+                case Found::NO:
+                    throw Exception(fmt::format("No historical write of {} found in block {}",
+                                                eevm::to_checksum_address(addr),
+                                                index.at(n - 1)));
+            }
+        }
+
+        const Index legacy(tx, bs.account_blocks, addr);
+        for (auto i = legacy.count_at_or_before(block); i > 0; i--) {
+            switch (find_in_block(tx, map, addr, legacy.at(i - 1), value)) {
+                case Found::YES:
+                    return Result(value);
+                case Found::FETCHING:
+                    return std::nullopt;
+                case Found::NO:
+                    break;
+            }
+        }
+        return Result(std::optional<V>());
+    }
+
+ private:
+    enum class Found { YES, NO, FETCHING };
+
+    // Blocks of one account in an AccountBlocksIndex, in increasing order
+    struct Index {
+        tables::AccountBlocks::TxView* blocks;
+        eevm::Address addr;
+        uint64_t size;
+
+        Index(kv::Tx& tx, tables::AccountBlocksIndex& index, const eevm::Address& addr_) :
+            blocks(tx.get_view(index.blocks)),
+            addr(addr_),
+            size(tx.get_view(index.size)->get(addr_).value_or(0)) {}
+
+        uint64_t at(uint64_t i) const {
+            return blocks->get({addr, i}).value_or(0);
+        }
+
+        // number of entries at or before block
+        uint64_t count_at_or_before(uint64_t block) const {
+            uint64_t lo = 0, hi = size;
+            while (lo < hi) {
+                const auto mid = lo + (hi - lo) / 2;
+                if (at(mid) <= block) {
+                    lo = mid + 1;
+                } else {
+                    hi = mid;
+                }
+            }
+            return lo;
+        }
+    };
+
+    // The last value of map at addr written in block b
+    template <typename V, typename M>
+    Found find_in_block(
+        kv::Tx& tx, M& map, const eevm::Address& addr, uint64_t b, std::optional<V>& value) {
+        const auto stores = request_block(tx, b);
+        for (auto it = stores.rbegin(); it != stores.rend(); ++it) {
+            if (*it == nullptr) {
+                return Found::FETCHING;
+            }
+            auto hist_tx = (*it)->create_tx();
+            auto v = hist_tx.get_view(map)->get(addr);
+            if (v.has_value()) {
+                value = std::move(v);
+                return Found::YES;
+            }
+        }
+        return Found::NO;
+    }
+
+    // Versions of block b are (versions[b], versions[b + 1]]
+    std::vector<ccf::historical::StorePtr> request_block(kv::Tx& tx, uint64_t b) {
+        auto versions = tx.get_view(bs.versions);
+        const auto first = versions->get(b);
+        const auto last = versions->get(b + 1);
+        if (!first.has_value() || !last.has_value()) {
+            throw Exception(fmt::format("Block {} has not been sealed", b));
+        }
+
+        std::lock_guard<std::mutex> guard(lock);
+        std::vector<ccf::historical::StorePtr> stores;
+        for (auto v = first.value() + 1; v <= last.value(); v++) {
+            stores.push_back(cache.get_store_at(v));
+            if (requested.insert(v).second) {
+                order.push_back(v);
+            }
+        }
+
+        while (order.size() > max_cached_versions) {
+            cache.drop_request(order.front());
+            requested.erase(order.front());
+            order.pop_front();
+        }
+        return stores;
+    }
+
+    ccf::historical::AbstractStateCache& cache;
+    tables::BlocksState& bs;
+
+    std::mutex lock;
+    std::set<kv::Version> requested;
+    std::deque<kv::Version> order;
+};
+
+} // namespace Ethereum
@@ -59,6 +59,11 @@ struct GetEstimateGasTag {
 
 using GetEstimateGas = RpcBuilder<GetEstimateGasTag, EstimateGas, Result>;
 
+struct GetBlockNumberTag {
+    static constexpr auto name = "eth_blockNumber";
+};
+using GetBlockNumber = RpcBuilder<GetBlockNumberTag, void, size_t>;
+
 struct GetBalanceTag {
     static constexpr auto name = "eth_getBalance";
 };
@@ -81,6 +86,11 @@ struct GetTransactionReceiptTag {
 using GetTransactionReceipt =
     RpcBuilder<GetTransactionReceiptTag, GetTransactionReceipt, ReceiptResponse>;
 
+struct GetLogsTag {
+    static constexpr auto name = "eth_getLogs";
+};
+using GetLogs = RpcBuilder<GetLogsTag, GetLogs, std::vector<LogObject>>;
+
 struct SendRawTransactionTag {
     static constexpr auto name = "eth_sendRawTransaction";
 };
@@ -0,0 +1,68 @@
+// Copyright (c) 2020 Oxford-Hainan Blockchain Research Institute
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#include <eEVM/util.h>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <keccak/KeccakHash.h>
+}
+
+namespace Ethereum {
+
+// Keccak-256 as used by Ethereum (eevm::keccak_256), fed in pieces as the
+// input is produced rather than from one assembled buffer
+class Keccak256 {
+ public:
+    Keccak256() {
+        Keccak_HashInitialize(&instance, 1088, 512, 256, 0x01);
+    }
+
+    void update(const uint8_t* data, size_t size) {
+        Keccak_HashUpdate(&instance, data, size * 8);
+    }
+
+    void update(const std::vector<uint8_t>& data) {
+        update(data.data(), data.size());
+    }
+
+    void update(const std::string& s) {
+        update(reinterpret_cast<const uint8_t*>(s.data()), s.size());
+    }
+
+    // a 32 byte big endian word, as in ABI encoding
+    void update_word(const uint256_t& v) {
+        uint8_t buf[32];
+        eevm::to_big_endian(v, buf);
+        update(buf, sizeof(buf));
+    }
+
+    // lets the hasher be the sink of streaming encoders
+    void operator()(const uint8_t* data, size_t size) {
+        update(data, size);
+    }
+
+    eevm::KeccakHash final() {
+        eevm::KeccakHash h;
+        Keccak_HashFinal(&instance, h.data());
+        return h;
+    }
+
+ private:
+    Keccak_HashInstance instance;
+};
+
+} // namespace Ethereum
@@ -0,0 +1,138 @@
+// Copyright (c) 2020 Oxford-Hainan Blockchain Research Institute
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#include "ethereum/types.h"
+
+#include <algorithm>
+#include <eEVM/util.h>
+
+namespace Ethereum {
+namespace logs {
+
+static constexpr size_t ADDRESS_SIZE = 20;
+static constexpr size_t TOPIC_SIZE = 32;
+
+inline eevm::KeccakHash hash_word(const uint256_t& v, size_t size) {
+    uint8_t buf[TOPIC_SIZE] = {};
+    eevm::to_big_endian(v, buf);
+    return eevm::keccak_256(buf + TOPIC_SIZE - size, size);
+}
+
+// Sets the three bits selected by the low 11 bits of the first three byte pairs
+// of the hash, as in the yellow paper's M3:2048
+inline void add_to_bloom(Bloom& bloom, const eevm::KeccakHash& h) {
+    for (size_t i = 0; i < 6; i += 2) {
+        const size_t bit = ((h[i] << 8) | h[i + 1]) & 2047;
+        bloom[bloom.size() - 1 - bit / 8] |= static_cast<uint8_t>(1 << (bit % 8));
+    }
+}
+
+inline bool bloom_contains(const Bloom& bloom, const eevm::KeccakHash& h) {
+    Bloom probe = {};
+    add_to_bloom(probe, h);
+    for (size_t i = 0; i < bloom.size(); i++) {
+        if ((bloom[i] & probe[i]) != probe[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+inline Bloom make_bloom(const std::vector<eevm::LogEntry>& logs) {
+    Bloom bloom = {};
+    for (auto&& log : logs) {
+        add_to_bloom(bloom, hash_word(log.address, ADDRESS_SIZE));
+        for (auto&& topic : log.topics) {
+            add_to_bloom(bloom, hash_word(topic, TOPIC_SIZE));
+        }
+    }
+    return bloom;
+}
+
+// Index buckets: ANY_BUCKET for every log, keccak(address) for every log of a
+// contract, and keccak(address ++ topic0) for logs with at least one topic
+static const uint256_t ANY_BUCKET = 0;
+
+inline uint256_t bucket(const eevm::Address& address) {
+    const auto h = hash_word(address, ADDRESS_SIZE);
+    return eevm::from_big_endian(h.data(), h.size());
+}
+
+inline uint256_t bucket(const eevm::Address& address, const eevm::log::Topic& topic0) {
+    uint8_t buf[ADDRESS_SIZE + TOPIC_SIZE] = {};
+    uint8_t word[TOPIC_SIZE] = {};
+    eevm::to_big_endian(address, word);
+    std::copy(word + TOPIC_SIZE - ADDRESS_SIZE, word + TOPIC_SIZE, buf);
+    eevm::to_big_endian(topic0, buf + ADDRESS_SIZE);
+    const auto h = eevm::keccak_256(buf, sizeof(buf));
+    return eevm::from_big_endian(h.data(), h.size());
+}
+
+// Distinct buckets touched by a set of logs, ANY_BUCKET first and the others in
+// order of first appearance
+inline std::vector<uint256_t> buckets(const std::vector<eevm::LogEntry>& logs) {
+    std::vector<uint256_t> res = {ANY_BUCKET};
+    auto add = [&res](const uint256_t& b) {
+        if (std::find(res.begin(), res.end(), b) == res.end()) {
+            res.push_back(b);
+        }
+    };
+    for (auto&& log : logs) {
+        add(bucket(log.address));
+        if (!log.topics.empty()) {
+            add(bucket(log.address, log.topics[0]));
+        }
+    }
+    return res;
+}
+
+// A bloom may match the filter when it contains one of the addresses and, for
+// every constrained position, one of the topics
+inline bool may_match(const Bloom& bloom, const LogFilter& filter) {
+    auto any_of = [&bloom](const auto& words, size_t size) {
+        return words.empty() || std::any_of(words.begin(), words.end(), [&](const auto& w) {
+                   return bloom_contains(bloom, hash_word(w, size));
+               });
+    };
+
+    if (!any_of(filter.addresses, ADDRESS_SIZE)) {
+        return false;
+    }
+    return std::all_of(filter.topics.begin(), filter.topics.end(), [&](const auto& t) {
+        return any_of(t, TOPIC_SIZE);
+    });
+}
+
+inline bool matches(const eevm::LogEntry& log, const LogFilter& filter) {
+    auto contains = [](const auto& words, const auto& w) {
+        return words.empty() || std::find(words.begin(), words.end(), w) != words.end();
+    };
+
+    if (!contains(filter.addresses, log.address)) {
+        return false;
+    }
+    for (size_t i = 0; i < filter.topics.size(); i++) {
+        if (filter.topics[i].empty()) {
+            continue;
+        }
+        if (i >= log.topics.size() || !contains(filter.topics[i], log.topics[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace logs
+} // namespace Ethereum
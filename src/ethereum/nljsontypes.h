@@ -13,7 +13,8 @@ inline void to_json(nlohmann::json& j, const BlockHeader& s) {
     j["number"] = eevm::to_hex_string(s.number);
     j["difficulty"] = eevm::to_hex_string(s.difficulty);
     j["gasLimit"] = eevm::to_hex_string(s.gas_limit);
-    j["gasUsed"] = eevm::to_hex_string(s.gas_used);
+    // eEVM does not meter gas
+    j["gasUsed"] = "0x0";
     j["timestamp"] = eevm::to_hex_string(s.timestamp);
     j["miner"] = eevm::to_checksum_address(s.miner);
     j["hash"] = eevm::to_hex_string(s.block_hash);
@@ -25,7 +26,6 @@ inline void from_json(const nlohmann::json& j, BlockHeader& s) {
     s.number = eevm::to_uint64(j["number"]);
     s.difficulty = eevm::to_uint64(j["difficulty"]);
     s.gas_limit = eevm::to_uint64(j["gasLimit"]);
-    s.gas_used = eevm::to_uint64(j["gasUsed"]);
     s.timestamp = eevm::to_uint64(j["timestamp"]);
     s.miner = eevm::to_uint256(j["miner"]);
     s.block_hash = eevm::to_uint256(j["hash"]);
@@ -50,6 +50,29 @@ inline void to_json(nlohmann::json& j, const TxResult& txr) {
     j["logs"] = txr.logs;
 }
 
+inline void to_json(nlohmann::json& j, const StorageKey& k) {
+    j = eevm::to_hex_string(k.data());
+}
+
+inline void from_json(const nlohmann::json& j, StorageKey& k) {
+    if (j.is_array()) {
+        // [address, slot], as written before the fixed width key
+        k = StorageKey(eevm::to_uint256(j[0]), eevm::to_uint256(j[1]));
+        return;
+    }
+    StorageKey::Bytes bytes;
+    array_from_hex_string(bytes, j.get<std::string>());
+    k = StorageKey(bytes);
+}
+
+inline void to_json(nlohmann::json& j, const StorageValue& v) {
+    j = eevm::to_hex_string(v.value);
+}
+
+inline void from_json(const nlohmann::json& j, StorageValue& v) {
+    v.value = eevm::to_uint256(j);
+}
+
 inline void to_json(nlohmann::json& j, const ReceiptResponse& s) {
     if (!s.has_value()) {
         j = nullptr;
@@ -205,6 +228,97 @@ inline void from_json(const nlohmann::json& j, GetTransactionReceipt& s) {
     s.tx_hash = eevm::to_uint256(j[0]);
 }
 
+//
+inline void to_json(nlohmann::json& j, const LogFilter& s) {
+    j = nlohmann::json::object();
+    j["fromBlock"] = s.from_block;
+    j["toBlock"] = s.to_block;
+
+    auto j_addrs = nlohmann::json::array();
+    for (const auto& a : s.addresses) {
+        j_addrs.push_back(eevm::to_checksum_address(a));
+    }
+    j["address"] = j_addrs;
+
+    auto j_topics = nlohmann::json::array();
+    for (const auto& t : s.topics) {
+        if (t.empty()) {
+            j_topics.push_back(nullptr);
+            continue;
+        }
+        auto j_t = nlohmann::json::array();
+        for (const auto& topic : t) {
+            j_t.push_back(eevm::to_hex_string_fixed(topic));
+        }
+        j_topics.push_back(j_t);
+    }
+    j["topics"] = j_topics;
+}
+
+inline void from_json(const nlohmann::json& j, LogFilter& s) {
+    require_object(j);
+
+    s.from_block = j.value("fromBlock", std::string(DefaultBlockID));
+    s.to_block = j.value("toBlock", std::string(DefaultBlockID));
+
+    // "address" and each topic position may be a single value or a list of
+    // alternatives, null matches anything
+    const auto addr_it = j.find("address");
+    if (addr_it != j.end() && !addr_it->is_null()) {
+        if (addr_it->is_array()) {
+            for (const auto& a : *addr_it) {
+                s.addresses.push_back(eevm::to_uint256(a));
+            }
+        } else {
+            s.addresses.push_back(eevm::to_uint256(*addr_it));
+        }
+    }
+
+    const auto topics_it = j.find("topics");
+    if (topics_it != j.end() && !topics_it->is_null()) {
+        for (const auto& t : *topics_it) {
+            auto& alternatives = s.topics.emplace_back();
+            if (t.is_array()) {
+                for (const auto& topic : t) {
+                    alternatives.push_back(eevm::to_uint256(topic));
+                }
+            } else if (!t.is_null()) {
+                alternatives.push_back(eevm::to_uint256(t));
+            }
+        }
+    }
+}
+
+inline void to_json(nlohmann::json& j, const LogObject& s) {
+    j = s.log;
+    j["transactionHash"] = eevm::to_hex_string_fixed(s.transaction_hash);
+    j["logIndex"] = eevm::to_hex_string(s.log_index);
+    j["blockNumber"] = eevm::to_hex_string(s.block_number);
+    j["transactionIndex"] = eevm::to_hex_string(s.transaction_index);
+    j["blockHash"] = eevm::to_hex_string_fixed(s.block_hash);
+    j["removed"] = false;
+}
+
+inline void from_json(const nlohmann::json& j, LogObject& s) {
+    require_object(j);
+    s.log = j.get<eevm::LogEntry>();
+    s.transaction_hash = eevm::to_uint256(j["transactionHash"]);
+    s.log_index = eevm::to_uint64(j["logIndex"]);
+    s.block_number = eevm::to_uint64(j["blockNumber"]);
+    s.transaction_index = eevm::to_uint64(j["transactionIndex"]);
+    s.block_hash = eevm::to_uint256(j["blockHash"]);
+}
+
+inline void to_json(nlohmann::json& j, const GetLogs& s) {
+    j = nlohmann::json::array();
+    j.push_back(s.filter);
+}
+
+inline void from_json(const nlohmann::json& j, GetLogs& s) {
+    require_array(j);
+    s.filter = j[0];
+}
+
 inline void to_json(nlohmann::json& j, const EstimateGas& s) {
     j = nlohmann::json::array();
     j.push_back(s.call_data);
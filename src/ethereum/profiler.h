@@ -0,0 +1,313 @@
+// Copyright (c) 2020 Oxford-Hainan Blockchain Research Institute
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#include "ds/json.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <eEVM/address.h>
+#include <eEVM/trace.h>
+#include <eEVM/util.h>
+#include <fmt/format.h>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace Ethereum {
+namespace profiler {
+
+using Clock = std::chrono::steady_clock;
+
+inline uint64_t elapsed_ns(const Clock::time_point& start) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+}
+
+struct OpcodeProfile {
+    std::string opcode = {};
+    uint64_t count = 0;
+};
+
+DECLARE_JSON_TYPE(OpcodeProfile)
+DECLARE_JSON_REQUIRED_FIELDS(OpcodeProfile, opcode, count)
+
+struct ContractProfile {
+    std::string address = {};
+    uint64_t calls = 0;
+    // calls whose instructions were counted, see SetProfiler::sample_every
+    uint64_t traced_calls = 0;
+    uint64_t instructions = 0;
+    uint64_t evm_ns = 0;
+    uint64_t sloads = 0;
+    uint64_t sstores = 0;
+    uint64_t kv_ns = 0;
+};
+
+DECLARE_JSON_TYPE(ContractProfile)
+DECLARE_JSON_REQUIRED_FIELDS(ContractProfile,
+                             address,
+                             calls,
+                             traced_calls,
+                             instructions,
+                             evm_ns,
+                             sloads,
+                             sstores,
+                             kv_ns)
+
+struct BatchProfile {
+    uint64_t batches = 0;
+    uint64_t transactions = 0;
+    uint64_t reexecuted = 0;
+};
+
+DECLARE_JSON_TYPE(BatchProfile)
+DECLARE_JSON_REQUIRED_FIELDS(BatchProfile, batches, transactions, reexecuted)
+
+struct Profile {
+    bool enabled = false;
+    uint64_t sample_every = 0;
+    std::vector<OpcodeProfile> opcodes = {};
+    std::vector<ContractProfile> contracts = {};
+    BatchProfile speculative = {};
+};
+
+DECLARE_JSON_TYPE(Profile)
+DECLARE_JSON_REQUIRED_FIELDS(Profile, enabled, sample_every, opcodes, contracts, speculative)
+
+struct SetProfiler {
+    bool enabled = false;
+    bool reset = false;
+    // count the instructions of one call in sample_every, 1 counts them all
+    uint64_t sample_every = 16;
+};
+
+DECLARE_JSON_TYPE_WITH_OPTIONAL_FIELDS(SetProfiler)
+DECLARE_JSON_REQUIRED_FIELDS(SetProfiler, enabled)
+DECLARE_JSON_OPTIONAL_FIELDS(SetProfiler, reset, sample_every)
+
+// Mnemonic of an EVM opcode, or its hex value when unassigned
+inline std::string mnemonic(uint8_t op) {
+    if (op >= 0x60 && op <= 0x7f) {
+        return fmt::format("PUSH{}", op - 0x5f);
+    }
+    if (op >= 0x80 && op <= 0x8f) {
+        return fmt::format("DUP{}", op - 0x7f);
+    }
+    if (op >= 0x90 && op <= 0x9f) {
+        return fmt::format("SWAP{}", op - 0x8f);
+    }
+    if (op >= 0xa0 && op <= 0xa4) {
+        return fmt::format("LOG{}", op - 0xa0);
+    }
+
+    static const std::map<uint8_t, std::string> names = {
+        {0x00, "STOP"},         {0x01, "ADD"},          {0x02, "MUL"},
+        {0x03, "SUB"},          {0x04, "DIV"},          {0x05, "SDIV"},
+        {0x06, "MOD"},          {0x07, "SMOD"},         {0x08, "ADDMOD"},
+        {0x09, "MULMOD"},       {0x0a, "EXP"},          {0x0b, "SIGNEXTEND"},
+        {0x10, "LT"},           {0x11, "GT"},           {0x12, "SLT"},
+        {0x13, "SGT"},          {0x14, "EQ"},           {0x15, "ISZERO"},
+        {0x16, "AND"},          {0x17, "OR"},           {0x18, "XOR"},
+        {0x19, "NOT"},          {0x1a, "BYTE"},         {0x1b, "SHL"},
+        {0x1c, "SHR"},          {0x1d, "SAR"},          {0x20, "SHA3"},
+        {0x30, "ADDRESS"},      {0x31, "BALANCE"},      {0x32, "ORIGIN"},
+        {0x33, "CALLER"},       {0x34, "CALLVALUE"},    {0x35, "CALLDATALOAD"},
+        {0x36, "CALLDATASIZE"}, {0x37, "CALLDATACOPY"}, {0x38, "CODESIZE"},
+        {0x39, "CODECOPY"},     {0x3a, "GASPRICE"},     {0x3b, "EXTCODESIZE"},
+        {0x3c, "EXTCODECOPY"},  {0x3d, "RETURNDATASIZE"}, {0x3e, "RETURNDATACOPY"},
+        {0x3f, "EXTCODEHASH"},  {0x40, "BLOCKHASH"},    {0x41, "COINBASE"},
+        {0x42, "TIMESTAMP"},    {0x43, "NUMBER"},       {0x44, "DIFFICULTY"},
+        {0x45, "GASLIMIT"},     {0x46, "CHAINID"},      {0x47, "SELFBALANCE"},
+        {0x50, "POP"},          {0x51, "MLOAD"},        {0x52, "MSTORE"},
+        {0x53, "MSTORE8"},      {0x54, "SLOAD"},        {0x55, "SSTORE"},
+        {0x56, "JUMP"},         {0x57, "JUMPI"},        {0x58, "PC"},
+        {0x59, "MSIZE"},        {0x5a, "GAS"},          {0x5b, "JUMPDEST"},
+        {0xf0, "CREATE"},       {0xf1, "CALL"},         {0xf2, "CALLCODE"},
+        {0xf3, "RETURN"},       {0xf4, "DELEGATECALL"}, {0xf5, "CREATE2"},
+        {0xfa, "STATICCALL"},   {0xfd, "REVERT"},       {0xfe, "INVALID"},
+        {0xff, "SELFDESTRUCT"}};
+    const auto it = names.find(op);
+    return it != names.end() ? it->second : fmt::format("0x{:02x}", op);
+}
+
+// Node-local execution statistics, switched per node with the read-only
+// cloak_set_profiler. Off by default, in which case every probe costs a
+// single relaxed atomic load.
+//
+// eEVM only reports executed instructions as a full trace, which copies the
+// stack at every step. Only one call in sample_every is traced, the others
+// are timed only, and each trace is folded into per-opcode counters and
+// dropped as soon as its call returns.
+class Profiler {
+ public:
+    static Profiler& instance() {
+        static Profiler p;
+        return p;
+    }
+
+    bool enabled() const {
+        return on.load(std::memory_order_relaxed);
+    }
+
+    void set_enabled(bool enabled_) {
+        on.store(enabled_, std::memory_order_relaxed);
+    }
+
+    void set_sample_every(uint64_t n) {
+        sample_every.store(std::max<uint64_t>(n, 1), std::memory_order_relaxed);
+    }
+
+    // whether the next call should be traced
+    bool sample() {
+        return seen.fetch_add(1, std::memory_order_relaxed) %
+            sample_every.load(std::memory_order_relaxed) ==
+            0;
+    }
+
+    void reset() {
+        std::lock_guard<std::mutex> guard(lock);
+        opcodes.fill(0);
+        contracts.clear();
+        batches = {};
+    }
+
+    // trace is null for calls that were only timed
+    void record_call(const eevm::Address& addr, const eevm::Trace* trace, uint64_t ns) {
+        std::array<uint64_t, 256> counts = {};
+        if (trace != nullptr) {
+            for (auto&& e : trace->events) {
+                counts[static_cast<uint8_t>(e.op)]++;
+            }
+        }
+
+        std::lock_guard<std::mutex> guard(lock);
+        auto& c = contracts[addr];
+        c.calls++;
+        c.evm_ns += ns;
+        if (trace != nullptr) {
+            c.traced_calls++;
+            c.instructions += trace->events.size();
+            for (size_t op = 0; op < counts.size(); op++) {
+                opcodes[op] += counts[op];
+            }
+        }
+    }
+
+    void record_batch(uint64_t transactions, uint64_t reexecuted) {
+        std::lock_guard<std::mutex> guard(lock);
+        batches.batches++;
+        batches.transactions += transactions;
+        batches.reexecuted += reexecuted;
+    }
+
+    void record_kv(const eevm::Address& addr, bool is_store, uint64_t ns) {
+        std::lock_guard<std::mutex> guard(lock);
+        auto& c = contracts[addr];
+        if (is_store) {
+            c.sstores++;
+        } else {
+            c.sloads++;
+        }
+        c.kv_ns += ns;
+    }
+
+    Profile get() {
+        std::lock_guard<std::mutex> guard(lock);
+        Profile p;
+        p.enabled = enabled();
+        p.sample_every = sample_every.load(std::memory_order_relaxed);
+        p.speculative = batches;
+        for (size_t op = 0; op < opcodes.size(); op++) {
+            if (opcodes[op] != 0) {
+                p.opcodes.push_back({mnemonic(static_cast<uint8_t>(op)), opcodes[op]});
+            }
+        }
+        for (auto&& [addr, c] : contracts) {
+            auto cp = c;
+            cp.address = eevm::to_checksum_address(addr);
+            p.contracts.push_back(cp);
+        }
+        return p;
+    }
+
+ private:
+    Profiler() = default;
+
+    std::atomic<bool> on{false};
+    std::atomic<uint64_t> sample_every{SetProfiler().sample_every};
+    std::atomic<uint64_t> seen{0};
+    std::mutex lock;
+    std::array<uint64_t, 256> opcodes = {};
+    std::map<eevm::Address, ContractProfile> contracts;
+    BatchProfile batches = {};
+};
+
+// Times one SLOAD/SSTORE against the KV when profiling is on
+class KvProbe {
+ public:
+    KvProbe(const eevm::Address& addr_, bool is_store_) :
+        active(Profiler::instance().enabled()), addr(addr_), is_store(is_store_) {
+        if (active) {
+            start = Clock::now();
+        }
+    }
+
+    ~KvProbe() {
+        if (active) {
+            Profiler::instance().record_kv(addr, is_store, elapsed_ns(start));
+        }
+    }
+
+ private:
+    bool active;
+    const eevm::Address& addr;
+    bool is_store;
+    Clock::time_point start;
+};
+
+// Times one eevm::Processor::run. Opcode counts are taken from the eEVM trace,
+// which is only recorded for the calls the profiler samples.
+class CallProbe {
+ public:
+    explicit CallProbe(const eevm::Address& addr_) :
+        active(Profiler::instance().enabled()),
+        traced(active && Profiler::instance().sample()),
+        addr(addr_) {
+        if (active) {
+            start = Clock::now();
+        }
+    }
+
+    // whether the call should record an eEVM trace for finish
+    bool traces() const {
+        return traced;
+    }
+
+    void finish(const eevm::Trace& trace) {
+        if (active) {
+            Profiler::instance().record_call(addr, traced ? &trace : nullptr, elapsed_ns(start));
+        }
+    }
+
+ private:
+    bool active;
+    bool traced;
+    eevm::Address addr;
+    Clock::time_point start;
+};
+
+} // namespace profiler
+} // namespace Ethereum
@@ -0,0 +1,381 @@
+// Copyright (c) 2020 Oxford-Hainan Blockchain Research Institute
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#include "ds/json.h"
+#include "ethereum/blocks.h"
+#include "ethereum/exception.h"
+#include "ethereum/logs.h"
+#include "ethereum/tables.h"
+
+#include <algorithm>
+#include <kv/tx.h>
+#include <limits>
+#include <map>
+#include <set>
+#include <vector>
+
+namespace Ethereum {
+
+struct ReceiptRetention {
+    // number of most recent results kept in eth.txresults, 0 keeps everything
+    uint64_t window = 0;
+    // move pruned results to eth.txresults.cold instead of dropping them
+    bool cold = false;
+};
+
+DECLARE_JSON_TYPE_WITH_OPTIONAL_FIELDS(ReceiptRetention)
+DECLARE_JSON_REQUIRED_FIELDS(ReceiptRetention, window)
+DECLARE_JSON_OPTIONAL_FIELDS(ReceiptRetention, cold)
+
+// Writes transaction results and enforces the retention window. Only results
+// written while a window is set are tracked, so that the unbounded default
+// does not make every transaction write a sequence counter. Tracked results
+// are spread over `shards` sequences by hash, each keeping window / shards
+// results, so that concurrent transactions rarely write the same counter.
+class ReceiptStore {
+ public:
+    // HEAD and TAIL alone are the single sequence used before the shards,
+    // shard s uses "head.<s>" and "tail.<s>"
+    static constexpr auto HEAD = "head";
+    static constexpr auto TAIL = "tail";
+    static constexpr auto WINDOW = "window";
+    static constexpr auto COLD = "cold";
+    static constexpr uint64_t shards = 10;
+    // bounds the extra work a single transaction does once a window shrinks
+    static constexpr size_t max_pruned_per_put = 8;
+
+    // blocks may be null when results are not placed into pseudo-blocks
+    ReceiptStore(kv::Tx& tx, tables::ResultsState& rs, BlockProducer* blocks_ = nullptr) :
+        blocks(blocks_),
+        results(tx.get_view(rs.results)),
+        cold(tx.get_view(rs.cold)),
+        order(tx.get_view(rs.order)),
+        retention(tx.get_view(rs.retention)),
+        blooms(tx.get_view(rs.blooms)),
+        logs_index(tx.get_view(rs.logs_index)),
+        logs_index_size(tx.get_view(rs.logs_index_size)) {}
+
+    void put(const TxHash& hash, const TxResult& result) {
+        results->put(hash, result);
+        const auto loc = blocks != nullptr ? blocks->add(hash) : TxLocation{0, 0};
+        index_logs(hash, result, loc.first);
+
+        const auto window = retention->get(WINDOW).value_or(0);
+        if (window == 0) {
+            return;
+        }
+
+        // a single sequence is kept up until set_retention moves it into the
+        // shards
+        const auto legacy_head = retention->get(HEAD);
+        if (legacy_head.has_value()) {
+            const auto head = legacy_head.value();
+            order->put(head, hash);
+            retention->put(HEAD, head + 1);
+            prune(TAIL, head + 1, window, max_pruned_per_put, [](uint64_t n) { return n; });
+            return;
+        }
+
+        const auto s = static_cast<uint64_t>(hash % shards);
+        const auto head = retention->get(shard_key(HEAD, s)).value_or(0);
+        order->put(head * shards + s, hash);
+        retention->put(shard_key(HEAD, s), head + 1);
+        prune(shard_key(TAIL, s), head + 1, per_shard(window), max_pruned_per_put, [s](uint64_t n) {
+            return n * shards + s;
+        });
+    }
+
+    // Setting a window also tracks and prunes the results written while none
+    // was set, which takes a pass over all results
+    void set_retention(const ReceiptRetention& r) {
+        retention->put(WINDOW, r.window);
+        retention->put(COLD, r.cold ? 1 : 0);
+        if (r.window == 0) {
+            return;
+        }
+
+        track_all();
+        for (uint64_t s = 0; s < shards; s++) {
+            prune(shard_key(TAIL, s),
+                  retention->get(shard_key(HEAD, s)).value_or(0),
+                  per_shard(r.window),
+                  std::numeric_limits<size_t>::max(),
+                  [s](uint64_t n) { return n * shards + s; });
+        }
+    }
+
+    // Logs are indexed per slot: a block and, as in BlockProducer, a shard of
+    // it picked by transaction hash. Only transactions of the same block and
+    // shard write the same index counters, and they already share
+    // BlockProducer's.
+    static uint64_t slot(uint64_t block, uint64_t shard) {
+        return block * BlockProducer::shards + shard;
+    }
+
+    ReceiptRetention get_retention() {
+        return {retention->get(WINDOW).value_or(0), retention->get(COLD).value_or(0) != 0};
+    }
+
+    // Results are looked up in the hot table first, then in the cold one
+    template <typename TX>
+    static std::optional<TxResult> get(TX& tx, tables::ResultsState& rs, const TxHash& hash) {
+        auto r = tx.get_read_only_view(rs.results)->get(hash);
+        if (r.has_value()) {
+            return r;
+        }
+        return tx.get_read_only_view(rs.cold)->get(hash);
+    }
+
+ private:
+    static std::string shard_key(const char* field, uint64_t shard) {
+        return fmt::format("{}.{}", field, shard);
+    }
+
+    static uint64_t per_shard(uint64_t window) {
+        return (window + shards - 1) / shards;
+    }
+
+    // Drops the oldest results of a sequence, at most max of them, until no
+    // more than window are left. key maps a position to its order entry.
+    template <typename Key>
+    void prune(const std::string& tail_key, uint64_t head, uint64_t window, size_t max, Key&& key) {
+        auto tail = retention->get(tail_key).value_or(0);
+        const bool to_cold = retention->get(COLD).value_or(0) != 0;
+        for (size_t n = 0; head - tail > window && n < max; n++, tail++) {
+            const auto hash = order->get(key(tail));
+            order->remove(key(tail));
+            if (!hash.has_value()) {
+                continue;
+            }
+
+            const auto r = results->get(hash.value());
+            if (r.has_value()) {
+                if (to_cold) {
+                    cold->put(hash.value(), r.value());
+                }
+                unindex_logs(hash.value(), r.value());
+            }
+            results->remove(hash.value());
+        }
+        retention->put(tail_key, tail);
+    }
+
+    // Lays the shards out again from position 0: first the results that were
+    // never tracked, in no particular order, as they were written before any
+    // window was set, then those of the single sequence, then those already in
+    // the shards.
+    void track_all() {
+        std::set<TxHash> tracked;
+        std::vector<TxHash> legacy;
+        std::vector<std::vector<TxHash>> sharded(shards);
+        auto take = [&](uint64_t key, std::vector<TxHash>& into) {
+            const auto hash = order->get(key);
+            order->remove(key);
+            if (hash.has_value() && tracked.insert(hash.value()).second) {
+                into.push_back(hash.value());
+            }
+        };
+
+        const auto legacy_head = retention->get(HEAD);
+        if (legacy_head.has_value()) {
+            for (auto n = retention->get(TAIL).value_or(0); n < legacy_head.value(); n++) {
+                take(n, legacy);
+            }
+            retention->remove(HEAD);
+            retention->remove(TAIL);
+        }
+        for (uint64_t s = 0; s < shards; s++) {
+            const auto head = retention->get(shard_key(HEAD, s)).value_or(0);
+            for (auto n = retention->get(shard_key(TAIL, s)).value_or(0); n < head; n++) {
+                take(n * shards + s, sharded[s]);
+            }
+        }
+
+        std::vector<std::vector<TxHash>> layout(shards);
+        results->foreach([&](const TxHash& hash, const TxResult&) {
+            if (tracked.count(hash) == 0) {
+                layout[static_cast<uint64_t>(hash % shards)].push_back(hash);
+            }
+            return true;
+        });
+        for (auto&& hash : legacy) {
+            layout[static_cast<uint64_t>(hash % shards)].push_back(hash);
+        }
+        for (uint64_t s = 0; s < shards; s++) {
+            auto& seq = layout[s];
+            seq.insert(seq.end(), sharded[s].begin(), sharded[s].end());
+            for (uint64_t n = 0; n < seq.size(); n++) {
+                order->put(n * shards + s, seq[n]);
+            }
+            retention->put(shard_key(HEAD, s), seq.size());
+            retention->put(shard_key(TAIL, s), 0);
+        }
+    }
+
+    void index_logs(const TxHash& hash, const TxResult& result, uint64_t block) {
+        if (result.logs.empty()) {
+            return;
+        }
+
+        const auto s = slot(block, static_cast<uint64_t>(hash % BlockProducer::shards));
+        blooms->put(hash, {s, logs::make_bloom(result.logs)});
+        for (auto&& b : logs::buckets(result.logs)) {
+            const tables::LogsSlotKey key = {b, s};
+            const auto n = logs_index_size->get(key).value_or(0);
+            logs_index->put({key, n}, hash);
+            logs_index_size->put(key, n + 1);
+        }
+    }
+
+    // Moves the last entry of each bucket of the slot into the pruned one
+    void unindex_logs(const TxHash& hash, const TxResult& result) {
+        const auto bloom = blooms->get(hash);
+        if (!bloom.has_value()) {
+            return;
+        }
+
+        blooms->remove(hash);
+        for (auto&& b : logs::buckets(result.logs)) {
+            const tables::LogsSlotKey key = {b, bloom->first};
+            const auto size = logs_index_size->get(key).value_or(0);
+            for (uint64_t n = 0; n < size; n++) {
+                if (logs_index->get({key, n}) != hash) {
+                    continue;
+                }
+                const auto last = size - 1;
+                if (n != last) {
+                    logs_index->put({key, n}, logs_index->get({key, last}).value());
+                }
+                logs_index->remove({key, last});
+                if (last == 0) {
+                    logs_index_size->remove(key);
+                } else {
+                    logs_index_size->put(key, last);
+                }
+                break;
+            }
+        }
+    }
+
+    BlockProducer* blocks;
+    tables::Results::TxView* results;
+    tables::Results::TxView* cold;
+    tables::ResultsOrder::TxView* order;
+    tables::ResultsRetention::TxView* retention;
+    tables::LogsBloom::TxView* blooms;
+    tables::LogsIndex::TxView* logs_index;
+    tables::LogsIndexSize::TxView* logs_index_size;
+};
+
+// Serves eth_getLogs. The candidates are the index entries of the slots of
+// the blocks in range: those of the (address, topic0) buckets with addresses,
+// otherwise those of ANY_BUCKET. Candidates whose bloom cannot match are
+// skipped, the others are ordered by position and checked log by log against
+// the filter.
+// Results recorded without a pseudo-block count as block 0. A range over more
+// than max_blocks blocks is rejected up front, as the query reads every slot
+// of every block in it.
+template <typename TX>
+std::vector<LogObject> find_logs(TX& tx,
+                                 tables::ResultsState& rs,
+                                 tables::BlocksState& bs,
+                                 const LogFilter& filter,
+                                 size_t max_logs = 10000,
+                                 uint64_t max_blocks = 1000) {
+    const auto open = BlockProducer::open_number(tx, bs);
+    const auto from = BlockProducer::resolve(filter.from_block, open).value_or(open);
+    const auto to = BlockProducer::resolve(filter.to_block, open).value_or(open);
+    if (from > to) {
+        return {};
+    }
+    if (to - from >= max_blocks) {
+        throw Exception(
+            fmt::format("block range {}-{} covers more than {} blocks", from, to, max_blocks));
+    }
+
+    std::vector<uint256_t> buckets;
+    const bool by_topic = !filter.topics.empty() && !filter.topics[0].empty();
+    for (auto&& addr : filter.addresses) {
+        if (!by_topic) {
+            buckets.push_back(logs::bucket(addr));
+            continue;
+        }
+        for (auto&& topic : filter.topics[0]) {
+            buckets.push_back(logs::bucket(addr, topic));
+        }
+    }
+    if (buckets.empty()) {
+        buckets.push_back(logs::ANY_BUCKET);
+    }
+
+    auto blooms = tx.get_read_only_view(rs.blooms);
+    auto index = tx.get_read_only_view(rs.logs_index);
+    auto sizes = tx.get_read_only_view(rs.logs_index_size);
+    std::set<TxHash> seen;
+    std::vector<std::pair<TxLocation, TxHash>> in_range;
+    for (auto block = from; block <= to; block++) {
+        for (uint64_t s = 0; s < BlockProducer::shards; s++) {
+            for (auto&& b : buckets) {
+                const tables::LogsSlotKey key = {b, ReceiptStore::slot(block, s)};
+                const auto size = sizes->get(key).value_or(0);
+                for (uint64_t n = 0; n < size; n++) {
+                    const auto hash = index->get({key, n});
+                    if (!hash.has_value() || !seen.insert(hash.value()).second) {
+                        continue;
+                    }
+                    const auto bloom = blooms->get(hash.value());
+                    if (!bloom.has_value() || !logs::may_match(bloom->second, filter)) {
+                        continue;
+                    }
+                    in_range.emplace_back(
+                        BlockProducer::locate(tx, bs, hash.value()).value_or(TxLocation{0, 0}),
+                        hash.value());
+                }
+            }
+        }
+    }
+    std::sort(in_range.begin(), in_range.end());
+
+    std::map<uint64_t, BlockHash> block_hashes;
+    auto block_hash = [&](uint64_t number) {
+        auto it = block_hashes.find(number);
+        if (it == block_hashes.end()) {
+            const auto h = BlockProducer::header(tx, bs, number);
+            it = block_hashes.emplace(number, h.has_value() ? h->block_hash : 0).first;
+        }
+        return it->second;
+    };
+
+    std::vector<LogObject> res;
+    for (auto&& [loc, hash] : in_range) {
+        const auto r = ReceiptStore::get(tx, rs, hash);
+        if (!r.has_value()) {
+            continue;
+        }
+
+        for (size_t i = 0; i < r->logs.size(); i++) {
+            if (!logs::matches(r->logs[i], filter)) {
+                continue;
+            }
+            if (res.size() == max_logs) {
+                throw Exception(fmt::format("query returned more than {} results", max_logs));
+            }
+            res.push_back({r->logs[i], hash, i, loc.first, loc.second, block_hash(loc.first)});
+        }
+    }
+    return res;
+}
+
+} // namespace Ethereum
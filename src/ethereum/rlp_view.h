@@ -0,0 +1,233 @@
+// Copyright (c) 2020 Oxford-Hainan Blockchain Research Institute
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#include "ethereum/exception.h"
+#include "ethereum/keccak.h"
+
+#include <array>
+#include <eEVM/bigint.h>
+#include <eEVM/util.h>
+#include <fmt/format.h>
+#include <type_traits>
+#include <vector>
+
+namespace Ethereum {
+namespace rlp {
+
+// Payload of an RLP item, borrowed from the decoded buffer
+struct Slice {
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+
+    std::vector<uint8_t> to_bytes() const {
+        return {data, data + size};
+    }
+
+    // big endian integer of at most sizeof(T) bytes
+    template <typename T>
+    T to_uint() const {
+        const size_t max = std::is_same_v<T, uint256_t> ? 32 : sizeof(T);
+        if (size > max) {
+            throw Exception(fmt::format("RLP integer of {} bytes does not fit in {}", size, max));
+        }
+        if constexpr (std::is_same_v<T, uint256_t>) {
+            return eevm::from_big_endian(data, size);
+        } else {
+            T v = 0;
+            for (size_t i = 0; i < size; i++) {
+                v = static_cast<T>((v << 8) | data[i]);
+            }
+            return v;
+        }
+    }
+};
+
+namespace detail {
+// length of a string or list payload, after the prefix byte
+inline size_t read_length(const uint8_t* p, size_t n) {
+    if (n > sizeof(size_t)) {
+        throw Exception("RLP length is too long");
+    }
+    size_t len = 0;
+    for (size_t i = 0; i < n; i++) {
+        len = (len << 8) | p[i];
+    }
+    return len;
+}
+} // namespace detail
+
+// Splits an encoded list of byte strings into slices of the input, without
+// copying. The input must outlive the slices.
+inline std::vector<Slice> decode_list(const uint8_t* data, size_t size, size_t expected) {
+    if (size == 0 || data[0] < 0xc0) {
+        throw Exception("RLP input is not a list");
+    }
+
+    size_t pos = 1, end = size;
+    if (data[0] <= 0xf7) {
+        end = pos + (data[0] - 0xc0);
+    } else {
+        const size_t n = data[0] - 0xf7;
+        if (pos + n > size) {
+            throw Exception("RLP list header is truncated");
+        }
+        const auto len = detail::read_length(data + pos, n);
+        if (len != size - pos - n) {
+            throw Exception(
+                fmt::format("RLP list spans {} bytes, input has {}", len, size - pos - n));
+        }
+        end = size;
+        pos += n;
+    }
+    if (end != size) {
+        throw Exception(fmt::format("RLP list spans {} bytes, input has {}", end, size));
+    }
+
+    std::vector<Slice> items;
+    items.reserve(expected);
+    while (pos < end) {
+        const auto prefix = data[pos];
+        Slice s;
+        if (prefix < 0x80) {
+            s = {data + pos, 1};
+            pos += 1;
+        } else if (prefix <= 0xb7) {
+            s = {data + pos + 1, size_t(prefix - 0x80)};
+            pos += 1 + s.size;
+        } else if (prefix < 0xc0) {
+            const size_t n = prefix - 0xb7;
+            if (pos + 1 + n > end) {
+                throw Exception("RLP string header is truncated");
+            }
+            s.size = detail::read_length(data + pos + 1, n);
+            // checked before advancing, as a length of up to 2^64 - 1 would wrap pos
+            if (s.size > end - (pos + 1 + n)) {
+                throw Exception("RLP item is truncated");
+            }
+            s.data = data + pos + 1 + n;
+            pos += 1 + n + s.size;
+        } else {
+            throw Exception("Nested RLP lists are not expected");
+        }
+        if (pos > end) {
+            throw Exception("RLP item is truncated");
+        }
+        items.push_back(s);
+    }
+
+    if (items.size() != expected) {
+        throw Exception(
+            fmt::format("Expected {} RLP items, but decoded {}", expected, items.size()));
+    }
+    return items;
+}
+
+inline std::vector<Slice> decode_list(const std::vector<uint8_t>& encoded, size_t expected) {
+    return decode_list(encoded.data(), encoded.size(), expected);
+}
+
+// A byte string or integer to be RLP encoded. Integers are held as minimal
+// big endian bytes in the item itself, byte strings are borrowed.
+class Item {
+ public:
+    Item(const Slice& s) : ptr(s.data), len(s.size) {}
+
+    Item(const std::vector<uint8_t>& v) : ptr(v.data()), len(v.size()) {}
+
+    Item(const uint256_t& v) {
+        eevm::to_big_endian(v, buf.data());
+        len = buf.size();
+        while (len > 0 && buf[buf.size() - len] == 0) {
+            len--;
+        }
+    }
+
+    template <typename T, typename = std::enable_if_t<std::is_integral_v<T>>>
+    Item(T v) : Item(uint256_t(v)) {}
+
+    const uint8_t* data() const {
+        return ptr != nullptr ? ptr : buf.data() + buf.size() - len;
+    }
+
+    size_t size() const {
+        return len;
+    }
+
+ private:
+    const uint8_t* ptr = nullptr;
+    size_t len = 0;
+    std::array<uint8_t, 32> buf = {};
+};
+
+namespace detail {
+// Writes the header of a payload of len bytes, returns its size
+inline size_t header(uint8_t offset, size_t len, uint8_t* out) {
+    if (len <= 55) {
+        out[0] = static_cast<uint8_t>(offset + len);
+        return 1;
+    }
+    size_t n = 0;
+    for (auto l = len; l > 0; l >>= 8) {
+        n++;
+    }
+    out[0] = static_cast<uint8_t>(offset + 55 + n);
+    for (size_t i = 0; i < n; i++) {
+        out[n - i] = static_cast<uint8_t>(len >> (8 * i));
+    }
+    return 1 + n;
+}
+
+inline bool single_byte(const Item& item) {
+    return item.size() == 1 && item.data()[0] < 0x80;
+}
+
+inline size_t encoded_size(const Item& item) {
+    if (single_byte(item)) {
+        return 1;
+    }
+    uint8_t h[9];
+    return header(0x80, item.size(), h) + item.size();
+}
+} // namespace detail
+
+// Streams the RLP encoding of a list of items into sink, a callable taking
+// (const uint8_t*, size_t), without building the encoding
+template <typename Sink>
+void write_list(Sink&& sink, std::initializer_list<Item> items) {
+    size_t payload = 0;
+    for (auto&& item : items) {
+        payload += detail::encoded_size(item);
+    }
+
+    uint8_t h[9];
+    sink(h, detail::header(0xc0, payload, h));
+    for (auto&& item : items) {
+        if (!detail::single_byte(item)) {
+            sink(h, detail::header(0x80, item.size(), h));
+        }
+        sink(item.data(), item.size());
+    }
+}
+
+// keccak_256 of the RLP encoding of a list, equal to
+// eevm::keccak_256(eevm::rlp::encode(...)) of the same fields
+inline eevm::KeccakHash keccak_list(std::initializer_list<Item> items) {
+    Keccak256 k;
+    write_list(k, items);
+    return k.final();
+}
+
+} // namespace rlp
+} // namespace Ethereum
@@ -0,0 +1,531 @@
+// Copyright (c) 2020 Oxford-Hainan Blockchain Research Institute
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#include "ethereum/code.h"
+#include "ethereum/execute_transaction.h"
+#include "ethereum/profiler.h"
+#include "ethereum/tables.h"
+
+#include <atomic>
+#include <eEVM/globalstate.h>
+#include <kv/store.h>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <set>
+#ifdef VIRTUAL_ENCLAVE
+#    include <thread>
+#endif
+
+namespace Ethereum {
+namespace speculative {
+
+using Nonce = eevm::Account::Nonce;
+using StorageKey = tables::StorageKey;
+
+// Every entry is the value seen (read set) or produced (write set) by one
+// execution, std::nullopt means the key is absent or has been removed
+struct AccessSet {
+    std::map<eevm::Address, std::optional<uint256_t>> balances;
+    std::map<eevm::Address, std::optional<Nonce>> nonces;
+    std::map<eevm::Address, std::optional<eevm::Code>> codes;
+    std::map<StorageKey, std::optional<uint256_t>> storage;
+
+    void merge(const AccessSet& other) {
+        for (auto&& [k, v] : other.balances) {
+            balances[k] = v;
+        }
+        for (auto&& [k, v] : other.nonces) {
+            nonces[k] = v;
+        }
+        for (auto&& [k, v] : other.codes) {
+            codes[k] = v;
+        }
+        for (auto&& [k, v] : other.storage) {
+            storage[k] = v;
+        }
+    }
+
+    // Accounts with a balance, nonce or code entry
+    tables::AccountWrites accounts() const {
+        tables::AccountWrites res;
+        for (auto&& [k, v] : balances) {
+            res.balances.insert(k);
+        }
+        for (auto&& [k, v] : nonces) {
+            res.nonces.insert(k);
+        }
+        for (auto&& [k, v] : codes) {
+            res.codes.insert(k);
+        }
+        return res;
+    }
+};
+
+class StateReader {
+ public:
+    virtual ~StateReader() = default;
+    virtual std::optional<uint256_t> balance(const eevm::Address& addr) = 0;
+    virtual std::optional<Nonce> nonce(const eevm::Address& addr) = 0;
+    virtual std::optional<eevm::Code> code(const eevm::Address& addr) = 0;
+    virtual std::optional<uint256_t> storage(const StorageKey& key) = 0;
+};
+
+// Reads the state through one KV transaction. TxViews are not safe to share
+// between threads, so every worker reads through a reader of its own.
+class KvReader : public StateReader {
+ public:
+    KvReader(const tables::Accounts::Views& av, tables::Storage::TxView* st) :
+        accounts(av), storage_view(st) {}
+
+    std::optional<uint256_t> balance(const eevm::Address& addr) override {
+        return accounts.balances->get(addr);
+    }
+
+    std::optional<Nonce> nonce(const eevm::Address& addr) override {
+        return accounts.nonces->get(addr);
+    }
+
+    std::optional<eevm::Code> code(const eevm::Address& addr) override {
+        const auto code = CodeStore::get(accounts, addr);
+        return code != nullptr ? std::optional<eevm::Code>(*code) : std::nullopt;
+    }
+
+    std::optional<uint256_t> storage(const StorageKey& key) override {
+        return storage_view->get(key);
+    }
+
+ private:
+    tables::Accounts::Views accounts;
+    tables::Storage::TxView* storage_view;
+};
+
+// Reads the writes of transactions already committed in this batch first,
+// falling back to the state the batch started from
+class LayeredReader : public StateReader {
+ public:
+    LayeredReader(const AccessSet& top_, StateReader& base_) : top(top_), base(base_) {}
+
+    std::optional<uint256_t> balance(const eevm::Address& addr) override {
+        return lookup(top.balances, addr, [&]() { return base.balance(addr); });
+    }
+
+    std::optional<Nonce> nonce(const eevm::Address& addr) override {
+        return lookup(top.nonces, addr, [&]() { return base.nonce(addr); });
+    }
+
+    std::optional<eevm::Code> code(const eevm::Address& addr) override {
+        return lookup(top.codes, addr, [&]() { return base.code(addr); });
+    }
+
+    std::optional<uint256_t> storage(const StorageKey& key) override {
+        return lookup(top.storage, key, [&]() { return base.storage(key); });
+    }
+
+ private:
+    template <typename M, typename K, typename F>
+    static typename M::mapped_type lookup(const M& m, const K& k, F&& fallback) {
+        auto it = m.find(k);
+        if (it != m.end()) {
+            return it->second;
+        }
+        return fallback();
+    }
+
+    const AccessSet& top;
+    StateReader& base;
+};
+
+// The block every transaction of the batch runs in. The headers view is only
+// read for BLOCKHASH, which is rare enough to serialise.
+class BlockContext {
+ public:
+    BlockContext(const eevm::Block& block_, tables::Blocks::TxView* headers_) :
+        block(block_), headers(headers_) {}
+
+    const eevm::Block& current() const {
+        return block;
+    }
+
+    // same as EthereumState::get_block_hash
+    uint256_t hash(uint8_t offset) {
+        if (headers == nullptr || offset == 0 || offset > block.number) {
+            return 0;
+        }
+        std::lock_guard<std::mutex> guard(lock);
+        const auto header = headers->get(block.number - offset);
+        return header.has_value() ? header->block_hash : 0;
+    }
+
+ private:
+    eevm::Block block;
+    std::mutex lock;
+    tables::Blocks::TxView* headers;
+};
+
+class OverlayState;
+
+struct OverlayAccount : public eevm::Account, public eevm::Storage {
+    eevm::Address address;
+    OverlayState& state;
+
+    OverlayAccount(const eevm::Address& a, OverlayState& s) : address(a), state(s) {}
+
+    eevm::Address get_address() const override {
+        return address;
+    }
+
+    uint256_t get_balance() const override;
+    void set_balance(const uint256_t& b) override;
+    Nonce get_nonce() const override;
+    void increment_nonce() override;
+    eevm::Code get_code() const override;
+    void set_code(eevm::Code&& c) override;
+
+    void store(const uint256_t& key, const uint256_t& value) override;
+    uint256_t load(const uint256_t& key) override;
+    bool remove(const uint256_t& key) override;
+};
+
+// eevm::GlobalState which never touches the KV: the first value read for each
+// key is remembered in `reads`, everything written lands in `writes`
+class OverlayState : public eevm::GlobalState {
+ public:
+    AccessSet reads;
+    AccessSet writes;
+
+    OverlayState(StateReader& reader_, BlockContext& block_) : reader(reader_), block(block_) {}
+
+    void remove(const eevm::Address& addr) override {
+        throw Exception("not implemented");
+    }
+
+    eevm::AccountState get(const eevm::Address& address) override {
+        auto cache_it = cache.find(address);
+        if (cache_it != cache.end()) {
+            auto& proxy = cache_it->second;
+            return eevm::AccountState(*proxy, *proxy);
+        }
+
+        if (!balance(address).has_value()) {
+            return create(address, 0, {});
+        }
+
+        return add_to_cache(address);
+    }
+
+    eevm::AccountState create(const eevm::Address& address,
+                              const uint256_t& balance_ = 0u,
+                              const eevm::Code& code_ = {}) override {
+        if (balance(address).has_value() || code(address).has_value() ||
+            nonce(address).has_value()) {
+            throw Exception(fmt::format("Trying to create account at {}, but it already exists",
+                                        eevm::to_checksum_address(address)));
+        }
+
+        writes.balances[address] = balance_;
+        writes.codes[address] = code_;
+        // Nonce of contracts should start at 1
+        writes.nonces[address] = code_.empty() ? 0 : 1;
+        return add_to_cache(address);
+    }
+
+    const eevm::Block& get_current_block() override {
+        return block.current();
+    }
+
+    uint256_t get_block_hash(uint8_t offset) override {
+        return block.hash(offset);
+    }
+
+    std::optional<uint256_t> balance(const eevm::Address& addr) {
+        return lookup(writes.balances, reads.balances, addr, [&]() {
+            return reader.balance(addr);
+        });
+    }
+
+    std::optional<Nonce> nonce(const eevm::Address& addr) {
+        return lookup(writes.nonces, reads.nonces, addr, [&]() { return reader.nonce(addr); });
+    }
+
+    std::optional<eevm::Code> code(const eevm::Address& addr) {
+        return lookup(writes.codes, reads.codes, addr, [&]() { return reader.code(addr); });
+    }
+
+    std::optional<uint256_t> storage(const StorageKey& key) {
+        return lookup(writes.storage, reads.storage, key, [&]() { return reader.storage(key); });
+    }
+
+ private:
+    template <typename M, typename K, typename F>
+    static typename M::mapped_type lookup(const M& w, M& r, const K& k, F&& fetch) {
+        auto w_it = w.find(k);
+        if (w_it != w.end()) {
+            return w_it->second;
+        }
+        auto r_it = r.find(k);
+        if (r_it != r.end()) {
+            return r_it->second;
+        }
+        return r.emplace(k, fetch()).first->second;
+    }
+
+    eevm::AccountState add_to_cache(const eevm::Address& address) {
+        auto& proxy = cache[address];
+        proxy = std::make_unique<OverlayAccount>(address, *this);
+        return eevm::AccountState(*proxy, *proxy);
+    }
+
+    StateReader& reader;
+    BlockContext& block;
+    std::map<eevm::Address, std::unique_ptr<OverlayAccount>> cache;
+};
+
+inline uint256_t OverlayAccount::get_balance() const {
+    return state.balance(address).value_or(0);
+}
+
+inline void OverlayAccount::set_balance(const uint256_t& b) {
+    state.writes.balances[address] = b;
+}
+
+inline Nonce OverlayAccount::get_nonce() const {
+    return state.nonce(address).value_or(0);
+}
+
+inline void OverlayAccount::increment_nonce() {
+    state.writes.nonces[address] = get_nonce() + 1;
+}
+
+inline eevm::Code OverlayAccount::get_code() const {
+    return state.code(address).value_or(eevm::Code{});
+}
+
+inline void OverlayAccount::set_code(eevm::Code&& c) {
+    state.writes.codes[address] = std::move(c);
+}
+
+inline void OverlayAccount::store(const uint256_t& key, const uint256_t& value) {
+    profiler::KvProbe probe(address, true);
+    state.writes.storage[StorageKey(address, key)] = value;
+}
+
+inline uint256_t OverlayAccount::load(const uint256_t& key) {
+    profiler::KvProbe probe(address, false);
+    return state.storage(StorageKey(address, key)).value_or(0);
+}
+
+inline bool OverlayAccount::remove(const uint256_t& key) {
+    const StorageKey k(address, key);
+    const auto existed = state.storage(k).has_value();
+    state.writes.storage[k] = std::nullopt;
+    return existed;
+}
+
+struct Execution {
+    MessageCall call;
+    AccessSet reads;
+    AccessSet writes;
+    TxHash tx_hash = {};
+    TxResult tx_result = {};
+    std::optional<std::string> error = std::nullopt;
+    size_t runs = 0;
+    // read through a worker's own KV transaction rather than the batch's
+    bool own_view = false;
+};
+
+// Optimistic batch execution in the spirit of Block-STM: every transaction is
+// first run against the pre-batch state, possibly in parallel. They are then
+// committed in order, and only those whose reads were overwritten by an
+// earlier transaction of the batch are executed again. The outcome is the
+// same as running the batch sequentially.
+//
+// Parallel workers need store to open KV transactions of their own. Those may
+// see writes committed after tx started, so their reads are checked against
+// tx as well when committing, which also puts them in tx's read set.
+class SpeculativeExecutor {
+ public:
+    SpeculativeExecutor(kv::Tx& tx_,
+                        tables::AccountsState& as_,
+                        const eevm::Block& block_,
+                        tables::Blocks::TxView* headers,
+                        kv::Store* store_ = nullptr,
+                        size_t workers_ = 0) :
+        tx(tx_),
+        as(as_),
+        block(block_, headers),
+        store(store_),
+        workers(workers_ == 0 ? default_workers() : workers_) {}
+
+    std::vector<Execution> run(const std::vector<MessageCall>& calls, ReceiptStore& receipts) {
+        std::vector<Execution> executions(calls.size());
+        for (size_t i = 0; i < calls.size(); i++) {
+            executions[i].call = calls[i];
+        }
+
+        KvReader base(as.accounts.get_views(tx), tx.get_view(as.storage));
+        execute_all(executions, base);
+
+        AccessSet committed;
+        size_t reexecuted = 0;
+        for (auto& ex : executions) {
+            if (!still_valid(ex, committed, base)) {
+                LayeredReader layered(committed, base);
+                execute(ex, layered, false);
+                reexecuted++;
+            }
+
+            if (!ex.error.has_value()) {
+                committed.merge(ex.writes);
+            }
+        }
+
+        apply(committed);
+        for (auto& ex : executions) {
+            if (!ex.error.has_value()) {
+                receipts.put(ex.tx_hash, ex.tx_result);
+            }
+        }
+
+        auto& prof = profiler::Profiler::instance();
+        if (prof.enabled()) {
+            prof.record_batch(executions.size(), reexecuted);
+        }
+        CLOAK_DEBUG_FMT("speculative batch: {} transactions, {} workers, {} re-executed",
+                        executions.size(),
+                        workers,
+                        reexecuted);
+        return executions;
+    }
+
+    static size_t default_workers() {
+#ifdef VIRTUAL_ENCLAVE
+        return std::max(1u, std::thread::hardware_concurrency());
+#else
+        // enclave builds cannot spawn threads, speculate on the calling thread
+        return 1;
+#endif
+    }
+
+ private:
+    void execute(Execution& ex, StateReader& reader, bool own_view) {
+        OverlayState os(reader, block);
+        ex.runs++;
+        ex.own_view = own_view;
+        ex.error = std::nullopt;
+        try {
+            auto [tx_hash, tx_result] = EVMC(ex.call, os, nullptr).execute();
+            ex.tx_hash = tx_hash;
+            ex.tx_result = tx_result;
+        } catch (const std::exception& e) {
+            ex.error = e.what();
+        }
+        ex.reads = std::move(os.reads);
+        ex.writes = std::move(os.writes);
+    }
+
+    void execute_all(std::vector<Execution>& executions, StateReader& reader) {
+#ifdef VIRTUAL_ENCLAVE
+        if (store != nullptr && workers > 1 && executions.size() > 1) {
+            std::atomic<size_t> next{0};
+            auto worker = [&]() {
+                auto own_tx = store->create_tx();
+                KvReader own(as.accounts.get_views(own_tx), own_tx.get_view(as.storage));
+                for (size_t i = next++; i < executions.size(); i = next++) {
+                    execute(executions[i], own, true);
+                }
+            };
+
+            std::vector<std::thread> pool;
+            for (size_t i = 0; i < std::min(workers, executions.size()); i++) {
+                pool.emplace_back(worker);
+            }
+            for (auto& t : pool) {
+                t.join();
+            }
+            return;
+        }
+#endif
+        for (auto& ex : executions) {
+            execute(ex, reader, false);
+        }
+    }
+
+    // A read is stale when an earlier transaction of the batch wrote another
+    // value, or when it came from a worker's view and tx reads another one
+    template <typename M, typename F>
+    static bool same_reads(const M& reads, const M& committed, bool own_view, F&& read_base) {
+        for (auto&& [k, v] : reads) {
+            auto it = committed.find(k);
+            if (it != committed.end()) {
+                if (it->second != v) {
+                    return false;
+                }
+            } else if (own_view && read_base(k) != v) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static bool still_valid(const Execution& ex, const AccessSet& committed, StateReader& base) {
+        const auto& r = ex.reads;
+        return same_reads(r.balances,
+                          committed.balances,
+                          ex.own_view,
+                          [&](const eevm::Address& k) { return base.balance(k); }) &&
+            same_reads(r.nonces,
+                       committed.nonces,
+                       ex.own_view,
+                       [&](const eevm::Address& k) { return base.nonce(k); }) &&
+            same_reads(r.codes,
+                       committed.codes,
+                       ex.own_view,
+                       [&](const eevm::Address& k) { return base.code(k); }) &&
+            same_reads(r.storage, committed.storage, ex.own_view, [&](const StorageKey& k) {
+                return base.storage(k);
+            });
+    }
+
+    void apply(const AccessSet& committed) {
+        auto views = as.accounts.get_views(tx);
+        auto storage = tx.get_view(as.storage);
+        for (auto&& [addr, v] : committed.balances) {
+            views.balances->put(addr, v.value_or(0));
+        }
+        for (auto&& [addr, v] : committed.nonces) {
+            views.nonces->put(addr, v.value_or(0));
+        }
+        for (auto&& [addr, v] : committed.codes) {
+            CodeStore::put(views, addr, v.value_or(eevm::Code{}));
+        }
+        for (auto&& [key, v] : committed.storage) {
+            if (v.has_value()) {
+                storage->put(key, v.value());
+            } else {
+                storage->remove(key);
+            }
+        }
+    }
+
+    kv::Tx& tx;
+    tables::AccountsState& as;
+    BlockContext block;
+    kv::Store* store;
+    size_t workers;
+};
+
+} // namespace speculative
+} // namespace Ethereum
@@ -21,6 +21,7 @@ namespace Ethereum {
 // Implementation of eevm::GlobalState backed by ccf's KV
 class EthereumState : public eevm::GlobalState {
     eevm::Block current_block = {};
+    tables::Blocks::TxView* blocks = nullptr;
 
     tables::Accounts::Views accounts;
     tables::Storage::TxView& tx_storage;
@@ -90,12 +91,11 @@ class EthereumState : public eevm::GlobalState {
         }
 
         // Write initial code
-        const auto code_it = accounts.codes->get(address);
-        if (code_it.has_value()) {
+        if (CodeStore::exists(accounts, address)) {
             throw Exception(fmt::format("Trying to create account at {}, but it already has code",
                                         eevm::to_checksum_address(address)));
         } else {
-            accounts.codes->put(address, code);
+            CodeStore::put(accounts, address, code);
         }
 
         // Write initial nonce
@@ -108,16 +108,45 @@ class EthereumState : public eevm::GlobalState {
             accounts.nonces->put(address, initial_nonce);
         }
 
-        return add_to_cache(address);
+        auto state = add_to_cache(address);
+        auto& proxy = cache[address];
+        proxy->balance_written = proxy->nonce_written = proxy->code_written = true;
+        return state;
+    }
+
+    // Accounts whose balance, nonce or code this state has written
+    tables::AccountWrites written_accounts() const {
+        tables::AccountWrites res;
+        for (auto&& [addr, proxy] : cache) {
+            if (proxy->balance_written) {
+                res.balances.insert(addr);
+            }
+            if (proxy->nonce_written) {
+                res.nonces.insert(addr);
+            }
+            if (proxy->code_written) {
+                res.codes.insert(addr);
+            }
+        }
+        return res;
     }
 
     const eevm::Block& get_current_block() override {
         return current_block;
     }
 
+    // offset counts back from the current block, sealed pseudo-blocks only
     uint256_t get_block_hash(uint8_t offset) override {
-        LOG_INFO_FMT("offset is currently {}", offset);
-        return 0;
+        if (blocks == nullptr || offset == 0 || offset > current_block.number) {
+            return 0;
+        }
+        const auto header = blocks->get(current_block.number - offset);
+        return header.has_value() ? header->block_hash : 0;
+    }
+
+    void set_current_block(const eevm::Block& block, tables::Blocks::TxView* blocks_) {
+        current_block = block;
+        blocks = blocks_;
     }
 
     static EthereumState make_state(kv::Tx& tx, tables::AccountsState& as) {
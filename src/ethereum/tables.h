@@ -20,9 +20,13 @@
 
 // STL/3rd-party
 #include "msgpack/address.h"
+#include "msgpack/storage.h"
 #include "msgpack/types.h"
 #include "nljsontypes.h"
 
+#include <cstring>
+#include <set>
+#include <string>
 #include <vector>
 
 // Implement std::hash for uint256, so it can be used as key in kv
@@ -34,6 +38,27 @@ struct hash<intx::uint<N>> {
         return hash_container(words);
     }
 };
+
+// Storage keys are hashed a word at a time, without converting to intx
+template <>
+struct hash<Ethereum::StorageKey> {
+    size_t operator()(const Ethereum::StorageKey& k) const {
+        constexpr uint64_t mul = 0x9e3779b97f4a7c15;
+        const auto p = k.data().data();
+        uint64_t h = 0;
+        size_t i = 0;
+        for (; i + sizeof(uint64_t) <= Ethereum::StorageKey::SIZE; i += sizeof(uint64_t)) {
+            uint64_t w;
+            std::memcpy(&w, p + i, sizeof(w));
+            h = (h ^ w) * mul;
+            h ^= h >> 32;
+        }
+        uint32_t tail;
+        std::memcpy(&tail, p + i, sizeof(tail));
+        h = (h ^ tail) * mul;
+        return static_cast<size_t>(h ^ (h >> 29));
+    }
+};
 } // namespace std
 
 namespace Ethereum {
@@ -46,42 +71,185 @@ namespace tables {
 
 inline constexpr auto BALANCES = "eth.account.balance";
 inline constexpr auto CODES = "eth.account.code";
+inline constexpr auto CODE_HASHES = "eth.account.codehash";
+inline constexpr auto CODE_CONTENTS = "eth.code";
 inline constexpr auto NONCES = "eth.account.nonce";
 inline constexpr auto STORAGE = "eth.storage";
 inline constexpr auto TXRESULT = "eth.txresults";
+inline constexpr auto TXRESULT_COLD = "eth.txresults.cold";
+inline constexpr auto TXRESULT_ORDER = "eth.txresults.order";
+inline constexpr auto TXRESULT_RETENTION = "eth.txresults.retention";
+inline constexpr auto BLOCKS = "eth.blocks";
+inline constexpr auto BLOCKS_PENDING = "eth.blocks.pending";
+inline constexpr auto BLOCKS_VERSION = "eth.blocks.version";
+inline constexpr auto TX_LOCATIONS = "eth.tx.location";
+inline constexpr auto ACCOUNT_BLOCKS = "eth.account.blocks";
+inline constexpr auto ACCOUNT_BLOCKS_SIZE = "eth.account.blocks.size";
+inline constexpr auto BALANCE_BLOCKS = "eth.account.blocks.balance";
+inline constexpr auto NONCE_BLOCKS = "eth.account.blocks.nonce";
+inline constexpr auto CODE_BLOCKS = "eth.account.blocks.code";
+inline constexpr auto LOGS_BLOOM = "eth.logs.bloom";
+inline constexpr auto LOGS_INDEX = "eth.logs.index";
+inline constexpr auto LOGS_INDEX_SIZE = "eth.logs.index.size";
+
+// The account fields whose history is indexed, see AccountBlocksIndex
+enum class AccountField { BALANCE, NONCE, CODE };
+
+// Accounts written by a transaction, per field
+struct AccountWrites {
+    std::set<eevm::Address> balances;
+    std::set<eevm::Address> nonces;
+    std::set<eevm::Address> codes;
+
+    const std::set<eevm::Address>& of(AccountField field) const {
+        switch (field) {
+            case AccountField::BALANCE:
+                return balances;
+            case AccountField::NONCE:
+                return nonces;
+            default:
+                return codes;
+        }
+    }
+};
 
 struct Accounts {
     using Balances = kv::Map<eevm::Address, uint256_t>;
     Balances balances;
 
+    // address -> code, as written before code was content addressed. Only
+    // read for accounts that have no entry in code_hashes, see CodeStore.
     using Codes = kv::Map<eevm::Address, eevm::Code>;
     Codes codes;
 
     using Nonces = kv::Map<eevm::Address, eevm::Account::Nonce>;
     Nonces nonces;
 
+    // address -> keccak of its code
+    using CodeHashes = kv::Map<eevm::Address, uint256_t>;
+    CodeHashes code_hashes;
+
+    // keccak of code -> code, shared by every account deployed with it
+    using CodeContents = kv::Map<uint256_t, eevm::Code>;
+    CodeContents code_contents;
+
     struct Views {
         Balances::TxView* balances;
         Codes::TxView* codes;
         Nonces::TxView* nonces;
+        CodeHashes::TxView* code_hashes;
+        CodeContents::TxView* code_contents;
     };
 
     Views get_views(kv::Tx& tx) {
-        return {tx.get_view(balances), tx.get_view(codes), tx.get_view(nonces)};
+        return {tx.get_view(balances),
+                tx.get_view(codes),
+                tx.get_view(nonces),
+                tx.get_view(code_hashes),
+                tx.get_view(code_contents)};
     }
 };
 
-using StorageKey = std::pair<eevm::Address, uint256_t>;
-using Storage = kv::Map<StorageKey, uint256_t>;
+using StorageKey = Ethereum::StorageKey;
+using Storage = kv::Map<StorageKey, StorageValue>;
 
 using Results = kv::Map<TxHash, TxResult>;
+// position in a retention sequence -> tx hash, only maintained while a retention
+// window is set, see ReceiptStore
+using ResultsOrder = kv::Map<uint64_t, TxHash>;
+using ResultsRetention = kv::Map<std::string, uint64_t>;
+
+// tx hash -> (slot it is indexed in, bloom of its logs), only for results that
+// have logs
+using LogsBloom = kv::Map<TxHash, std::pair<uint64_t, Bloom>>;
+// ((bucket, slot), n) -> n-th tx hash of the slot with a log in bucket. A slot
+// is a block and a shard of it, see ReceiptStore::slot and logs::bucket.
+using LogsSlotKey = std::pair<uint256_t, uint64_t>;
+using LogsIndexKey = std::pair<LogsSlotKey, uint64_t>;
+using LogsIndex = kv::Map<LogsIndexKey, TxHash>;
+using LogsIndexSize = kv::Map<LogsSlotKey, uint64_t>;
+
+struct ResultsState {
+    Results results;
+    Results cold;
+    ResultsOrder order;
+    ResultsRetention retention;
+    LogsBloom blooms;
+    LogsIndex logs_index;
+    LogsIndexSize logs_index_size;
+
+    ResultsState() :
+        results(TXRESULT),
+        cold(TXRESULT_COLD),
+        order(TXRESULT_ORDER),
+        retention(TXRESULT_RETENTION),
+        blooms(LOGS_BLOOM),
+        logs_index(LOGS_INDEX),
+        logs_index_size(LOGS_INDEX_SIZE) {}
+};
+
+using Blocks = kv::Map<uint64_t, BlockHeader>;
+// fields of the open block, see BlockProducer
+using BlocksPending = kv::Map<std::string, uint256_t>;
+// block number -> KV version its first transaction read at
+using BlocksVersion = kv::Map<uint64_t, uint64_t>;
+// tx hash -> (block number, index in block)
+using TxLocations = kv::Map<TxHash, std::pair<uint64_t, uint64_t>>;
+// (address, n) -> n-th block that wrote one field of the account
+using AccountBlocks = kv::Map<std::pair<eevm::Address, uint64_t>, uint64_t>;
+using AccountBlocksSize = kv::Map<eevm::Address, uint64_t>;
+
+struct AccountBlocksIndex {
+    AccountBlocks blocks;
+    AccountBlocksSize size;
+
+    explicit AccountBlocksIndex(const std::string& name) : blocks(name), size(name + ".size") {}
+};
+
+struct BlocksState {
+    Blocks headers;
+    BlocksPending pending;
+    BlocksVersion versions;
+    TxLocations locations;
+    AccountBlocksIndex balance_blocks;
+    AccountBlocksIndex nonce_blocks;
+    AccountBlocksIndex code_blocks;
+    // blocks that wrote any of the three fields, as recorded before the index
+    // was kept per field. Only read, see HistoricalState.
+    AccountBlocksIndex account_blocks;
+
+    BlocksState() :
+        headers(BLOCKS),
+        pending(BLOCKS_PENDING),
+        versions(BLOCKS_VERSION),
+        locations(TX_LOCATIONS),
+        balance_blocks(BALANCE_BLOCKS),
+        nonce_blocks(NONCE_BLOCKS),
+        code_blocks(CODE_BLOCKS),
+        account_blocks(ACCOUNT_BLOCKS) {}
+
+    AccountBlocksIndex& index(AccountField field) {
+        switch (field) {
+            case AccountField::BALANCE:
+                return balance_blocks;
+            case AccountField::NONCE:
+                return nonce_blocks;
+            default:
+                return code_blocks;
+        }
+    }
+};
 
 struct AccountsState {
     Accounts accounts;
     Storage storage;
 
     AccountsState() :
-        accounts{Accounts::Balances(BALANCES), Accounts::Codes(CODES), Accounts::Nonces(NONCES)},
+        accounts{Accounts::Balances(BALANCES),
+                 Accounts::Codes(CODES),
+                 Accounts::Nonces(NONCES),
+                 Accounts::CodeHashes(CODE_HASHES),
+                 Accounts::CodeContents(CODE_CONTENTS)},
         storage(STORAGE) {}
 };
 
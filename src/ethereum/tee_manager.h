@@ -15,6 +15,7 @@
 #pragma once
 
 #include "abi/abicoder.h"
+#include "app/agent_queue.h"
 #include "app/utils.h"
 #include "ethereum/types.h"
 #include "kv/tx.h"
@@ -119,12 +120,15 @@ class State {
         return std::make_shared<Account>(accounts, key_pair);
     }
 
-    AccountPtr create() {
+    // kp defaults to a fresh secp256k1 key pair
+    AccountPtr create(tls::KeyPairPtr kp = nullptr) {
         if (key_pair.publicAddr->get("TEE_PUBLICADDR").has_value()) {
             LOG_AND_THROW("tee has been prepared");
         }
 
-        auto kp = tls::make_key_pair(tls::CurveImpl::secp256k1_bitcoin);
+        if (kp == nullptr) {
+            kp = tls::make_key_pair(tls::CurveImpl::secp256k1_bitcoin);
+        }
         auto addr = evm4ccf::get_addr_from_kp(kp);
 
         key_pair.privateKey->put(addr, kp->private_key_pem());
@@ -164,8 +168,12 @@ class State {
     }
 };
 
-void prepare(kv::Tx& tx, tables::Table& tee_table, TeePrepare& tee_prepare) {
-    auto tee_acc = State::make_state(tx, tee_table).create();
+void prepare(kv::Tx& tx,
+             tables::Table& tee_table,
+             agent::tables::Table& agent_table,
+             TeePrepare& tee_prepare,
+             tls::KeyPairPtr kp = nullptr) {
+    auto tee_acc = State::make_state(tx, tee_table).create(kp);
     // register tee address on chain
     auto encoder = abicoder::Encoder("setTEEAddress");
     encoder.add_inputs("",
@@ -176,7 +184,7 @@ void prepare(kv::Tx& tx, tables::Table& tee_table, TeePrepare& tee_prepare) {
     Ethereum::MessageCall mc(
         tee_acc->get_address(), tee_prepare.cloak_service_addr, encoder.encodeWithSignatrue());
     auto signed_data = evm4ccf::sign_eth_tx(tee_acc->get_tee_kp(), mc, tee_acc->get_nonce());
-    Utils::cloak_agent_log("register_tee_addr", eevm::to_hex_string(signed_data));
+    agent::Queue(tx, agent_table).push("register_tee_addr", eevm::to_hex_string(signed_data));
 
     tee_acc->increment_nonce();
 
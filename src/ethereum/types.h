@@ -13,6 +13,8 @@
 // limitations under the License.
 
 #pragma once
+#include <algorithm>
+#include <array>
 #include <eEVM/address.h>
 #include <eEVM/bigint.h>
 #include <eEVM/transaction.h>
@@ -29,6 +31,7 @@ using TxHash = EthHash;
 using BlockHash = EthHash;
 using ByteString = std::vector<uint8_t>;
 using ContractParticipants = std::set<eevm::Address>;
+using Bloom = std::array<uint8_t, 256>;
 
 constexpr auto DefaultBlockID = "latest";
 
@@ -48,7 +51,6 @@ struct BlockHeader {
     uint64_t number = {};
     uint64_t difficulty = {};
     uint64_t gas_limit = {};
-    uint64_t gas_used = {};
     uint64_t timestamp = {};
     eevm::Address miner = {};
     BlockHash block_hash = {};
@@ -56,8 +58,7 @@ struct BlockHeader {
 
 inline bool operator==(const BlockHeader& l, const BlockHeader& r) {
     return l.number == r.number && l.difficulty == r.difficulty && l.gas_limit == r.gas_limit &&
-        l.gas_used == r.gas_used && l.timestamp == r.timestamp && l.miner == r.miner &&
-        l.block_hash == r.block_hash;
+        l.timestamp == r.timestamp && l.miner == r.miner && l.block_hash == r.block_hash;
 }
 
 struct TxResult {
@@ -65,6 +66,71 @@ struct TxResult {
     std::vector<eevm::LogEntry> logs;
 };
 
+// Key of eth.storage: the 20 byte address followed by the 32 byte slot, both
+// big endian. Keys compare, hash and serialise as one fixed width blob.
+class StorageKey {
+ public:
+    static constexpr size_t ADDRESS_SIZE = 20;
+    static constexpr size_t SLOT_SIZE = 32;
+    static constexpr size_t SIZE = ADDRESS_SIZE + SLOT_SIZE;
+    using Bytes = std::array<uint8_t, SIZE>;
+
+    StorageKey() = default;
+
+    StorageKey(const eevm::Address& address, const uint256_t& slot) {
+        uint8_t word[SLOT_SIZE];
+        eevm::to_big_endian(address, word);
+        std::copy(word + SLOT_SIZE - ADDRESS_SIZE, word + SLOT_SIZE, bytes.begin());
+        eevm::to_big_endian(slot, bytes.data() + ADDRESS_SIZE);
+    }
+
+    explicit StorageKey(const Bytes& b) : bytes(b) {}
+
+    eevm::Address address() const {
+        return eevm::from_big_endian(bytes.data(), ADDRESS_SIZE);
+    }
+
+    uint256_t slot() const {
+        return eevm::from_big_endian(bytes.data() + ADDRESS_SIZE, SLOT_SIZE);
+    }
+
+    const Bytes& data() const {
+        return bytes;
+    }
+
+    bool operator==(const StorageKey& other) const {
+        return bytes == other.bytes;
+    }
+
+    bool operator!=(const StorageKey& other) const {
+        return bytes != other.bytes;
+    }
+
+    bool operator<(const StorageKey& other) const {
+        return bytes < other.bytes;
+    }
+
+ private:
+    Bytes bytes = {};
+};
+
+// Value of eth.storage. Converts to and from uint256_t, and is packed without
+// its leading zero bytes when COMPACT_STORAGE_VALUES is defined.
+struct StorageValue {
+    uint256_t value = 0;
+
+    StorageValue() = default;
+    StorageValue(const uint256_t& v) : value(v) {}
+
+    operator const uint256_t&() const {
+        return value;
+    }
+
+    bool operator==(const StorageValue& other) const {
+        return value == other.value;
+    }
+};
+
 struct TxReceipt {
     TxHash transaction_hash = {};
     uint256_t transaction_index = {};
@@ -76,8 +142,7 @@ struct TxReceipt {
     uint256_t gas_used = {};
     std::optional<eevm::Address> contract_address = std::nullopt;
     std::vector<eevm::LogEntry> logs = {};
-    // logs_bloom could be bitset for interaction, but is currently ignored
-    std::array<uint8_t, 256> logs_bloom = {};
+    Bloom logs_bloom = {};
     uint256_t status = {};
 };
 
@@ -114,6 +179,27 @@ struct SendRawTransaction {
     ByteData raw_transaction = {};
 };
 
+// An empty addresses list or topic position matches anything
+struct LogFilter {
+    BlockID from_block = DefaultBlockID;
+    BlockID to_block = DefaultBlockID;
+    std::vector<eevm::Address> addresses = {};
+    std::vector<std::vector<eevm::log::Topic>> topics = {};
+};
+
+struct LogObject {
+    eevm::LogEntry log = {};
+    TxHash transaction_hash = {};
+    uint64_t log_index = {};
+    uint64_t block_number = {};
+    uint64_t transaction_index = {};
+    BlockHash block_hash = {};
+};
+
+struct GetLogs {
+    LogFilter filter = {};
+};
+
 struct EstimateGas {
     MessageCall call_data = {};
 };
@@ -0,0 +1,296 @@
+// Copyright (c) 2020 Oxford-Hainan Blockchain Research Institute
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Runs the cloak transaction path on the host, against an in-memory kv::Store,
+// without a CCF network or an enclave.
+//
+// Recorded mode replays JSON-RPC request bodies, one per line, through the
+// same Generator, CloakPolicyTransaction and Ethereum::execute_mpt code the
+// endpoints call. Each request runs in its own committed transaction. States
+// in the requests are encrypted to the TEE key of the recording, so pass
+// that key with --tee-key for cloak_prepare to install it.
+//
+// Synthetic mode needs no recording. It times the ABI coder on generated
+// state arrays and the EVM on a counter contract.
+//
+// Both modes print the time spent per method and per CLOAK_PHASE. The target
+// is built with frame pointers, so `perf record -g` works for flame graphs.
+
+#include "app/formatters.h"
+#include "abi/abicoder.h"
+#include "app/metrics.h"
+#include "app/rpc/context.h"
+#include "app/rpc/sax_params.h"
+#include "ethereum/execute_transaction.h"
+#include "ethereum/tee_manager.h"
+#include "transaction/generator.h"
+
+#include <chrono>
+#include <fmt/format.h>
+#include <fstream>
+#include <iostream>
+#include <kv/store.h>
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace cloak4ccf {
+namespace harness {
+
+struct Options {
+    std::string requests;
+    std::optional<std::string> tee_key;
+    size_t repeat = 1;
+    size_t synthetic = 0;
+    size_t states = 8;
+    size_t state_size = 64;
+};
+
+constexpr auto usage = R"(Usage:
+  cloak_host_harness --requests FILE [--tee-key PEM] [--repeat N]
+  cloak_host_harness --synthetic N [--states K] [--state-size BYTES]
+)";
+
+// stores 1 + the word at slot 0 back to slot 0
+constexpr auto counter_init_code = "0x6009600c60003960096000f3600054600101600055";
+
+std::string read_file(const std::string& path) {
+    std::ifstream f(path);
+    if (!f) {
+        throw std::runtime_error(fmt::format("Cannot open {}", path));
+    }
+    return {std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>()};
+}
+
+// One fresh store, as on a new network
+class Harness {
+ public:
+    explicit Harness(const Options& opts_) : opts(opts_) {}
+
+    // Returns the number of requests whose method is not handled here
+    size_t replay(const std::vector<nlohmann::json>& requests) {
+        size_t skipped = 0;
+        for (auto&& r : requests) {
+            const auto method = r.at("method").get<std::string>();
+            const auto& params = r.at("params");
+            if (!dispatch(method, params)) {
+                skipped++;
+            }
+        }
+        return skipped;
+    }
+
+    void synthetic() {
+        const eevm::Address from = 0xcafe;
+        eevm::Address counter = 0;
+        transact("deploy", [&](CloakContext& ctx) {
+            Ethereum::MessageCall mc;
+            mc.from = from;
+            mc.data = counter_init_code;
+            auto es = Ethereum::EthereumState::make_state(ctx.tx, ctx.cloakTables.acc_state);
+            counter = Ethereum::EVMC(mc, es, nullptr).execute().second.contract_address.value();
+        });
+
+        abicoder::BytesList states(opts.states, std::vector<uint8_t>(opts.state_size, 0xab));
+        for (size_t i = 0; i < opts.synthetic; i++) {
+            transact("abi_roundtrip", [&](CloakContext&) {
+                std::vector<uint8_t> packed;
+                {
+                    CLOAK_PHASE("abi_encode");
+                    abicoder::Encoder encoder("set_states");
+                    encoder.add_bytes_array("data", states);
+                    packed = encoder.encode();
+                }
+                CLOAK_PHASE("abi_decode");
+                if (abicoder::Decoder::decode_bytes_array(packed) != states) {
+                    throw std::logic_error("ABI round trip changed the states");
+                }
+            });
+
+            transact("evm_call", [&](CloakContext& ctx) {
+                CLOAK_PHASE("evm");
+                Ethereum::MessageCall mc;
+                mc.from = from;
+                mc.to = counter;
+                auto es = Ethereum::EthereumState::make_state(ctx.tx, ctx.cloakTables.acc_state);
+                Ethereum::EVMC(mc, es, nullptr).run_with_result();
+            });
+        }
+    }
+
+ private:
+    template <typename F>
+    void transact(const std::string& method, F&& f) {
+        metrics::Call call(metrics::Registry::instance().endpoint(method));
+        auto tx = store.create_tx();
+        CloakContext ctx(tx, tables);
+        f(ctx);
+        if (tx.commit() != kv::CommitSuccess::OK) {
+            throw std::runtime_error(fmt::format("Failed to commit {}", method));
+        }
+        call.ok = true;
+    }
+
+    bool dispatch(const std::string& method, const nlohmann::json& params) {
+        if (method == "cloak_prepare") {
+            transact(method, [&](CloakContext& ctx) {
+                auto prepare = params.get<TeePrepare>();
+                tls::KeyPairPtr kp = nullptr;
+                if (opts.tee_key.has_value()) {
+                    // states in the recording are encrypted to its TEE key
+                    kp = tls::make_key_pair(tls::Pem(read_file(opts.tee_key.value())));
+                }
+                TeeManager::prepare(ctx.tx, tables.tee_table, tables.agent, prepare, kp);
+            });
+        } else if (method == "eth_sendRawTransaction") {
+            transact(method, [&](CloakContext& ctx) {
+                Ethereum::send_raw_transaction(ctx, sax::Params::from_json(params).bytes(0));
+            });
+        } else if (method == "cloak_sendRawPrivacyTransaction") {
+            transact(method, [&](CloakContext& ctx) {
+                Transaction::Generator(ctx).add_privacy(sax::Params::from_json(params).bytes(0));
+            });
+        } else if (method == "cloak_sendRawMultiPartyTransaction") {
+            transact(method, [&](CloakContext& ctx) {
+                Transaction::Generator(ctx).add_cloakTransaction(
+                    sax::Params::from_json(params).bytes(0));
+            });
+        } else if (method == "eth_sync_old_states") {
+            transact(method, [&](CloakContext& ctx) {
+                Transaction::Generator(ctx).sync_states(params.get<SyncStates>());
+            });
+        } else if (method == "eth_sync_public_keys") {
+            transact(method, [&](CloakContext& ctx) {
+                Transaction::Generator(ctx).sync_public_keys(params.get<SyncKeys>());
+            });
+        } else if (method == "cloak_sync_report") {
+            transact(method, [&](CloakContext& ctx) {
+                Transaction::Generator(ctx).sync_report(params.get<SyncReport>());
+            });
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    const Options& opts;
+    kv::Store store;
+    CloakTables tables;
+};
+
+void report(std::chrono::steady_clock::duration wall) {
+    auto row = [](const std::string& name, uint64_t count, uint64_t total_ns) {
+        fmt::print("  {:<40} {:>8} {:>12.3f} {:>12.1f}\n",
+                   name,
+                   count,
+                   total_ns / 1e6,
+                   count == 0 ? 0.0 : total_ns / 1e3 / count);
+    };
+
+    fmt::print("{:<42} {:>8} {:>12} {:>12}\n", "", "count", "total ms", "mean us");
+    fmt::print("methods\n");
+    metrics::Registry::instance().visit(
+        [&](const std::string& name, const metrics::EndpointStats& s) {
+            row(name, s.calls.load(), s.latency.total_ns());
+        },
+        [](const std::string&, const metrics::Histogram&) {});
+    fmt::print("phases\n");
+    metrics::Registry::instance().visit(
+        [](const std::string&, const metrics::EndpointStats&) {},
+        [&](const std::string& name, const metrics::Histogram& h) {
+            row(name, h.count(), h.total_ns());
+        });
+    fmt::print(
+        "wall {:.3f} ms\n",
+        std::chrono::duration_cast<std::chrono::microseconds>(wall).count() / 1e3);
+}
+
+Options parse(int argc, char** argv) {
+    Options opts;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            throw std::invalid_argument(fmt::format("Missing value for {}", arg));
+        }
+        const std::string value = argv[++i];
+        if (arg == "--requests") {
+            opts.requests = value;
+        } else if (arg == "--tee-key") {
+            opts.tee_key = value;
+        } else if (arg == "--repeat") {
+            opts.repeat = std::stoul(value);
+        } else if (arg == "--synthetic") {
+            opts.synthetic = std::stoul(value);
+        } else if (arg == "--states") {
+            opts.states = std::stoul(value);
+        } else if (arg == "--state-size") {
+            opts.state_size = std::stoul(value);
+        } else {
+            throw std::invalid_argument(fmt::format("Unknown option {}", arg));
+        }
+    }
+    if (opts.requests.empty() == (opts.synthetic == 0)) {
+        throw std::invalid_argument("Expected one of --requests or --synthetic");
+    }
+    return opts;
+}
+
+} // namespace harness
+} // namespace cloak4ccf
+
+int main(int argc, char** argv) {
+    using namespace cloak4ccf::harness;
+    logger::config::level() = logger::FAIL;
+
+    Options opts;
+    try {
+        opts = parse(argc, argv);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl << usage;
+        return 1;
+    }
+
+    std::vector<nlohmann::json> requests;
+    if (!opts.requests.empty()) {
+        std::ifstream f(opts.requests);
+        std::string line;
+        while (std::getline(f, line)) {
+            if (!line.empty()) {
+                requests.push_back(nlohmann::json::parse(line));
+            }
+        }
+    }
+
+    try {
+        const auto start = std::chrono::steady_clock::now();
+        size_t skipped = 0;
+        for (size_t i = 0; i < opts.repeat; i++) {
+            Harness h(opts);
+            if (opts.synthetic > 0) {
+                h.synthetic();
+            } else {
+                skipped = h.replay(requests);
+            }
+        }
+        report(std::chrono::steady_clock::now() - start);
+        if (skipped > 0) {
+            fmt::print("skipped {} requests of methods the harness does not run\n", skipped);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Failed: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
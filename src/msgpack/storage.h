@@ -0,0 +1,110 @@
+// Copyright (c) 2020 Oxford-Hainan Blockchain Research Institute
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstring>
+#include <msgpack/msgpack.hpp>
+
+// msgpack conversion for the eth.storage key and value.
+//
+// Keys are written as a single 52 byte bin and values as a bin of the value's
+// significant big endian bytes. Entries written before, as a
+// std::pair<eevm::Address, uint256_t> key and a plain uint256_t value, still
+// decode, so existing ledgers replay and existing snapshots load unchanged.
+// Each entry moves to the new form the next time it is written, and snapshots
+// taken after that hold only the new form.
+namespace msgpack {
+MSGPACK_API_VERSION_NAMESPACE(MSGPACK_DEFAULT_API_NS) {
+    namespace adaptor {
+
+    template <>
+    struct convert<Ethereum::StorageKey> { // NOLINT
+        msgpack::object const& operator()(msgpack::object const& o,
+                                          Ethereum::StorageKey& v) const {
+            if (o.type == msgpack::type::BIN) {
+                Ethereum::StorageKey::Bytes bytes;
+                if (o.via.bin.size != bytes.size()) {
+                    throw msgpack::type_error();
+                }
+                std::memcpy(bytes.data(), o.via.bin.ptr, bytes.size());
+                v = Ethereum::StorageKey(bytes);
+                return o;
+            }
+
+            if (o.type != msgpack::type::ARRAY || o.via.array.size != 2) {
+                throw msgpack::type_error();
+            }
+            v = Ethereum::StorageKey(o.via.array.ptr[0].as<eevm::Address>(),
+                                     o.via.array.ptr[1].as<uint256_t>());
+            return o;
+        }
+    };
+
+    template <>
+    struct pack<Ethereum::StorageKey> { // NOLINT
+        template <typename Stream>
+        packer<Stream>& operator()(msgpack::packer<Stream>& o,
+                                   Ethereum::StorageKey const& v) const {
+            const auto& bytes = v.data();
+            o.pack_bin(bytes.size());
+            o.pack_bin_body(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+            return o;
+        }
+    };
+
+    template <>
+    struct convert<Ethereum::StorageValue> { // NOLINT
+        msgpack::object const& operator()(msgpack::object const& o,
+                                          Ethereum::StorageValue& v) const {
+            if (o.type != msgpack::type::BIN) {
+                v.value = o.as<uint256_t>();
+                return o;
+            }
+            if (o.via.bin.size > 32) {
+                throw msgpack::type_error();
+            }
+            v.value = 0;
+            if (o.via.bin.size > 0) {
+                const auto data = reinterpret_cast<const uint8_t*>(o.via.bin.ptr);
+                v.value = eevm::from_big_endian(data, o.via.bin.size);
+            }
+            return o;
+        }
+    };
+
+    template <>
+    struct pack<Ethereum::StorageValue> { // NOLINT
+        template <typename Stream>
+        packer<Stream>& operator()(msgpack::packer<Stream>& o,
+                                   Ethereum::StorageValue const& v) const {
+#ifdef COMPACT_STORAGE_VALUES
+            uint8_t buf[32];
+            eevm::to_big_endian(v.value, buf);
+            size_t skip = 0;
+            while (skip < sizeof(buf) && buf[skip] == 0) {
+                skip++;
+            }
+            o.pack_bin(sizeof(buf) - skip);
+            o.pack_bin_body(reinterpret_cast<const char*>(buf + skip), sizeof(buf) - skip);
+#else
+            o.pack(v.value);
+#endif
+            return o;
+        }
+    };
+
+    } // namespace adaptor
+} // namespace msgpack
+} // namespace msgpack
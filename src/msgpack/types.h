@@ -2,7 +2,9 @@
 // Licensed under the MIT License.
 #pragma once
 
+#include <map>
 #include <msgpack/msgpack.hpp>
+#include <vector>
 
 // To instantiate the kv map types above, all keys and values must be
 // convertible to msgpack
@@ -36,14 +38,97 @@ MSGPACK_API_VERSION_NAMESPACE(MSGPACK_DEFAULT_API_NS) {
     };
 
     // msgpack conversion for Ethereum::TxResult
+    //
+    // Results are written in a compact form: addresses and topics are stored
+    // once per result as fixed-width bins, and each log refers to them by
+    // index. [version, contract_address | nil, [address], [topic],
+    // [[address_idx, data, [topic_idx]]]]. Entries written before the compact
+    // form was introduced are [contract_address, [LogEntry]] and still decode.
+    namespace txresult {
+    static constexpr uint8_t COMPACT_V1 = 1;
+    static constexpr size_t ADDRESS_SIZE = 20;
+    static constexpr size_t TOPIC_SIZE = 32;
+
+    template <typename Stream>
+    inline void pack_fixed(msgpack::packer<Stream>& o, const uint256_t& v, size_t size) {
+        uint8_t buf[TOPIC_SIZE] = {};
+        eevm::to_big_endian(v, buf);
+        o.pack_bin(size);
+        o.pack_bin_body(reinterpret_cast<const char*>(buf + TOPIC_SIZE - size), size);
+    }
+
+    inline uint256_t convert_fixed(msgpack::object const& o) {
+        if (o.type != msgpack::type::BIN) {
+            throw msgpack::type_error();
+        }
+        const auto data = reinterpret_cast<const uint8_t*>(o.via.bin.ptr);
+        return eevm::from_big_endian(data, o.via.bin.size);
+    }
+
+    template <typename K>
+    inline uint32_t index_of(std::map<K, uint32_t>& m, std::vector<K>& order, const K& k) {
+        auto it = m.find(k);
+        if (it != m.end()) {
+            return it->second;
+        }
+        auto idx = static_cast<uint32_t>(order.size());
+        m.emplace(k, idx);
+        order.push_back(k);
+        return idx;
+    }
+    } // namespace txresult
+
     template <>
     struct convert<Ethereum::TxResult> { // NOLINT
         msgpack::object const& operator()(msgpack::object const& o, Ethereum::TxResult& v) const {
-            auto addr = o.via.array.ptr[0].as<eevm::Address>();
-            if (addr != 0) {
-                v.contract_address = addr;
+            if (o.type != msgpack::type::ARRAY) {
+                throw msgpack::type_error();
+            }
+
+            v.contract_address = std::nullopt;
+            if (o.via.array.size == 2) {
+                auto addr = o.via.array.ptr[0].as<eevm::Address>();
+                if (addr != 0) {
+                    v.contract_address = addr;
+                }
+                v.logs = o.via.array.ptr[1].as<std::vector<eevm::LogEntry>>();
+                return o;
+            }
+
+            if (o.via.array.size != 5 ||
+                o.via.array.ptr[0].as<uint8_t>() != txresult::COMPACT_V1) {
+                throw msgpack::type_error();
+            }
+
+            const auto& contract = o.via.array.ptr[1];
+            if (contract.type != msgpack::type::NIL) {
+                v.contract_address = txresult::convert_fixed(contract);
+            }
+
+            std::vector<eevm::Address> addresses;
+            const auto& addrs = o.via.array.ptr[2].via.array;
+            for (size_t i = 0; i < addrs.size; i++) {
+                addresses.push_back(txresult::convert_fixed(addrs.ptr[i]));
+            }
+
+            std::vector<eevm::log::Topic> topics;
+            const auto& tps = o.via.array.ptr[3].via.array;
+            for (size_t i = 0; i < tps.size; i++) {
+                topics.push_back(txresult::convert_fixed(tps.ptr[i]));
+            }
+
+            const auto& logs = o.via.array.ptr[4].via.array;
+            v.logs.clear();
+            v.logs.reserve(logs.size);
+            for (size_t i = 0; i < logs.size; i++) {
+                const auto& log = logs.ptr[i].via.array;
+                auto& entry = v.logs.emplace_back();
+                entry.address = addresses.at(log.ptr[0].as<uint32_t>());
+                entry.data = log.ptr[1].as<eevm::log::Data>();
+                for (auto idx : log.ptr[2].as<std::vector<uint32_t>>()) {
+                    entry.topics.push_back(topics.at(idx));
+                }
             }
-            v.logs = o.via.array.ptr[1].as<std::vector<eevm::LogEntry>>();
 
             return o;
         }
@@ -53,9 +138,44 @@ MSGPACK_API_VERSION_NAMESPACE(MSGPACK_DEFAULT_API_NS) {
     struct pack<Ethereum::TxResult> { // NOLINT
         template <typename Stream>
         packer<Stream>& operator()(msgpack::packer<Stream>& o, Ethereum::TxResult const& v) const {
-            o.pack_array(2);
-            o.pack(v.contract_address.value_or(0x0));
-            o.pack(v.logs);
+            std::map<eevm::Address, uint32_t> address_idx;
+            std::vector<eevm::Address> addresses;
+            std::map<eevm::log::Topic, uint32_t> topic_idx;
+            std::vector<eevm::log::Topic> topics;
+            std::vector<std::pair<uint32_t, std::vector<uint32_t>>> refs;
+            for (auto&& log : v.logs) {
+                auto& ref = refs.emplace_back();
+                ref.first = txresult::index_of(address_idx, addresses, log.address);
+                for (auto&& topic : log.topics) {
+                    ref.second.push_back(txresult::index_of(topic_idx, topics, topic));
+                }
+            }
+
+            o.pack_array(5);
+            o.pack(txresult::COMPACT_V1);
+            if (v.contract_address.has_value()) {
+                txresult::pack_fixed(o, v.contract_address.value(), txresult::ADDRESS_SIZE);
+            } else {
+                o.pack_nil();
+            }
+
+            o.pack_array(addresses.size());
+            for (auto&& addr : addresses) {
+                txresult::pack_fixed(o, addr, txresult::ADDRESS_SIZE);
+            }
+
+            o.pack_array(topics.size());
+            for (auto&& topic : topics) {
+                txresult::pack_fixed(o, topic, txresult::TOPIC_SIZE);
+            }
+
+            o.pack_array(v.logs.size());
+            for (size_t i = 0; i < v.logs.size(); i++) {
+                o.pack_array(3);
+                o.pack(refs[i].first);
+                o.pack(v.logs[i].data);
+                o.pack(refs[i].second);
+            }
             return o;
         }
     };
@@ -68,10 +188,9 @@ MSGPACK_API_VERSION_NAMESPACE(MSGPACK_DEFAULT_API_NS) {
             v.number = o.via.array.ptr[0].as<uint64_t>();
             v.difficulty = o.via.array.ptr[1].as<uint64_t>();
             v.gas_limit = o.via.array.ptr[2].as<uint64_t>();
-            v.gas_used = o.via.array.ptr[3].as<uint64_t>();
-            v.timestamp = o.via.array.ptr[4].as<uint64_t>();
-            v.miner = o.via.array.ptr[5].as<decltype(v.miner)>();
-            v.block_hash = o.via.array.ptr[6].as<decltype(v.block_hash)>();
+            v.timestamp = o.via.array.ptr[3].as<uint64_t>();
+            v.miner = o.via.array.ptr[4].as<decltype(v.miner)>();
+            v.block_hash = o.via.array.ptr[5].as<decltype(v.block_hash)>();
 
             return o;
         }
@@ -82,11 +201,10 @@ MSGPACK_API_VERSION_NAMESPACE(MSGPACK_DEFAULT_API_NS) {
         template <typename Stream>
         packer<Stream>& operator()(msgpack::packer<Stream>& o,
                                    Ethereum::BlockHeader const& v) const {
-            o.pack_array(7);
+            o.pack_array(6);
             o.pack(v.number);
             o.pack(v.difficulty);
             o.pack(v.gas_limit);
-            o.pack(v.gas_used);
             o.pack(v.timestamp);
             o.pack(v.miner);
             o.pack(v.block_hash);
@@ -53,6 +53,100 @@ DECLARE_JSON_REQUIRED_FIELDS(MPT_CALL::In, id)
 DECLARE_JSON_TYPE(MPT_CALL::Out)
 DECLARE_JSON_REQUIRED_FIELDS(MPT_CALL::Out, status, output)
 
+// Status changes of multi party transactions after the cursor since. Clients
+// poll with the returned next cursor, starting from an empty one. A cursor
+// holds a position per shard of the log; changes are in order per
+// transaction only.
+struct MPT_WATCH {
+    struct In {
+        // empty watches every transaction
+        std::vector<std::string> ids = {};
+        std::vector<uint64_t> since = {};
+    };
+
+    struct Change {
+        uint64_t seq = {};
+        std::string id = {};
+        Status status = {};
+    };
+
+    struct Out {
+        std::vector<Change> changes = {};
+        std::vector<uint64_t> next = {};
+        // changes after since have been pruned, re-read with cloak_get_mpt
+        bool truncated = false;
+    };
+};
+
+DECLARE_JSON_TYPE(MPT_WATCH::In)
+DECLARE_JSON_REQUIRED_FIELDS(MPT_WATCH::In, ids, since)
+
+DECLARE_JSON_TYPE(MPT_WATCH::Change)
+DECLARE_JSON_REQUIRED_FIELDS(MPT_WATCH::Change, seq, id, status)
+
+DECLARE_JSON_TYPE(MPT_WATCH::Out)
+DECLARE_JSON_REQUIRED_FIELDS(MPT_WATCH::Out, changes, next, truncated)
+
+// Multi party transactions by id, or by contract and status
+struct MPT_BULK {
+    struct In {
+        std::vector<std::string> ids = {};
+        // used when ids is empty
+        std::string contract = {};
+        // empty matches every status
+        std::vector<Status> statuses = {};
+        uint64_t max = {};
+    };
+
+    struct Result {
+        std::string id = {};
+        Status status = {};
+        std::string output = {};
+    };
+
+    struct Out {
+        std::vector<Result> results = {};
+        // more transactions of the contract matched than max
+        bool truncated = false;
+    };
+};
+
+DECLARE_JSON_TYPE_WITH_OPTIONAL_FIELDS(MPT_BULK::In)
+DECLARE_JSON_REQUIRED_FIELDS(MPT_BULK::In, max)
+DECLARE_JSON_OPTIONAL_FIELDS(MPT_BULK::In, ids, contract, statuses)
+
+DECLARE_JSON_TYPE(MPT_BULK::Result)
+DECLARE_JSON_REQUIRED_FIELDS(MPT_BULK::Result, id, status, output)
+
+DECLARE_JSON_TYPE(MPT_BULK::Out)
+DECLARE_JSON_REQUIRED_FIELDS(MPT_BULK::Out, results, truncated)
+
+// A page of the multi party transactions of a contract or a sender, oldest
+// first
+struct MPT_LIST {
+    struct In {
+        // exactly one of contract and sender
+        std::string contract = {};
+        std::string sender = {};
+        uint64_t start = 0;
+        uint64_t limit = {};
+    };
+
+    struct Out {
+        std::vector<MPT_BULK::Result> results = {};
+        // start of the next page, total once every page has been read
+        uint64_t next = {};
+        uint64_t total = {};
+    };
+};
+
+DECLARE_JSON_TYPE_WITH_OPTIONAL_FIELDS(MPT_LIST::In)
+DECLARE_JSON_REQUIRED_FIELDS(MPT_LIST::In, limit)
+DECLARE_JSON_OPTIONAL_FIELDS(MPT_LIST::In, contract, sender, start)
+
+DECLARE_JSON_TYPE(MPT_LIST::Out)
+DECLARE_JSON_REQUIRED_FIELDS(MPT_LIST::Out, results, next, total)
+
 namespace policy {
 
 struct MultiPartyParams {
@@ -105,6 +199,17 @@ DECLARE_JSON_TYPE_WITH_OPTIONAL_FIELDS(stateParams)
 DECLARE_JSON_OPTIONAL_FIELDS(stateParams, keys)
 DECLARE_JSON_REQUIRED_FIELDS(stateParams, name)
 
+// A key of a mapping state resolved against the function inputs, with one
+// component per nesting level
+struct MappingKey {
+    std::vector<ByteString> encoded;
+    // as given, e.g. a checksum address
+    std::vector<std::string> raw;
+};
+
+// state name => keys, in the order of the function's read and mutate lists
+using MappingKeys = std::map<std::string, std::vector<MappingKey>>;
+
 struct Function {
  public:
     ByteData type;
@@ -150,60 +255,45 @@ struct Function {
         return true;
     }
 
-    std::vector<std::string> get_mapping_keys(const std::string& msg_sender,
-                                              const std::string& name,
-                                              int pos = -1,
-                                              bool encoded = true) {
-        std::vector<std::string> res;
-        auto ps = read;
-        ps.insert(ps.end(), mutate.begin(), mutate.end());
-        CLOAK_DEBUG_FMT("get_mapping_keys, msg_sender:{}, name:{}", msg_sender, name);
-        for (auto&& x : ps) {
-            if (x.name == name) {
+    // Resolves the keys of every mapping state read or mutated by the
+    // function. Needs the inputs to be complete.
+    MappingKeys resolve_mapping_keys(const std::string& msg_sender) const {
+        MappingKeys res;
+        for (auto* ps : {&read, &mutate}) {
+            for (auto&& x : *ps) {
+                auto& keys = res[x.name];
                 for (auto&& key : x.keys) {
-                    std::vector<std::string> nested_keys = Utils::split_string(key, ':');
-                    CLOAK_DEBUG_FMT("key:{}, nested_keys:{}", key, fmt::join(nested_keys, ", "));
-                    if (pos != -1) {
-                        nested_keys = {nested_keys.at(pos)};
-                    }
-                    for (auto&& single_key : nested_keys) {
-                        if (single_key == "msg.sender") {
-                            if (encoded) {
-                                res.push_back(
-                                    eevm::to_hex_string(abicoder::Address(msg_sender).encode()));
-                            } else {
-                                res.push_back(msg_sender);
-                            }
-                            continue;
-                        }
-                        for (auto&& input : inputs) {
-                            if (input.name == single_key) {
-                                if (encoded) {
-                                    auto data = abicoder::Encoder::encode(
-                                        "", input.value.value(), input.structural_type);
-                                    res.push_back(eevm::to_hex_string(data));
-                                } else {
-                                    res.push_back(input.value.value());
-                                }
-                            }
-                        }
-                    }
+                    keys.push_back(resolve_mapping_key(msg_sender, x.name, key));
                 }
             }
         }
         return res;
     }
 
-    size_t get_keys_size(const std::string& name) {
-        auto ps = read;
-        ps.insert(ps.end(), mutate.begin(), mutate.end());
-        size_t sum = 0;
-        for (auto&& x : ps) {
-            if (x.name == name) {
-                sum += x.keys.size();
+ private:
+    MappingKey resolve_mapping_key(const std::string& msg_sender,
+                                   const std::string& name,
+                                   const std::string& key) const {
+        MappingKey res;
+        for (auto&& single_key : Utils::split_string(key, ':')) {
+            if (single_key == "msg.sender") {
+                res.encoded.push_back(abicoder::Address(msg_sender).encode());
+                res.raw.push_back(msg_sender);
+                continue;
             }
+            auto input = std::find_if(inputs.begin(), inputs.end(), [&](auto&& in) {
+                return in.name == single_key;
+            });
+            if (input == inputs.end()) {
+                throw std::logic_error(
+                    fmt::format("Key {} of mapping {} is not a function input", single_key, name));
+            }
+            res.encoded.push_back(
+                abicoder::Encoder::encode("", input->getValue(), input->structural_type));
+            res.raw.push_back(input->getValue().get<std::string>());
         }
-        return sum;
+        CLOAK_DEBUG_FMT("mapping {}, key:{}, resolved:{}", name, key, fmt::join(res.raw, ", "));
+        return res;
     }
 };
 
@@ -14,6 +14,7 @@
 
 #pragma once
 #include "abi/abicoder.h"
+#include "app/agent_queue.h"
 #include "app/utils.h"
 #include "ds/logger.h"
 #include "ethereum/syncstate.h"
@@ -22,6 +23,7 @@
 #include "fmt/format.h"
 #include "kv/tx.h"
 #include "map"
+#include "optional"
 #include "string"
 #include "tls/key_pair.h"
 #include "tls/pem.h"
@@ -41,16 +43,43 @@ using Address = eevm::Address;
 using Policy = rpcparams::Policy;
 using h256 = eevm::KeccakHash;
 using ByteString = std::vector<uint8_t>;
+// ABI bytes[] elements, e.g. the states of a multi party transaction
+using ByteStrings = std::vector<ByteString>;
 
 // tables
 struct PrivacyPolicyTransaction;
-struct CloakPolicyTransaction;
+struct CloakPolicyDescriptor;
+struct CloakPolicyPayload;
+struct LegacyCloakPolicyTransaction;
 using Privacys = kv::Map<h256, PrivacyPolicyTransaction>;
 using PrivacyDigests = kv::Map<Address, h256>;
-using CloakPolicys = kv::Map<h256, CloakPolicyTransaction>;
+// a CloakPolicyTransaction is stored in three parts, see CloakPolicyStore
+using CloakPolicyDescriptors = kv::Map<h256, CloakPolicyDescriptor>;
+using CloakPolicyStatuses = kv::Map<h256, Status>;
+using CloakPolicyPayloads = kv::Map<h256, CloakPolicyPayload>;
+// the whole transaction, as stored before it was split. Only read.
+using LegacyCloakPolicys = kv::Map<h256, LegacyCloakPolicyTransaction>;
 using CloakDigests = kv::Map<Address, h256>;
 using StatesDigests = kv::Map<h256, h256>;
 
+struct StatusChange {
+    h256 id;
+    Status status;
+    MSGPACK_DEFINE(id, status);
+};
+// seq => change, and per shard the "first.<s>" and "last.<s>" retained
+// change, see StatusLog
+using StatusLog = kv::Map<uint64_t, StatusChange>;
+using StatusLogCursors = kv::Map<std::string, uint64_t>;
+// (contract, status) bucket => digests, and each digest's position in its
+// bucket
+using MptIndex = kv::Map<std::pair<uint256_t, uint64_t>, h256>;
+using MptIndexSize = kv::Map<uint256_t, uint64_t>;
+using MptIndexPosition = kv::Map<h256, uint64_t>;
+// (contract or sender, seq) => digest, in creation order
+using MptsByAddress = kv::Map<std::pair<Address, uint64_t>, h256>;
+using MptsByAddressSize = kv::Map<Address, uint64_t>;
+
 struct MultiPartyTransaction {
     size_t nonce;
     ByteString to;
@@ -88,8 +117,27 @@ struct PrivacyPolicyTransaction {
     PrivacyPolicyTransaction() {}
 };
 
-struct CloakPolicyTransaction {
- public:
+// Fields of a CloakPolicyTransaction that never change after creation
+struct CloakPolicyDescriptor {
+    Address from;
+    Address to;
+    Address verifierAddr;
+    ByteData codeHash;
+    std::vector<policy::Params> states;
+    MSGPACK_DEFINE(from, to, verifierAddr, codeHash, states);
+};
+
+// Fields that grow while the transaction collects inputs and states
+struct CloakPolicyPayload {
+    policy::Function function;
+    ByteStrings old_states;
+    std::vector<std::string> requested_addresses;
+    MSGPACK_DEFINE(function, old_states, requested_addresses);
+};
+
+// A CloakPolicyTransaction as stored in eth.transaction.cloak_policys, with
+// states as hex strings
+struct LegacyCloakPolicyTransaction {
     Address from;
     Address to;
     Address verifierAddr;
@@ -98,9 +146,7 @@ struct CloakPolicyTransaction {
     std::vector<policy::Params> states;
     std::vector<std::string> old_states;
     std::vector<std::string> requested_addresses;
-    std::map<std::string, std::string> public_keys;
     Status status = Status::PENDING;
-
     MSGPACK_DEFINE(from,
                    to,
                    verifierAddr,
@@ -110,8 +156,58 @@ struct CloakPolicyTransaction {
                    old_states,
                    requested_addresses,
                    status);
+
+    CloakPolicyDescriptor descriptor() const {
+        return {from, to, verifierAddr, codeHash, states};
+    }
+
+    CloakPolicyPayload payload() const {
+        ByteStrings raw;
+        for (auto&& s : old_states) {
+            raw.push_back(eevm::to_bytes(s));
+        }
+        return {function, raw, requested_addresses};
+    }
+};
+
+struct CloakPolicyTransaction {
+ public:
+    Address from;
+    Address to;
+    Address verifierAddr;
+    ByteData codeHash;
+    policy::Function function;
+    std::vector<policy::Params> states;
+    ByteStrings old_states;
+    std::vector<std::string> requested_addresses;
+    // checksum address => raw public key
+    std::map<std::string, ByteString> public_keys;
+    Status status = Status::PENDING;
+
     CloakPolicyTransaction() {}
 
+    CloakPolicyTransaction(const CloakPolicyDescriptor& d,
+                           const CloakPolicyPayload& p,
+                           Status status_) :
+        from(d.from),
+        to(d.to),
+        verifierAddr(d.verifierAddr),
+        codeHash(d.codeHash),
+        function(p.function),
+        states(d.states),
+        old_states(p.old_states),
+        requested_addresses(p.requested_addresses),
+        status(status_),
+        payload_dirty(false) {}
+
+    CloakPolicyDescriptor descriptor() const {
+        return {from, to, verifierAddr, codeHash, states};
+    }
+
+    CloakPolicyPayload payload() const {
+        return {function, old_states, requested_addresses};
+    }
+
     CloakPolicyTransaction(const PrivacyPolicyTransaction& ppt, const ByteData& name) {
         from = ppt.from;
         to = ppt.to;
@@ -133,23 +229,55 @@ struct CloakPolicyTransaction {
         for (auto&& [name, value] : inputs) {
             function.padding(name, value);
         }
+        resolved_keys.reset();
+        payload_dirty = true;
+    }
+
+    void set_old_states(const ByteStrings& states_) {
+        old_states = states_;
+        payload_dirty = true;
+    }
+
+    void set_outputs(const ByteString& outputs) {
+        function.raw_outputs = outputs;
+        payload_dirty = true;
+    }
+
+    // Whether the payload may differ from the stored one. Only transactions
+    // read back from their three records start out clean, and the payload
+    // fields are to be changed through the setters above.
+    bool payload_changed() const {
+        return payload_dirty;
+    }
+
+    // Keys of a mapping state, resolved against the inputs on first use and
+    // kept for the rest of the transaction
+    const std::vector<policy::MappingKey>& mapping_keys(const std::string& state) {
+        static const std::vector<policy::MappingKey> none;
+        if (!resolved_keys.has_value()) {
+            resolved_keys = function.resolve_mapping_keys(eevm::to_checksum_address(from));
+        }
+        auto it = resolved_keys->find(state);
+        return it == resolved_keys->end() ? none : it->second;
     }
 
-    std::vector<std::string> get_states_read() {
-        std::vector<std::string> read;
+    ByteStrings get_states_read() {
+        ByteStrings read;
         for (size_t i = 0; i < states.size(); i++) {
-            auto state = states[i];
+            const auto& state = states[i];
             if (state.structural_type["type"] != "mapping") {
                 continue;
             }
 
-            read.push_back(to_hex_string_fixed(i));
-            auto keys = function.get_mapping_keys(eevm::to_checksum_address(from), state.name);
-            read.push_back(to_hex_string_fixed(function.get_keys_size(state.name)));
-            read.insert(read.end(), keys.begin(), keys.end());
+            read.push_back(word(i));
+            const auto& keys = mapping_keys(state.name);
+            read.push_back(word(keys.size()));
+            for (auto&& key : keys) {
+                read.insert(read.end(), key.encoded.begin(), key.encoded.end());
+            }
         }
 
-        CLOAK_DEBUG_FMT("read:{}", fmt::join(read, ", "));
+        CLOAK_DEBUG_FMT("read:{}", fmt::join(Utils::to_hex_strings(read), ", "));
         return read;
     }
 
@@ -160,7 +288,7 @@ struct CloakPolicyTransaction {
             size_t factor = encrypted && owner != "all" ? 3 : 1;
             if (state.structural_type["type"] == "mapping") {
                 size_t depth = state.structural_type["depth"].get<size_t>();
-                size_t keys_size = function.get_keys_size(state.name);
+                size_t keys_size = mapping_keys(state.name).size();
                 res += 2 + (depth + factor) * keys_size;
             } else {
                 res += factor + 1;
@@ -171,13 +299,12 @@ struct CloakPolicyTransaction {
     }
 
     std::vector<uint8_t> get_states_call_data(bool encrypted) {
-        std::vector<std::string> read = get_states_read();
+        auto read = get_states_read();
         size_t return_len = get_states_return_len(encrypted);
-        CLOAK_DEBUG_FMT(
-            "get_states_call_data, return_len:{}, read:{}", return_len, fmt::join(read, ", "));
+        CLOAK_DEBUG_FMT("get_states_call_data, return_len:{}", return_len);
 
         auto encoder = abicoder::Encoder("get_states");
-        encoder.add_inputs("read", "bytes[]", read, abicoder::make_bytes_array());
+        encoder.add_bytes_array("read", read);
         encoder.add_inputs(
             "return_len", "uint256", to_hex_string(return_len), abicoder::number_type());
         auto data = encoder.encodeWithSignatrue();
@@ -187,51 +314,48 @@ struct CloakPolicyTransaction {
 
     bool request_public_keys(h256& target_digest,
                              cloak4ccf::TeeManager::AccountPtr acc,
-                             Address& service_addr) {
-        // state => address
-        std::map<std::string, std::string> addresses;
-        visit_states(old_states, true, [this, &addresses](auto id, size_t idx) {
-            if (states[id].structural_type["type"] == "address" &&
-                states[id].owner["owner"] == "all") {
-                addresses[states[id].name] =
-                    eevm::to_checksum_address(eevm::to_uint256(old_states[idx + 1]));
-            }
-        });
+                             Address& service_addr,
+                             cloak4ccf::agent::Queue& queue) {
+        const auto slots = layout(old_states, true);
+        const auto addresses = owner_addresses(slots);
 
         // get result
         std::vector<std::string> res;
         bool included_tee = false;
-        visit_states(old_states, true, [this, &included_tee, &res, &addresses](size_t id, size_t) {
-            auto p = states[id];
-            std::string owner = p.owner["owner"].get<std::string>();
-            if (owner == "all") {
-                return;
-            } else if (owner == "tee") {
-                included_tee = true;
-            } else if (owner == "mapping") {
-                // mapping
-                int key_var_pos = p.owner["var_pos"].get<int>();
-                if (key_var_pos == -1) {
-                    res.push_back(addresses.at(p.owner["var"].get<std::string>()));
-                } else {
-                    auto keys = function.get_mapping_keys(
-                        eevm::to_checksum_address(from), p.name, key_var_pos, false);
-                    res.insert(res.end(), keys.begin(), keys.end());
+        for (auto&& slot : slots) {
+            switch (slot.owner) {
+                case StateSlot::Owner::ALL:
+                    break;
+                case StateSlot::Owner::TEE:
+                    included_tee = true;
+                    break;
+                case StateSlot::Owner::MAPPING: {
+                    int key_var_pos = slot.state->owner["var_pos"].get<int>();
+                    if (key_var_pos == -1) {
+                        res.push_back(
+                            addresses.at(slot.state->owner["var"].get<std::string>()));
+                    } else {
+                        for (auto&& key : mapping_keys(slot.state->name)) {
+                            res.push_back(key.raw.at(key_var_pos));
+                        }
+                    }
+                    break;
                 }
-            } else {
-                // identifier
-                res.push_back(addresses.at(owner));
+                case StateSlot::Owner::IDENTIFIER:
+                    res.push_back(addresses.at(slot.owner_name));
+                    break;
             }
-        });
+        }
 
         if (res.empty()) {
             if (included_tee) {
-                old_states = decrypt_states(acc->get_tee_kp());
+                set_old_states(decrypt_states(acc->get_tee_kp(), slots));
             }
             return false;
         }
 
         requested_addresses = res;
+        payload_dirty = true;
         CLOAK_DEBUG_FMT("requested_addresses:{}", fmt::join(requested_addresses, ", "));
 
         auto encoder = abicoder::Encoder("getPk");
@@ -240,180 +364,242 @@ struct CloakPolicyTransaction {
 
         auto response =
             Ethereum::SyncStateResponse(target_digest, acc->get_address(), service_addr, data);
-        Utils::cloak_agent_log("request_public_keys", response);
+        queue.push("request_public_keys", response);
         return true;
     }
 
-    std::vector<std::string> decrypt_states(tls::KeyPairPtr tee_kp) {
-        std::vector<std::string> res;
-        visit_states(old_states, true, [this, &res, &tee_kp](size_t id, size_t idx) {
-            res.push_back(old_states[idx]);
-            auto p = states.at(id);
-            std::string owner = p.owner["owner"].get<std::string>();
-            if (owner == "all") {
-                if (p.structural_type["type"] == "mapping") {
-                    auto size = size_t(to_uint256(old_states[idx + 1]));
-                    size_t depth = p.structural_type["depth"].get<size_t>();
-                    res.insert(res.end(),
-                               old_states.begin() + idx + 1,
-                               old_states.begin() + idx + 2 + size * (depth + 1));
-                } else {
-                    res.push_back(old_states[idx + 1]);
-                }
-            } else if (owner == "mapping") {
-                auto mapping_keys =
-                    function.get_mapping_keys(eevm::to_checksum_address(from), p.name);
-                size_t depth = p.structural_type["depth"].get<size_t>();
-                size_t keys_size = function.get_keys_size(p.name);
-                auto it = mapping_keys.begin();
-                res.push_back(old_states[idx + 1]);
-                for (size_t j = 0; j < keys_size; j++) {
-                    res.insert(res.end(), it + j * depth, it + (j + 1) * depth);
-                    size_t data_pos = idx + 2 + depth + j * (depth + 3);
-                    auto sender_addr = to_uint256(old_states[data_pos + 2]);
-                    CLOAK_DEBUG_FMT(
-                        "data_pos:{}, sender_addr:{}", data_pos, to_checksum_address(sender_addr));
-                    if (sender_addr == 0) {
-                        res.push_back(abicoder::ZERO_HEX_STR);
-                        continue;
-                    }
-                    auto pk = public_keys.at(to_checksum_address(sender_addr));
-                    auto der = evm4ccf::get_der_from__raw_public_key(eevm::to_bytes(pk));
-
-                    // tag and iv
-                    auto&& [tag, iv] = Utils::split_tag_and_iv(to_bytes(old_states[data_pos + 1]));
-                    auto data = to_bytes(old_states[data_pos]);
-                    CLOAK_DEBUG_FMT("decryption, iv:{}, tag:{}, data:{}",
-                                    to_hex_string(iv),
-                                    to_hex_string(tag),
-                                    old_states[data_pos]);
-                    data.insert(data.end(), tag.begin(), tag.end());
-                    auto decrypted = Utils::decrypt_data(tee_kp, der, iv, data);
-                    res.push_back(to_hex_string(decrypted));
-                }
-            } else {
-                // tee and identifier
-                auto sender_addr = to_checksum_address(to_uint256(old_states[idx + 3]));
-                CLOAK_DEBUG_FMT("sender_addr:{}", sender_addr);
-                if (to_uint256(sender_addr) == 0) {
-                    if (p.structural_type["type"] == "array") {
-                        size_t array_size = abicoder::get_static_array_size(p.structural_type);
-                        res.push_back(Utils::repeat_hex_string(abicoder::ZERO_HEX_STR, array_size));
-                    } else {
-                        res.push_back(abicoder::ZERO_HEX_STR);
-                    }
-                    return;
-                }
-                // tag and iv
-                auto pk_der = p.owner["owner"] == "tee" ?
-                    get_der_from_public_key(tee_kp->get_raw_context()) :
-                    get_der_from__raw_public_key(eevm::to_bytes(public_keys.at(sender_addr)));
-
-                auto&& [tag, iv] = Utils::split_tag_and_iv(eevm::to_bytes(old_states[idx + 2]));
-                CLOAK_DEBUG_FMT("tag:{}, iv:{}", tag, iv);
-                auto data = eevm::to_bytes(old_states[idx + 1]);
-                data.insert(data.end(), tag.begin(), tag.end());
-                auto decrypted = Utils::decrypt_data(tee_kp, pk_der, iv, data);
-                res.push_back(eevm::to_hex_string(decrypted));
-            }
-        });
-
-        CLOAK_DEBUG_FMT("old_states:{}, res:{}", fmt::join(old_states, ", "), fmt::join(res, ", "));
-        return res;
+    ByteStrings decrypt_states(tls::KeyPairPtr tee_kp) {
+        return decrypt_states(tee_kp, layout(old_states, true));
     }
 
-    std::vector<std::string> encrypt_states(tls::KeyPairPtr tee_kp,
-                                            const std::vector<std::string>& new_states) {
-        // identifier owner addresses
-        std::map<std::string, std::string> addresses;
-        visit_states(new_states, false, [this, &addresses](size_t id, size_t idx) {
-            if (states[id].structural_type["type"] == "address" &&
-                states[id].owner["owner"] == "all") {
-                addresses[states[id].name] =
-                    eevm::to_checksum_address(eevm::to_uint256(old_states[idx + 1]));
+    ByteStrings encrypt_states(tls::KeyPairPtr tee_kp, const ByteStrings& new_states) {
+        const auto slots = layout(new_states, false);
+        // owners other than the tee are only present when old_states is still
+        // encrypted, see request_public_keys
+        std::optional<std::map<std::string, std::string>> addresses;
+        auto owner_address = [this, &addresses](const std::string& name) {
+            if (!addresses.has_value()) {
+                addresses = owner_addresses(layout(old_states, true));
             }
-        });
-
-        std::vector<std::string> res;
-        visit_states(
-            new_states,
-            false,
-            [this, &res, &addresses, &tee_kp, &new_states](size_t id, size_t idx) {
-                // policy state
-                auto tee_addr_hex = to_hex_string(get_addr_from_kp(tee_kp));
-                auto ps = states[id];
-                res.push_back(new_states[idx]);
-                CLOAK_DEBUG_FMT("ps:{}", nlohmann::json(ps).dump());
-                if (ps.owner["owner"] == "all") {
-                    if (ps.structural_type["type"] == "mapping") {
-                        auto size = to_uint64(new_states[idx + 1]);
-                        size_t depth = ps.structural_type["depth"].get<size_t>();
-                        res.insert(res.end(),
-                                   new_states.begin() + idx + 1,
-                                   new_states.begin() + idx + 2 + (depth + 1) * size);
-                    } else {
-                        res.push_back(new_states[idx + 1]);
-                    }
-                } else if (ps.owner["owner"] == "mapping") {
-                    auto mapping_keys =
-                        function.get_mapping_keys(eevm::to_checksum_address(from), ps.name);
-                    size_t depth = ps.structural_type["depth"].get<size_t>();
-                    size_t keys_size = function.get_keys_size(ps.name);
+            return addresses->at(name);
+        };
+        auto tee_addr_hex = to_hex_string(get_addr_from_kp(tee_kp));
+
+        ByteStrings res;
+        for (auto&& slot : slots) {
+            const auto idx = slot.offset;
+            res.push_back(new_states[idx]);
+            switch (slot.owner) {
+                case StateSlot::Owner::ALL:
+                    // id excluded
+                    res.insert(res.end(),
+                               new_states.begin() + idx + 1,
+                               new_states.begin() + idx + slot.length);
+                    break;
+                case StateSlot::Owner::MAPPING: {
+                    const auto& keys = mapping_keys(slot.state->name);
+                    const int var_pos = slot.state->owner["var_pos"].get<int>();
                     res.push_back(new_states[idx + 1]);
-                    auto it = mapping_keys.begin();
-                    for (size_t j = 0; j < keys_size; j++) {
-                        res.insert(res.end(), it + depth * j, it + depth * (j + 1));
-                        auto iv = tls::create_entropy()->random(crypto::GCM_SIZE_IV);
-                        auto msg_sender =
-                            eevm::to_checksum_address(eevm::to_uint256(mapping_keys[j]));
+                    for (size_t j = 0; j < slot.keys; j++) {
+                        const auto& key = keys.at(j);
+                        res.insert(res.end(), key.encoded.begin(), key.encoded.end());
+                        // the owner whose public key request_public_keys fetched
+                        auto owner = eevm::to_checksum_address(eevm::to_uint256(
+                            var_pos == -1 ?
+                                owner_address(slot.state->owner["var"].get<std::string>()) :
+                                key.raw.at(var_pos)));
 
-                        auto der = evm4ccf::get_der_from__raw_public_key(
-                            eevm::to_bytes(public_keys.at(msg_sender)));
-                        auto&& [encrypted, tag] = Utils::encrypt_data_s(
-                            tee_kp, der, iv, to_bytes(new_states[idx + 3 + j * 2]));
+                        auto iv = tls::create_entropy()->random(crypto::GCM_SIZE_IV);
+                        auto der = evm4ccf::get_der_from__raw_public_key(public_keys.at(owner));
+                        const auto& value = new_states[idx + 2 + j * (slot.depth + 1) + slot.depth];
+                        auto&& [encrypted, tag] = Utils::encrypt_data_s(tee_kp, der, iv, value);
                         CLOAK_DEBUG_FMT("iv:{}, tag:{}, data:{}", iv, tag, encrypted);
                         tag.insert(tag.end(), iv.begin(), iv.end());
-                        res.insert(res.end(),
-                                   {to_hex_string(encrypted), to_hex_string(tag), mapping_keys[j]});
+                        res.insert(res.end(), {encrypted, tag, word(eevm::to_uint256(owner))});
                     }
-                } else {
-                    // tee and identifier
-                    CLOAK_DEBUG_FMT("id:{}, owner:{}", id, ps.owner.dump());
-                    std::string sender_addr =
-                        ps.owner["owner"] == "tee" ? tee_addr_hex : addresses.at(ps.owner["owner"]);
+                    break;
+                }
+                case StateSlot::Owner::TEE:
+                case StateSlot::Owner::IDENTIFIER: {
+                    const bool tee = slot.owner == StateSlot::Owner::TEE;
+                    std::string sender_addr = tee ? tee_addr_hex : owner_address(slot.owner_name);
 
-                    auto pk_der = ps.owner["owner"] == "tee" ?
-                        get_der_from_public_key(tee_kp->get_raw_context()) :
-                        get_der_from__raw_public_key(eevm::to_bytes(public_keys.at(sender_addr)));
+                    auto pk_der = tee ? get_der_from_public_key(tee_kp->get_raw_context()) :
+                                        get_der_from__raw_public_key(public_keys.at(sender_addr));
 
                     auto iv = tls::create_entropy()->random(crypto::GCM_SIZE_IV);
                     auto&& [encrypted, tag] =
-                        Utils::encrypt_data_s(tee_kp, pk_der, iv, to_bytes(new_states[idx + 1]));
+                        Utils::encrypt_data_s(tee_kp, pk_der, iv, new_states[idx + 1]);
                     tag.insert(tag.end(), iv.begin(), iv.end());
-                    res.insert(res.end(),
-                               {to_hex_string(encrypted), to_hex_string(tag), sender_addr});
+                    res.insert(res.end(), {encrypted, tag, eevm::to_bytes(sender_addr)});
+                    break;
                 }
-            });
+            }
+        }
         return res;
     }
 
-    // f: size_t(the id of states) -> size_t(the index of states) -> void
-    void visit_states(const std::vector<std::string>& v_states,
-                      bool is_encryped,
-                      std::function<void(size_t, size_t)> f) {
-        for (size_t i = 0; i < v_states.size();) {
-            size_t id = to_uint64(v_states[i]);
-            f(id, i);
-            auto state = states[id];
-            int factor = is_encryped && state.owner["owner"] != "all" ? 3 : 1;
-            if (state.structural_type["type"] == "mapping") {
-                size_t depth = state.structural_type["depth"].get<size_t>();
-                i += 2 + to_uint64(v_states[i + 1]) * (factor + depth);
+    // Where one state sits in a flat state list: the state id, then its value
+    // words, or for mappings the key count and the keys and values
+    struct StateSlot {
+        enum class Owner { ALL, TEE, MAPPING, IDENTIFIER };
+
+        size_t id = 0;
+        const policy::Params* state = nullptr;
+        // index of the id in the list, and the number of entries from there
+        size_t offset = 0;
+        size_t length = 0;
+        Owner owner = Owner::ALL;
+        // set for identifier owners
+        std::string owner_name;
+        std::string type;
+        size_t depth = 0;
+        size_t keys = 0;
+    };
+
+    // Parses a state list once, so that the passes over it read the slots
+    // rather than the list and the policy JSON
+    std::vector<StateSlot> layout(const ByteStrings& v_states, bool is_encryped) const {
+        std::vector<StateSlot> slots;
+        for (size_t i = 0; i < v_states.size(); i += slots.back().length) {
+            StateSlot slot;
+            slot.id = size_t(word(v_states[i]));
+            slot.state = &states.at(slot.id);
+            slot.offset = i;
+            slot.type = slot.state->structural_type.at("type").get<std::string>();
+
+            const auto owner = slot.state->owner.at("owner").get<std::string>();
+            if (owner == "all") {
+                slot.owner = StateSlot::Owner::ALL;
+            } else if (owner == "tee") {
+                slot.owner = StateSlot::Owner::TEE;
+            } else if (owner == "mapping") {
+                slot.owner = StateSlot::Owner::MAPPING;
             } else {
-                i += 1 + factor;
+                slot.owner = StateSlot::Owner::IDENTIFIER;
+                slot.owner_name = owner;
+            }
+
+            size_t factor = is_encryped && slot.owner != StateSlot::Owner::ALL ? 3 : 1;
+            if (slot.type == "mapping") {
+                if (i + 1 >= v_states.size()) {
+                    throw std::logic_error(fmt::format("State {} is truncated", slot.id));
+                }
+                slot.depth = slot.state->structural_type.at("depth").get<size_t>();
+                slot.keys = size_t(word(v_states[i + 1]));
+                slot.length = 2 + slot.keys * (factor + slot.depth);
+            } else {
+                slot.length = 1 + factor;
+            }
+            if (i + slot.length > v_states.size()) {
+                throw std::logic_error(fmt::format("State {} is truncated", slot.id));
+            }
+            slots.push_back(std::move(slot));
+        }
+        return slots;
+    }
+
+ private:
+    // Addresses of the public address states in old_states, by state name.
+    // slots is the layout of old_states.
+    std::map<std::string, std::string> owner_addresses(const std::vector<StateSlot>& slots) const {
+        std::map<std::string, std::string> addresses;
+        for (auto&& slot : slots) {
+            if (slot.type == "address" && slot.owner == StateSlot::Owner::ALL) {
+                addresses[slot.state->name] =
+                    eevm::to_checksum_address(word(old_states[slot.offset + 1]));
+            }
+        }
+        return addresses;
+    }
+
+    ByteStrings decrypt_states(tls::KeyPairPtr tee_kp, const std::vector<StateSlot>& slots) {
+        ByteStrings res;
+        for (auto&& slot : slots) {
+            const auto idx = slot.offset;
+            res.push_back(old_states[idx]);
+            switch (slot.owner) {
+                case StateSlot::Owner::ALL:
+                    res.insert(res.end(),
+                               old_states.begin() + idx + 1,
+                               old_states.begin() + idx + slot.length);
+                    break;
+                case StateSlot::Owner::MAPPING: {
+                    const auto& keys = mapping_keys(slot.state->name);
+                    const auto depth = slot.depth;
+                    res.push_back(old_states[idx + 1]);
+                    for (size_t j = 0; j < slot.keys; j++) {
+                        const auto& encoded = keys.at(j).encoded;
+                        res.insert(res.end(), encoded.begin(), encoded.end());
+                        size_t data_pos = idx + 2 + depth + j * (depth + 3);
+                        auto sender_addr = word(old_states[data_pos + 2]);
+                        CLOAK_DEBUG_FMT("data_pos:{}, sender_addr:{}",
+                                        data_pos,
+                                        to_checksum_address(sender_addr));
+                        if (sender_addr == 0) {
+                            res.emplace_back(abicoder::Type::MAX_BYTE_LENGTH);
+                            continue;
+                        }
+                        auto der = evm4ccf::get_der_from__raw_public_key(
+                            public_keys.at(to_checksum_address(sender_addr)));
+
+                        // tag and iv
+                        auto&& [tag, iv] = Utils::split_tag_and_iv(old_states[data_pos + 1]);
+                        auto data = old_states[data_pos];
+                        CLOAK_DEBUG_FMT("decryption, iv:{}, tag:{}, data:{}",
+                                        to_hex_string(iv),
+                                        to_hex_string(tag),
+                                        to_hex_string(data));
+                        data.insert(data.end(), tag.begin(), tag.end());
+                        res.push_back(Utils::decrypt_data(tee_kp, der, iv, data));
+                    }
+                    break;
+                }
+                case StateSlot::Owner::TEE:
+                case StateSlot::Owner::IDENTIFIER: {
+                    auto sender = word(old_states[idx + 3]);
+                    CLOAK_DEBUG_FMT("sender_addr:{}", to_checksum_address(sender));
+                    if (sender == 0) {
+                        size_t words = slot.type == "array" ?
+                            abicoder::get_static_array_size(slot.state->structural_type) :
+                            1;
+                        res.emplace_back(words * abicoder::Type::MAX_BYTE_LENGTH);
+                        break;
+                    }
+                    // tag and iv
+                    auto pk_der = slot.owner == StateSlot::Owner::TEE ?
+                        get_der_from_public_key(tee_kp->get_raw_context()) :
+                        get_der_from__raw_public_key(public_keys.at(to_checksum_address(sender)));
+
+                    auto&& [tag, iv] = Utils::split_tag_and_iv(old_states[idx + 2]);
+                    CLOAK_DEBUG_FMT("tag:{}, iv:{}", tag, iv);
+                    auto data = old_states[idx + 1];
+                    data.insert(data.end(), tag.begin(), tag.end());
+                    res.push_back(Utils::decrypt_data(tee_kp, pk_der, iv, data));
+                    break;
+                }
             }
         }
+
+        CLOAK_DEBUG_FMT("old_states:{}, res:{}",
+                        fmt::join(Utils::to_hex_strings(old_states), ", "),
+                        fmt::join(Utils::to_hex_strings(res), ", "));
+        return res;
+    }
+
+    // a state word is at most 32 big endian bytes
+    static uint256_t word(const ByteString& b) {
+        return eevm::from_big_endian(b.data(), b.size());
+    }
+
+    static ByteString word(const uint256_t& v) {
+        ByteString b(abicoder::Type::MAX_BYTE_LENGTH);
+        eevm::to_big_endian(v, b.data());
+        return b;
     }
+
+    std::optional<policy::MappingKeys> resolved_keys;
+    bool payload_dirty = true;
 };
 
 } // namespace evm4ccf
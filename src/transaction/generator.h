@@ -13,12 +13,16 @@
 // limitations under the License.
 
 #pragma once
+#include "app/metrics.h"
 #include "app/rpc/context.h"
 #include "ethereum/execute_transaction.h"
 #include "ethereum/state.h"
 #include "ethereum/syncstate.h"
 #include "ethereum/tee_manager.h"
 #include "signature.h"
+#include "mpt_index.h"
+#include "policy_store.h"
+#include "status_log.h"
 #include "tables.h"
 #include "transaction/exception.h"
 #include "types.h"
@@ -37,14 +41,16 @@ class Generator {
  private:
     CloakContext& ctx;
     TransactionTables& tables;
+    CloakPolicyStore policies;
 
  public:
-    explicit Generator(CloakContext& ctx_) : ctx(ctx_), tables(ctx.cloakTables.txTables) {}
+    explicit Generator(CloakContext& ctx_) :
+        ctx(ctx_), tables(ctx.cloakTables.txTables), policies(ctx.tx, tables) {}
 
     auto add_privacy(const eevm::rlp::ByteString& encoded) {
         const auto decoded = evm4ccf::PrivacyTransactionWithSignature(encoded);
         PrivacyPolicyTransaction tc;
-        auto hash = decoded.to_transaction_call(tc);
+        auto hash = CLOAK_TIMED("sigrecover", [&]() { return decoded.to_transaction_call(tc); });
         auto [p, pd] = ctx.tx.get_view(tables.privacys, tables.privacy_digests);
         auto digests = pd->get(tc.to);
 
@@ -64,17 +70,17 @@ class Generator {
     auto add_cloakTransaction(const eevm::rlp::ByteString& encoded) {
         const auto decoded = evm4ccf::CloakTransactionWithSignature(encoded);
         evm4ccf::MultiPartyTransaction mpt;
-        decoded.to_transaction_call(mpt);
+        CLOAK_TIMED("sigrecover", [&]() { decoded.to_transaction_call(mpt); });
 
-        auto [cp, cd, mp] =
-            ctx.tx.get_view(tables.cloak_policys, tables.cloak_digests, tables.multi_partys);
+        auto cd = ctx.tx.get_view(tables.cloak_digests);
 
         // mpt hash
         auto multi_digest = decoded.digest();
 
         if (mpt.check_transaction_type()) {
             eevm::KeccakHash target_digest = Utils::vec_to_KeccakHash(mpt.to);
-            auto cpt_opt = cp->get(target_digest);
+            auto cpt_opt =
+                CLOAK_TIMED("policy_lookup", [&]() { return policies.get(target_digest); });
             if (!cpt_opt.has_value()) {
                 throw TransactionException(
                     fmt::format("multi party transaction digests doesn't exists (digests {})",
@@ -86,12 +92,11 @@ class Generator {
             }
 
             cpt_opt->set_content(mpt.params.inputs);
-            cp->put(target_digest, cpt_opt.value());
-
             if (cpt_opt->function.complete()) {
                 auto acc = TeeManager::State::make_account(ctx.tx, ctx.cloakTables.tee_table);
                 request_old_state(target_digest, cpt_opt.value(), acc);
             }
+            put_policy(target_digest, cpt_opt.value());
 
             return target_digest;
         }
@@ -110,75 +115,74 @@ class Generator {
         CloakPolicyTransaction cpt(ppt, mpt.name());
 
         cpt.set_content(mpt.params.inputs);
-        cp->put(multi_digest, cpt);
-        cd->put(to, multi_digest);
-        LOG_INFO_FMT("add user transaction digests {}", eevm::to_hex_string(multi_digest));
-
         if (cpt.function.complete()) {
             auto acc = TeeManager::State::make_account(ctx.tx, ctx.cloakTables.tee_table);
             request_old_state(multi_digest, cpt, acc);
         }
+        put_policy(multi_digest, cpt);
+        MptIndex::add(ctx.tx, tables, multi_digest, to, mpt.from);
+        cd->put(to, multi_digest);
+        LOG_INFO_FMT("add user transaction digests {}", eevm::to_hex_string(multi_digest));
 
         return multi_digest;
     }
 
     void sync_report(const SyncReport& report) {
-        auto cp_handler = ctx.tx.get_view(tables.cloak_policys);
         auto target_digest = Utils::to_KeccakHash(report.id);
-        auto cp_opt = cp_handler->get(target_digest);
-        if (!cp_opt.has_value()) {
+        auto descriptor = policies.get_descriptor(target_digest);
+        if (!descriptor.has_value()) {
             throw TransactionException(
                 fmt::format("multi party transaction digests doesn't exists (digests {})",
                             eevm::to_hex_string(target_digest)));
         }
 
-        if (report.result == "SYNCED") {
-            cp_opt->set_status(Status::SYNCED);
-        } else {
-            cp_opt->set_status(Status::SYNC_FAILED);
-        }
-
-        cp_handler->put(target_digest, cp_opt.value());
+        const auto status = report.result == "SYNCED" ? Status::SYNCED : Status::SYNC_FAILED;
+        const auto prev_status = policies.get_status(target_digest);
+        policies.set_status(target_digest, status);
+        record_status(target_digest, descriptor->to, prev_status, status);
     }
 
     void sync_public_keys(const SyncKeys& syncKeys) {
         auto target_digest = Utils::to_KeccakHash(syncKeys.tx_hash);
-        auto cp_handler = ctx.tx.get_view(tables.cloak_policys);
-        auto cp_opt = cp_handler->get(target_digest);
+        auto cp_opt = policies.get(target_digest);
         if (!cp_opt.has_value()) {
             throw TransactionException(
                 fmt::format("multi party transaction digests doesn't exists (digests {})",
                             eevm::to_hex_string(target_digest)));
         }
 
-        std::map<std::string, std::string> public_keys;
+        std::map<std::string, evm4ccf::ByteString> public_keys;
         auto public_keys_data = eevm::to_bytes(syncKeys.data);
-        auto public_key_list = abicoder::Decoder::decode_bytes_array(public_keys_data);
+        auto public_key_list = CLOAK_TIMED("abi_decode", [&]() {
+            return abicoder::Decoder::decode_bytes_array(public_keys_data);
+        });
 
         for (size_t i = 0; i < cp_opt->requested_addresses.size(); i++) {
-            public_keys[cp_opt->requested_addresses[i]] = public_key_list[i];
+            const auto addr = eevm::to_uint256(cp_opt->requested_addresses[i]);
+            public_keys[eevm::to_checksum_address(addr)] = public_key_list.at(i);
         }
 
         cp_opt->public_keys = public_keys;
         auto acc = TeeManager::State::make_account(ctx.tx, ctx.cloakTables.tee_table);
-        auto decrypted = cp_opt->decrypt_states(acc->get_tee_kp());
+        auto decrypted =
+            CLOAK_TIMED("crypto", [&]() { return cp_opt->decrypt_states(acc->get_tee_kp()); });
         auto new_states = Ethereum::execute_mpt(ctx, cp_opt.value(), acc->get_address(), decrypted);
         sync_result(target_digest, cp_opt.value(), acc, new_states);
-        cp_handler->put(target_digest, cp_opt.value());
+        put_policy(target_digest, cp_opt.value());
     }
 
     void sync_states(const SyncStates& syncStates) {
         auto target_digest = Utils::to_KeccakHash(syncStates.tx_hash);
-        auto [cp_handler, states_handler] =
-            ctx.tx.get_view(tables.cloak_policys, tables.states_digests);
-        auto cp_opt = cp_handler->get(target_digest);
+        auto states_handler = ctx.tx.get_view(tables.states_digests);
+        auto cp_opt = policies.get(target_digest);
         if (!cp_opt.has_value()) {
             throw TransactionException(
                 fmt::format("multi party transaction digests doesn't exists (digests {})",
                             eevm::to_hex_string(target_digest)));
         }
         auto data = eevm::to_bytes(syncStates.data);
-        auto old_states = abicoder::Decoder::decode_bytes_array(data);
+        auto old_states = CLOAK_TIMED(
+            "abi_decode", [&]() { return abicoder::Decoder::decode_bytes_array(data); });
         states_handler->put(target_digest, eevm::keccak_256(data));
 
         if (!cp_opt->function.complete()) {
@@ -186,23 +190,49 @@ class Generator {
                 fmt::format("function is not ready, get {}", eevm::to_hex_string(target_digest)));
         }
 
-        cp_opt->old_states = old_states;
+        cp_opt->set_old_states(old_states);
 
         auto acc = TeeManager::State::make_account(ctx.tx, ctx.cloakTables.tee_table);
         auto service_addr =
             TeeManager::get_service_addr(ctx.tx.get_view(ctx.cloakTables.tee_table.service));
-        if (!cp_opt->request_public_keys(target_digest, acc, service_addr)) {
+        agent::Queue queue(ctx.tx, ctx.cloakTables.agent);
+        if (!cp_opt->request_public_keys(target_digest, acc, service_addr, queue)) {
             auto new_states =
                 Ethereum::execute_mpt(ctx, cp_opt.value(), acc->get_address(), old_states);
             sync_result(target_digest, cp_opt.value(), acc, new_states);
         }
 
-        cp_handler->put(target_digest, cp_opt.value());
+        put_policy(target_digest, cp_opt.value());
     }
 
  private:
+    // Writes the payload and status of a multi party transaction, and its
+    // descriptor when it is new
+    void put_policy(const evm4ccf::h256& digest, const CloakPolicyTransaction& cpt) {
+        const auto prev_status = policies.get_status(digest);
+        if (prev_status.has_value()) {
+            policies.update(digest, cpt);
+        } else {
+            policies.create(digest, cpt);
+        }
+        record_status(digest, cpt.to, prev_status, cpt.get_status());
+    }
+
+    // Logs a status change and moves the transaction in the (contract,
+    // status) index
+    void record_status(const evm4ccf::h256& digest,
+                       const eevm::Address& contract,
+                       std::optional<Status> prev_status,
+                       Status status) {
+        if (prev_status != status) {
+            StatusLog(ctx.tx, tables).append(digest, status);
+            MptIndex(ctx.tx, tables).update(digest, contract, prev_status, status);
+        }
+    }
+
     std::tuple<eevm::KeccakHash, PrivacyPolicyTransaction> check_privacy_modules(
         const eevm::Address& to) {
+        CLOAK_PHASE("policy_lookup");
         auto [p, pd] = ctx.tx.get_view(tables.privacys, tables.privacy_digests);
 
         auto privacy_digests = pd->get(to);
@@ -229,7 +259,7 @@ class Generator {
 
         auto response =
             Ethereum::SyncStateResponse(target_digest, acc->get_address(), cpt.verifierAddr, data);
-        Utils::cloak_agent_log("request_old_state", response);
+        agent::Queue(ctx.tx, ctx.cloakTables.agent).push("request_old_state", response);
     }
 
     // == Sync new states ==
@@ -237,33 +267,40 @@ class Generator {
                      CloakPolicyTransaction& cpt,
                      TeeManager::AccountPtr acc,
                      const std::vector<uint8_t>& new_states_) {
-        auto new_states = abicoder::Decoder::decode_bytes_array(new_states_);
-        CLOAK_DEBUG_FMT("splited new_states:{}\n", fmt::join(new_states, "\n"));
-
-        auto encrypted_states = cpt.encrypt_states(acc->get_tee_kp(), new_states);
-        CLOAK_DEBUG_FMT("encrypted:{}", fmt::join(encrypted_states, ", "));
-
-        auto old_states_len = cpt.get_states_return_len(true);
-        auto encoder = abicoder::Encoder("set_states");
-
-        encoder.add_inputs("read", "bytes[]", cpt.get_states_read(), abicoder::make_bytes_array());
-        encoder.add_inputs("old_states_len",
-                           "uint256",
-                           eevm::to_hex_string(old_states_len),
-                           abicoder::number_type());
-        encoder.add_inputs("data", "bytes[]", encrypted_states, abicoder::make_bytes_array());
-        encoder.add_inputs(
-            "proof", "uint256[]", get_proof(cpt, target_digest), abicoder::make_number_array());
-        auto packed = encoder.encodeWithSignatrue();
+        auto new_states = CLOAK_TIMED(
+            "abi_decode", [&]() { return abicoder::Decoder::decode_bytes_array(new_states_); });
+        CLOAK_DEBUG_FMT("splited new_states:{}\n",
+                        fmt::join(Utils::to_hex_strings(new_states), "\n"));
+
+        auto encrypted_states = CLOAK_TIMED(
+            "crypto", [&]() { return cpt.encrypt_states(acc->get_tee_kp(), new_states); });
+        CLOAK_DEBUG_FMT("encrypted:{}", fmt::join(Utils::to_hex_strings(encrypted_states), ", "));
+
+        auto proof = get_proof(cpt, target_digest);
+        auto packed = CLOAK_TIMED("abi_encode", [&]() {
+            auto old_states_len = cpt.get_states_return_len(true);
+            auto encoder = abicoder::Encoder("set_states");
+
+            encoder.add_bytes_array("read", cpt.get_states_read());
+            encoder.add_inputs("old_states_len",
+                               "uint256",
+                               eevm::to_hex_string(old_states_len),
+                               abicoder::number_type());
+            encoder.add_bytes_array("data", encrypted_states);
+            encoder.add_inputs("proof", "uint256[]", proof, abicoder::make_number_array());
+            return encoder.encodeWithSignatrue();
+        });
         CLOAK_DEBUG_FMT("encoded data:{}", abicoder::split_abi_data_to_str(packed));
 
         Ethereum::MessageCall mc(acc->get_address(), cpt.verifierAddr, packed);
         // TODO(DUMMY): choose a better value based on concrete contract
         CLOAK_DEBUG_FMT("data:{}", mc.data);
-        auto signed_data = evm4ccf::sign_eth_tx(acc->get_tee_kp(), mc, acc->get_nonce());
+        auto signed_data = CLOAK_TIMED("crypto", [&]() {
+            return evm4ccf::sign_eth_tx(acc->get_tee_kp(), mc, acc->get_nonce());
+        });
         auto response = Ethereum::SyncStateResponse(target_digest, signed_data);
 
-        Utils::cloak_agent_log("sync_result", response);
+        agent::Queue(ctx.tx, ctx.cloakTables.agent).push("sync_result", response);
         cpt.set_status(evm4ccf::Status::SYNCING);
         acc->increment_nonce();
     }
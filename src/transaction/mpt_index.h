@@ -0,0 +1,225 @@
+// Copyright (c) 2020 Oxford-Hainan Blockchain Research Institute
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#include "app/utils.h"
+#include "policy_store.h"
+#include "tables.h"
+
+#include <algorithm>
+#include <eEVM/util.h>
+#include <kv/tx.h>
+#include <optional>
+
+namespace cloak4ccf {
+namespace Transaction {
+
+// Secondary indexes of multi party transactions.
+//
+// By (contract, status): each bucket is a dense list of digests. A digest
+// whose status changes is swap-removed from its old bucket and appended to
+// the new one, so lookups read only the matching digests.
+//
+// By contract and by sender: append-only lists in creation order, read a
+// page at a time.
+class MptIndex {
+ public:
+    static constexpr uint64_t max_results = 1000;
+
+    MptIndex(kv::Tx& tx, TransactionTables& tables) :
+        index(tx.get_view(tables.mpt_index)),
+        size(tx.get_view(tables.mpt_index_size)),
+        position(tx.get_view(tables.mpt_index_position)) {}
+
+    static uint256_t bucket(const eevm::Address& contract, evm4ccf::Status status) {
+        uint8_t buf[33] = {};
+        eevm::to_big_endian(contract, buf);
+        buf[32] = static_cast<uint8_t>(status);
+        const auto h = eevm::keccak_256(buf + 12, sizeof(buf) - 12);
+        return eevm::from_big_endian(h.data(), h.size());
+    }
+
+    void update(const evm4ccf::h256& digest,
+                const eevm::Address& contract,
+                std::optional<evm4ccf::Status> prev,
+                evm4ccf::Status status) {
+        if (prev == status) {
+            return;
+        }
+        if (prev.has_value()) {
+            remove(bucket(contract, prev.value()), digest);
+        }
+
+        const auto b = bucket(contract, status);
+        const auto n = size->get(b).value_or(0);
+        index->put({b, n}, digest);
+        size->put(b, n + 1);
+        position->put(digest, n);
+    }
+
+    static void add(kv::Tx& tx,
+                    TransactionTables& tables,
+                    const evm4ccf::h256& digest,
+                    const eevm::Address& contract,
+                    const eevm::Address& sender) {
+        append(tx.get_view(tables.mpts_by_contract),
+               tx.get_view(tables.mpts_by_contract_size),
+               contract,
+               digest);
+        append(tx.get_view(tables.mpts_by_sender),
+               tx.get_view(tables.mpts_by_sender_size),
+               sender,
+               digest);
+    }
+
+    template <typename TX>
+    static evm4ccf::MPT_LIST::Out list(TX& tx,
+                                       TransactionTables& tables,
+                                       const evm4ccf::MPT_LIST::In& in) {
+        if (in.contract.empty() == in.sender.empty()) {
+            throw std::logic_error("Exactly one of contract and sender is required");
+        }
+        const bool by_contract = !in.contract.empty();
+        const auto addr = eevm::to_uint256(by_contract ? in.contract : in.sender);
+        auto list = tx.get_read_only_view(by_contract ? tables.mpts_by_contract :
+                                                        tables.mpts_by_sender);
+        auto list_size = tx.get_read_only_view(by_contract ? tables.mpts_by_contract_size :
+                                                             tables.mpts_by_sender_size);
+
+        evm4ccf::MPT_LIST::Out out;
+        out.total = list_size->get(addr).value_or(0);
+        const auto start = std::min(in.start, out.total);
+        out.next = std::min(out.total, start + std::min(in.limit, max_results));
+
+        std::vector<evm4ccf::h256> digests;
+        for (auto i = start; i < out.next; i++) {
+            digests.push_back(list->get({addr, i}).value());
+        }
+        out.results = results(tx, tables, digests);
+        return out;
+    }
+
+    // At most max digests of the bucket, oldest first. Sets truncated when
+    // the bucket holds more.
+    template <typename TX>
+    static std::vector<evm4ccf::h256> find(TX& tx,
+                                           TransactionTables& tables,
+                                           const eevm::Address& contract,
+                                           evm4ccf::Status status,
+                                           uint64_t max,
+                                           bool& truncated) {
+        auto index = tx.get_read_only_view(tables.mpt_index);
+        const auto b = bucket(contract, status);
+        const auto n = tx.get_read_only_view(tables.mpt_index_size)->get(b).value_or(0);
+        truncated = truncated || n > max;
+
+        std::vector<evm4ccf::h256> res;
+        for (uint64_t i = 0; i < std::min(n, max); i++) {
+            res.push_back(index->get({b, i}).value());
+        }
+        return res;
+    }
+
+    // Looks up the listed ids, or else the transactions of the contract with
+    // one of the statuses. Unknown ids are left out.
+    template <typename TX>
+    static evm4ccf::MPT_BULK::Out bulk_get(TX& tx,
+                                           TransactionTables& tables,
+                                           const evm4ccf::MPT_BULK::In& in) {
+        using evm4ccf::Status;
+        const auto max = std::min(in.max, max_results);
+        evm4ccf::MPT_BULK::Out out;
+        std::vector<evm4ccf::h256> digests;
+        if (!in.ids.empty()) {
+            if (in.ids.size() > max) {
+                throw std::logic_error(fmt::format("At most {} ids can be looked up", max));
+            }
+            for (auto&& id : in.ids) {
+                digests.push_back(Utils::to_KeccakHash(id));
+            }
+        } else {
+            if (in.contract.empty()) {
+                throw std::logic_error("Either ids or contract is required");
+            }
+            auto statuses = in.statuses;
+            if (statuses.empty()) {
+                statuses = {Status::PENDING,
+                            Status::REQUESTING_OLD_STATES,
+                            Status::SYNCING,
+                            Status::SYNCED,
+                            Status::SYNC_FAILED,
+                            Status::DROPPED};
+            }
+            const auto contract = eevm::to_uint256(in.contract);
+            for (auto&& status : statuses) {
+                const auto found =
+                    find(tx, tables, contract, status, max - digests.size(), out.truncated);
+                digests.insert(digests.end(), found.begin(), found.end());
+            }
+        }
+
+        out.results = results(tx, tables, digests);
+        return out;
+    }
+
+ private:
+    template <typename TX>
+    static std::vector<evm4ccf::MPT_BULK::Result> results(
+        TX& tx, TransactionTables& tables, const std::vector<evm4ccf::h256>& digests) {
+        CloakPolicyStoreT<TX> policies(tx, tables);
+        std::vector<evm4ccf::MPT_BULK::Result> res;
+        for (auto&& digest : digests) {
+            const auto status = policies.get_status(digest);
+            if (status.has_value()) {
+                res.push_back(
+                    {eevm::to_hex_string(digest),
+                     status.value(),
+                     eevm::to_hex_string(policies.get_payload(digest)->function.raw_outputs)});
+            }
+        }
+        return res;
+    }
+
+    static void append(evm4ccf::MptsByAddress::TxView* list,
+                       evm4ccf::MptsByAddressSize::TxView* list_size,
+                       const eevm::Address& addr,
+                       const evm4ccf::h256& digest) {
+        const auto n = list_size->get(addr).value_or(0);
+        list->put({addr, n}, digest);
+        list_size->put(addr, n + 1);
+    }
+
+    void remove(const uint256_t& b, const evm4ccf::h256& digest) {
+        const auto pos = position->get(digest);
+        const auto n = size->get(b).value_or(0);
+        if (!pos.has_value() || n == 0) {
+            // written before the index existed
+            return;
+        }
+
+        const auto last = index->get({b, n - 1}).value();
+        index->put({b, pos.value()}, last);
+        position->put(last, pos.value());
+        index->remove({b, n - 1});
+        size->put(b, n - 1);
+        position->remove(digest);
+    }
+
+    evm4ccf::MptIndex::TxView* index;
+    evm4ccf::MptIndexSize::TxView* size;
+    evm4ccf::MptIndexPosition::TxView* position;
+};
+
+} // namespace Transaction
+} // namespace cloak4ccf
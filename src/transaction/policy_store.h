@@ -0,0 +1,127 @@
+// Copyright (c) 2020 Oxford-Hainan Blockchain Research Institute
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#include "tables.h"
+
+#include <kv/tx.h>
+#include <optional>
+#include <type_traits>
+
+namespace cloak4ccf {
+namespace Transaction {
+
+// Stores a CloakPolicyTransaction as three records: the descriptor, written
+// once; the status, a few bytes rewritten on every transition; and the
+// payload with the function inputs, outputs and states, rewritten only when
+// CloakPolicyTransaction::payload_changed says so. Status-only updates such as
+// sync reports leave the other two untouched.
+//
+// Transactions stored whole in eth.transaction.cloak_policys before the split
+// are read from there, and move to the three tables on their next write.
+template <typename TX>
+class CloakPolicyStoreT {
+ public:
+    CloakPolicyStoreT(TX& tx_, TransactionTables& tables_) : tx(tx_), tables(tables_) {}
+
+    std::optional<evm4ccf::CloakPolicyTransaction> get(const evm4ccf::h256& digest) {
+        const auto d = get_descriptor(digest);
+        if (!d.has_value()) {
+            return std::nullopt;
+        }
+        return evm4ccf::CloakPolicyTransaction(
+            d.value(), get_payload(digest).value(), get_status(digest).value());
+    }
+
+    std::optional<evm4ccf::Status> get_status(const evm4ccf::h256& digest) {
+        auto status = view(tables.cloak_policy_statuses)->get(digest);
+        if (status.has_value()) {
+            return status;
+        }
+        const auto legacy = get_legacy(digest);
+        return legacy.has_value() ? std::make_optional(legacy->status) : std::nullopt;
+    }
+
+    std::optional<evm4ccf::CloakPolicyDescriptor> get_descriptor(const evm4ccf::h256& digest) {
+        auto descriptor = view(tables.cloak_policy_descriptors)->get(digest);
+        if (descriptor.has_value()) {
+            return descriptor;
+        }
+        const auto legacy = get_legacy(digest);
+        return legacy.has_value() ? std::make_optional(legacy->descriptor()) : std::nullopt;
+    }
+
+    std::optional<evm4ccf::CloakPolicyPayload> get_payload(const evm4ccf::h256& digest) {
+        auto payload = view(tables.cloak_policy_payloads)->get(digest);
+        if (payload.has_value()) {
+            return payload;
+        }
+        const auto legacy = get_legacy(digest);
+        return legacy.has_value() ? std::make_optional(legacy->payload()) : std::nullopt;
+    }
+
+    void create(const evm4ccf::h256& digest, const evm4ccf::CloakPolicyTransaction& cpt) {
+        view(tables.cloak_policy_descriptors)->put(digest, cpt.descriptor());
+        view(tables.cloak_policy_payloads)->put(digest, cpt.payload());
+        view(tables.cloak_policy_statuses)->put(digest, cpt.get_status());
+    }
+
+    void update(const evm4ccf::h256& digest, const evm4ccf::CloakPolicyTransaction& cpt) {
+        if (!view(tables.cloak_policy_descriptors)->get(digest).has_value()) {
+            create(digest, cpt);
+            view(tables.cloak_policys)->remove(digest);
+            return;
+        }
+
+        if (cpt.payload_changed()) {
+            view(tables.cloak_policy_payloads)->put(digest, cpt.payload());
+        }
+        set_status(digest, cpt.get_status());
+    }
+
+    void set_status(const evm4ccf::h256& digest, evm4ccf::Status status) {
+        if (!view(tables.cloak_policy_descriptors)->get(digest).has_value()) {
+            auto cpt = get(digest);
+            if (cpt.has_value()) {
+                cpt->set_status(status);
+                update(digest, cpt.value());
+                return;
+            }
+        }
+        view(tables.cloak_policy_statuses)->put(digest, status);
+    }
+
+ private:
+    template <typename M>
+    auto view(M& map) {
+        if constexpr (std::is_same_v<TX, kv::ReadOnlyTx>) {
+            return tx.get_read_only_view(map);
+        } else {
+            return tx.get_view(map);
+        }
+    }
+
+    std::optional<evm4ccf::LegacyCloakPolicyTransaction> get_legacy(const evm4ccf::h256& digest) {
+        return view(tables.cloak_policys)->get(digest);
+    }
+
+    TX& tx;
+    TransactionTables& tables;
+};
+
+using CloakPolicyStore = CloakPolicyStoreT<kv::Tx>;
+using ReadOnlyCloakPolicyStore = CloakPolicyStoreT<kv::ReadOnlyTx>;
+
+} // namespace Transaction
+} // namespace cloak4ccf
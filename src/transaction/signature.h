@@ -15,6 +15,7 @@
 #pragma once
 
 #include "app/utils.h"
+#include "ethereum/rlp_view.h"
 #include "ethereum/tables.h"
 #include "ethereum_transaction.h"
 #include "kv/map.h"
@@ -43,14 +44,8 @@ struct PrivacyTransaction {
     }
 
     explicit PrivacyTransaction(const eevm::rlp::ByteString& encoded) {
-        auto tup = eevm::rlp::decode<eevm::rlp::ByteString,
-                                     eevm::rlp::ByteString,
-                                     eevm::rlp::ByteString,
-                                     eevm::rlp::ByteString>(encoded);
-        to = std::get<0>(tup);
-        verifierAddr = std::get<1>(tup);
-        codeHash = std::get<2>(tup);
-        data = std::get<3>(tup);
+        const auto items = Ethereum::rlp::decode_list(encoded, 4);
+        from_items(items);
     }
 
     eevm::rlp::ByteString encode() const {
@@ -58,34 +53,32 @@ struct PrivacyTransaction {
     }
 
     virtual eevm::KeccakHash to_be_signed() const {
-        return eevm::keccak_256(encode());
+        return Ethereum::rlp::keccak_list({to, verifierAddr, codeHash, data});
     }
 
     void to_transaction(PrivacyPolicyTransaction& tc) const {
         tc.to = eevm::from_big_endian(to.data(), 20u);
         tc.verifierAddr = eevm::from_big_endian(verifierAddr.data(), 20u);
         tc.codeHash = eevm::to_hex_string(codeHash);
-        tc.policy = Utils::parse<Policy>(eevm::to_hex_string(data));
+        tc.policy = Utils::parse<Policy>(data);
+    }
+
+ protected:
+    void from_items(const std::vector<Ethereum::rlp::Slice>& items) {
+        to = items[0].to_bytes();
+        verifierAddr = items[1].to_bytes();
+        codeHash = items[2].to_bytes();
+        data = items[3].to_bytes();
     }
 };
 
 struct PrivacyTransactionWithSignature : public SignatureAbstract, public PrivacyTransaction {
     explicit PrivacyTransactionWithSignature(const eevm::rlp::ByteString& encoded) {
-        auto tup = eevm::rlp::decode<eevm::rlp::ByteString,
-                                     eevm::rlp::ByteString,
-                                     eevm::rlp::ByteString,
-                                     eevm::rlp::ByteString,
-                                     uint8_t,
-                                     PointCoord,
-                                     PointCoord>(encoded);
-
-        to = std::get<0>(tup);
-        verifierAddr = std::get<1>(tup);
-        codeHash = std::get<2>(tup);
-        data = std::get<3>(tup);
-        v = std::get<4>(tup);
-        r = std::get<5>(tup);
-        s = std::get<6>(tup);
+        const auto items = Ethereum::rlp::decode_list(encoded, 7);
+        from_items(items);
+        v = items[4].to_uint<uint8_t>();
+        r = items[5].to_uint<PointCoord>();
+        s = items[6].to_uint<PointCoord>();
     }
 
     PrivacyTransactionWithSignature(const PrivacyTransaction& tx,
@@ -101,8 +94,8 @@ struct PrivacyTransactionWithSignature : public SignatureAbstract, public Privac
         if (is_pre_eip_155(v))
             return PrivacyTransaction::to_be_signed();
 
-        return eevm::keccak_256(
-            eevm::rlp::encode(to, verifierAddr, codeHash, data, current_chain_id, 0, 0));
+        return Ethereum::rlp::keccak_list(
+            {to, verifierAddr, codeHash, data, current_chain_id, 0, 0});
     }
 
     eevm::KeccakHash calc_policy_hash() const {
@@ -134,10 +127,7 @@ struct CloakTransaction {
     eevm::rlp::ByteString data;
 
     explicit CloakTransaction(const eevm::rlp::ByteString& encoded) {
-        auto tup = eevm::rlp::decode<size_t, eevm::rlp::ByteString, eevm::rlp::ByteString>(encoded);
-        nonce = std::get<0>(tup);
-        to = std::get<1>(tup);
-        data = std::get<2>(tup);
+        from_items(Ethereum::rlp::decode_list(encoded, 3));
     }
 
     eevm::rlp::ByteString encode() const {
@@ -145,31 +135,30 @@ struct CloakTransaction {
     }
 
     virtual eevm::KeccakHash to_be_signed() const {
-        return eevm::keccak_256(encode());
+        return Ethereum::rlp::keccak_list({nonce, to, data});
     }
 
     virtual void to_transaction_call(MultiPartyTransaction& mpt) const {
         mpt.to = to;
         mpt.nonce = nonce;
-        mpt.params = Utils::parse<policy::MultiPartyParams>(eevm::to_hex_string(data));
+        mpt.params = Utils::parse<policy::MultiPartyParams>(data);
+    }
+
+ protected:
+    void from_items(const std::vector<Ethereum::rlp::Slice>& items) {
+        nonce = items[0].to_uint<size_t>();
+        to = items[1].to_bytes();
+        data = items[2].to_bytes();
     }
 };
 
 struct CloakTransactionWithSignature : public SignatureAbstract, public CloakTransaction {
     explicit CloakTransactionWithSignature(const eevm::rlp::ByteString& encoded) {
-        auto tup = eevm::rlp::decode<size_t,
-                                     eevm::rlp::ByteString,
-                                     eevm::rlp::ByteString,
-                                     uint8_t,
-                                     PointCoord,
-                                     PointCoord>(encoded);
-
-        nonce = std::get<0>(tup);
-        to = std::get<1>(tup);
-        data = std::get<2>(tup);
-        v = std::get<3>(tup);
-        r = std::get<4>(tup);
-        s = std::get<5>(tup);
+        const auto items = Ethereum::rlp::decode_list(encoded, 6);
+        from_items(items);
+        v = items[3].to_uint<uint8_t>();
+        r = items[4].to_uint<PointCoord>();
+        s = items[5].to_uint<PointCoord>();
     }
 
     CloakTransactionWithSignature(const CloakTransaction& tx,
@@ -182,7 +171,7 @@ struct CloakTransactionWithSignature : public SignatureAbstract, public CloakTra
     }
 
     eevm::KeccakHash digest() const {
-        return eevm::keccak_256(encode());
+        return Ethereum::rlp::keccak_list({nonce, to, data, v, r, s});
     }
 
     eevm::KeccakHash to_be_signed() const override {
@@ -190,7 +179,7 @@ struct CloakTransactionWithSignature : public SignatureAbstract, public CloakTra
             return CloakTransaction::to_be_signed();
         }
 
-        return eevm::keccak_256(eevm::rlp::encode(nonce, to, data, current_chain_id, 0, 0));
+        return Ethereum::rlp::keccak_list({nonce, to, data, current_chain_id, 0, 0});
     }
 
     void to_transaction_call(MultiPartyTransaction& mpt) const override {
@@ -0,0 +1,178 @@
+// Copyright (c) 2020 Oxford-Hainan Blockchain Research Institute
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#include "app/utils.h"
+#include "tables.h"
+
+#include <algorithm>
+#include <kv/tx.h>
+#include <set>
+#include <string>
+
+namespace cloak4ccf {
+namespace Transaction {
+
+// Log of multi party transaction status changes, so that a client waiting on
+// many transactions reads the changes after one cursor rather than polling
+// every transaction. CCF answers every request within its transaction and
+// cannot park it until a change commits, so watchers poll the cursor; a
+// single poll returns all their changes since the last one.
+//
+// Changes are sharded by transaction id so that concurrent appends do not
+// all write one counter. A cursor holds a position per shard and watch
+// merges the shards: the changes of one transaction keep their order, but
+// there is none across transactions, which only the agent queue needs.
+//
+// Only the newest max_entries changes are kept. Watchers whose cursor falls
+// before them are told so and should re-read the transactions they watch.
+class StatusLog {
+ public:
+    static constexpr uint64_t shards = 10;
+    static constexpr uint64_t max_entries = 1 << 16;
+    static constexpr uint64_t max_scanned = 4096;
+    // legacy changes dropped per append, see drop_legacy
+    static constexpr uint64_t max_dropped = 2;
+
+    StatusLog(kv::Tx& tx, TransactionTables& tables) :
+        log(tx.get_view(tables.status_log)), cursors(tx.get_view(tables.status_log_cursors)) {}
+
+    void append(const evm4ccf::h256& id, evm4ccf::Status status) {
+        const auto s = shard(id);
+        const auto base = get_base();
+        const auto n = cursors->get(shard_key(LAST, s)).value_or(0) + 1;
+        log->put(position(base, n, s), {id, status});
+        cursors->put(shard_key(LAST, s), n);
+
+        auto first = cursors->get(shard_key(FIRST, s)).value_or(1);
+        for (; n - first >= per_shard; first++) {
+            log->remove(position(base, first, s));
+        }
+        cursors->put(shard_key(FIRST, s), first);
+        drop_legacy(s, base);
+    }
+
+    template <typename TX>
+    static evm4ccf::MPT_WATCH::Out watch(TX& tx,
+                                         TransactionTables& tables,
+                                         const evm4ccf::MPT_WATCH::In& in) {
+        auto log = tx.get_read_only_view(tables.status_log);
+        auto cursors = tx.get_read_only_view(tables.status_log_cursors);
+        auto since = in.since;
+        if (since.empty()) {
+            since.resize(shards, 0);
+        }
+        if (since.size() != shards) {
+            throw std::logic_error(fmt::format(
+                "Cursor has {} positions, the status log has {} shards", since.size(), shards));
+        }
+        const auto base = cursors->get(BASE).value_or(cursors->get(LAST).value_or(0));
+
+        std::set<evm4ccf::h256> ids;
+        for (auto&& id : in.ids) {
+            ids.insert(Utils::to_KeccakHash(id));
+        }
+
+        evm4ccf::MPT_WATCH::Out out;
+        out.next.resize(shards);
+        for (uint64_t s = 0; s < shards; s++) {
+            const auto first = cursors->get(shard_key(FIRST, s)).value_or(1);
+            const auto last = cursors->get(shard_key(LAST, s)).value_or(0);
+            if (since[s] > last) {
+                throw std::logic_error(fmt::format(
+                    "Cursor {} is ahead of shard {} of the status log ({})", since[s], s, last));
+            }
+
+            auto n = since[s] + 1;
+            if (n < first) {
+                out.truncated = true;
+                n = first;
+            }
+            const auto end = std::min(last, n + max_scanned / shards - 1);
+            for (; n <= end; n++) {
+                const auto seq = position(base, n, s);
+                const auto change = log->get(seq).value();
+                if (ids.empty() || ids.count(change.id) > 0) {
+                    out.changes.push_back({seq, eevm::to_hex_string(change.id), change.status});
+                }
+            }
+            out.next[s] = std::max(end, since[s]);
+        }
+        return out;
+    }
+
+ private:
+    static constexpr auto FIRST = "first";
+    static constexpr auto LAST = "last";
+    static constexpr auto BASE = "base";
+    static constexpr auto LEGACY = "legacy";
+    static constexpr uint64_t per_shard = (max_entries + shards - 1) / shards;
+
+    evm4ccf::StatusLog::TxView* log;
+    evm4ccf::StatusLogCursors::TxView* cursors;
+
+    static uint64_t shard(const evm4ccf::h256& id) {
+        return static_cast<uint64_t>(eevm::from_big_endian(id.data(), id.size()) % shards);
+    }
+
+    static std::string shard_key(const char* field, uint64_t shard) {
+        return fmt::format("{}.{}", field, shard);
+    }
+
+    // The n-th change of a shard, counted from 1
+    static uint64_t position(uint64_t base, uint64_t n, uint64_t shard) {
+        return base + n * shards + shard;
+    }
+
+    // Changes appended before the log was sharded hold the single sequence
+    // up to its "last" cursor. Shards start after it, so the first sharded
+    // append records it as the base once.
+    uint64_t get_base() {
+        const auto base = cursors->get(BASE);
+        if (base.has_value()) {
+            return base.value();
+        }
+        const auto legacy_last = cursors->get(LAST);
+        if (!legacy_last.has_value()) {
+            return 0;
+        }
+        cursors->put(BASE, legacy_last.value());
+        return legacy_last.value();
+    }
+
+    // Watchers no longer read the legacy changes. Each shard drops the few
+    // whose seq falls in it, so none of them writes a shared cursor.
+    void drop_legacy(uint64_t s, uint64_t base) {
+        if (base == 0) {
+            return;
+        }
+        const auto key = shard_key(LEGACY, s);
+        const auto dropped = cursors->get(key);
+        auto seq = dropped.value_or(0);
+        if (!dropped.has_value()) {
+            const auto first = cursors->get(FIRST).value_or(1);
+            seq = first + (s + shards - first % shards) % shards;
+        }
+        const auto start = seq;
+        for (uint64_t n = 0; seq <= base && n < max_dropped; n++, seq += shards) {
+            log->remove(seq);
+        }
+        if (seq != start || !dropped.has_value()) {
+            cursors->put(key, seq);
+        }
+    }
+};
+
+} // namespace Transaction
+} // namespace cloak4ccf
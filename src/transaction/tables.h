@@ -28,10 +28,22 @@ namespace transaction {
 struct Tables {
     static constexpr auto PRIVACYS = "eth.transaction.privacys";
     static constexpr auto PRIVACY_DIGESTS = "eth.transaction.privacy_digests";
-    static constexpr auto CLOAKPOLICYS = "eth.transaction.cloak_policys";
+    static constexpr auto CLOAK_POLICY_DESCRIPTORS = "eth.transaction.cloak_policy_descriptors";
+    static constexpr auto CLOAK_POLICY_STATUSES = "eth.transaction.cloak_policy_statuses";
+    static constexpr auto CLOAK_POLICY_PAYLOADS = "eth.transaction.cloak_policy_payloads";
+    static constexpr auto CLOAK_POLICYS = "eth.transaction.cloak_policys";
     static constexpr auto CLOAK_DIGESTS = "eth.transaction.cloak_digests";
     static constexpr auto MULTI_PARTYS = "eth.transaction.multi_partys";
     static constexpr auto STATES_DIGEST = "eth.transaction.states_digest";
+    static constexpr auto STATUS_LOG = "eth.transaction.status_log";
+    static constexpr auto STATUS_LOG_CURSORS = "eth.transaction.status_log.cursors";
+    static constexpr auto MPT_INDEX = "eth.transaction.mpt_index";
+    static constexpr auto MPT_INDEX_SIZE = "eth.transaction.mpt_index.size";
+    static constexpr auto MPT_INDEX_POSITION = "eth.transaction.mpt_index.position";
+    static constexpr auto MPTS_BY_CONTRACT = "eth.transaction.by_contract";
+    static constexpr auto MPTS_BY_CONTRACT_SIZE = "eth.transaction.by_contract.size";
+    static constexpr auto MPTS_BY_SENDER = "eth.transaction.by_sender";
+    static constexpr auto MPTS_BY_SENDER_SIZE = "eth.transaction.by_sender.size";
 };
 
 } // namespace transaction
@@ -45,17 +57,41 @@ struct TransactionTables {
     evm4ccf::Privacys privacys;
     evm4ccf::PrivacyDigests privacy_digests;
 
-    evm4ccf::CloakPolicys cloak_policys;
+    evm4ccf::CloakPolicyDescriptors cloak_policy_descriptors;
+    evm4ccf::CloakPolicyStatuses cloak_policy_statuses;
+    evm4ccf::CloakPolicyPayloads cloak_policy_payloads;
+    evm4ccf::LegacyCloakPolicys cloak_policys;
     evm4ccf::CloakDigests cloak_digests;
     evm4ccf::MultiPartys multi_partys;
     evm4ccf::StatesDigests states_digests;
+    evm4ccf::StatusLog status_log;
+    evm4ccf::StatusLogCursors status_log_cursors;
+    evm4ccf::MptIndex mpt_index;
+    evm4ccf::MptIndexSize mpt_index_size;
+    evm4ccf::MptIndexPosition mpt_index_position;
+    evm4ccf::MptsByAddress mpts_by_contract;
+    evm4ccf::MptsByAddressSize mpts_by_contract_size;
+    evm4ccf::MptsByAddress mpts_by_sender;
+    evm4ccf::MptsByAddressSize mpts_by_sender_size;
     TransactionTables() :
         privacys(transaction::Tables::PRIVACYS),
         privacy_digests(transaction::Tables::PRIVACY_DIGESTS),
-        cloak_policys(transaction::Tables::CLOAKPOLICYS),
+        cloak_policy_descriptors(transaction::Tables::CLOAK_POLICY_DESCRIPTORS),
+        cloak_policy_statuses(transaction::Tables::CLOAK_POLICY_STATUSES),
+        cloak_policy_payloads(transaction::Tables::CLOAK_POLICY_PAYLOADS),
+        cloak_policys(transaction::Tables::CLOAK_POLICYS),
         cloak_digests(transaction::Tables::CLOAK_DIGESTS),
         multi_partys(transaction::Tables::MULTI_PARTYS),
-        states_digests(transaction::Tables::STATES_DIGEST) {}
+        states_digests(transaction::Tables::STATES_DIGEST),
+        status_log(transaction::Tables::STATUS_LOG),
+        status_log_cursors(transaction::Tables::STATUS_LOG_CURSORS),
+        mpt_index(transaction::Tables::MPT_INDEX),
+        mpt_index_size(transaction::Tables::MPT_INDEX_SIZE),
+        mpt_index_position(transaction::Tables::MPT_INDEX_POSITION),
+        mpts_by_contract(transaction::Tables::MPTS_BY_CONTRACT),
+        mpts_by_contract_size(transaction::Tables::MPTS_BY_CONTRACT_SIZE),
+        mpts_by_sender(transaction::Tables::MPTS_BY_SENDER),
+        mpts_by_sender_size(transaction::Tables::MPTS_BY_SENDER_SIZE) {}
 };
 
 } // namespace cloak4ccf
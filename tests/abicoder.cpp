@@ -200,6 +200,22 @@ TEST_CASE("Test dynamic array") {
     }
 }
 
+TEST_CASE("Test bytes array") {
+    vector<string> hex = {"0x01", "0x68656c6c6f2c20776f726c6421"};
+    BytesList raw;
+    for (auto&& h : hex) {
+        raw.push_back(eevm::to_bytes(h));
+    }
+
+    // same encoding as a bytes[] built from hex values
+    auto correct = Encoder::encode("bytes[]", hex, make_bytes_array());
+    Encoder encoder;
+    encoder.add_bytes_array("", raw);
+    CHECK(encoder.encode() == correct);
+
+    CHECK(Decoder::decode_bytes_array(correct) == raw);
+}
+
 TEST_CASE("Test static array") {
     auto one = {"0xde0B295669a9FD93d5F28D9Ec85E40f4cb697BAe"};
     SUBCASE("One-dimensional") {
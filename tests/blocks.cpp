@@ -0,0 +1,122 @@
+// Copyright (c) 2020 Oxford-Hainan Blockchain Research Institute
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "ethereum/blocks.h"
+
+#include <doctest/doctest.h>
+#include <set>
+
+using namespace Ethereum;
+
+// Records every transaction in its own KV transaction, as the endpoints do
+static TxLocation add(kv::Store& store, tables::BlocksState& bs, const TxHash& hash) {
+    auto tx = store.create_tx();
+    const auto loc = BlockProducer(tx, bs).add(hash);
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+    return loc;
+}
+
+TEST_CASE("Blocks are sealed once a shard is full") {
+    kv::Store store;
+    tables::BlocksState bs;
+    constexpr auto per_shard = BlockProducer::max_txs / BlockProducer::shards;
+
+    // hashes 1, 11, 21... all fall in shard 1
+    std::set<uint64_t> indexes;
+    for (uint64_t i = 0; i < per_shard; i++) {
+        const auto loc = add(store, bs, 1 + i * BlockProducer::shards);
+        CHECK(loc.first == 0);
+        CHECK(indexes.insert(loc.second).second);
+    }
+    const auto other = add(store, bs, 2);
+    CHECK(other.first == 0);
+    CHECK(indexes.insert(other.second).second);
+
+    {
+        auto tx = store.create_tx();
+        CHECK(!BlockProducer::header(tx, bs, 0).has_value());
+        CHECK(BlockProducer::open_number(tx, bs) == 0);
+    }
+
+    // the shard filled up, so the next transaction seals block 0
+    const auto next = add(store, bs, 3);
+    CHECK(next.first == 1);
+    CHECK(next.second == 3);
+
+    auto tx = store.create_tx();
+    CHECK(BlockProducer::open_number(tx, bs) == 1);
+    const auto h0 = BlockProducer::header(tx, bs, 0);
+    REQUIRE(h0.has_value());
+    CHECK(h0->number == 0);
+    CHECK(h0->block_hash != 0);
+    CHECK(!BlockProducer::header(tx, bs, 1).has_value());
+
+    const auto loc = BlockProducer::locate(tx, bs, 2);
+    REQUIRE(loc.has_value());
+    CHECK(*loc == other);
+    CHECK(BlockProducer::locate(tx, bs, 3) == next);
+    CHECK(!BlockProducer::locate(tx, bs, 4).has_value());
+
+    // the shards are reset for the new block
+    CHECK(!tx.get_view(bs.pending)->get(BlockProducer::FULL).has_value());
+    CHECK(add(store, bs, 1).second == 1);
+}
+
+TEST_CASE("Block hashes cover the transactions") {
+    auto seal_one = [](const std::vector<TxHash>& hashes) {
+        kv::Store store;
+        tables::BlocksState bs;
+        for (auto&& h : hashes) {
+            add(store, bs, h);
+        }
+        auto tx = store.create_tx();
+        tx.get_view(bs.pending)->put(BlockProducer::FULL, 1);
+        BlockProducer(tx, bs).current();
+        return BlockProducer::header(tx, bs, 0).value().block_hash;
+    };
+
+    CHECK(seal_one({1, 2}) == seal_one({1, 2}));
+    CHECK(seal_one({1, 2}) != seal_one({1, 12}));
+    CHECK(seal_one({1, 2}) != seal_one({1}));
+}
+
+TEST_CASE("Open blocks recorded with a single count keep their indexes") {
+    kv::Store store;
+    tables::BlocksState bs;
+    {
+        auto tx = store.create_tx();
+        auto pending = tx.get_view(bs.pending);
+        pending->put(BlockProducer::TX_COUNT, 3);
+        pending->put(BlockProducer::TX_ROOT, 0xabc);
+        tx.get_view(bs.versions)->put(0, 0);
+        REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+    }
+
+    CHECK(add(store, bs, 10) == TxLocation{0, 3});
+    CHECK(add(store, bs, 21) == TxLocation{0, 4});
+
+    auto tx = store.create_tx();
+    tx.get_view(bs.pending)->put(BlockProducer::FULL, 1);
+    CHECK(BlockProducer(tx, bs).current().number == 1);
+    CHECK(!tx.get_view(bs.pending)->get(BlockProducer::TX_COUNT).has_value());
+}
+
+TEST_CASE("Block ids resolve against the open block") {
+    CHECK(!BlockProducer::resolve("latest", 5).has_value());
+    CHECK(!BlockProducer::resolve("pending", 5).has_value());
+    CHECK(BlockProducer::resolve("earliest", 5) == 0);
+    CHECK(BlockProducer::resolve("0x3", 5) == 3);
+    CHECK(!BlockProducer::resolve("0x5", 5).has_value());
+    CHECK_THROWS(BlockProducer::resolve("0x6", 5));
+}
@@ -0,0 +1,89 @@
+// Copyright (c) 2020 Oxford-Hainan Blockchain Research Institute
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "ethereum/code.h"
+
+#include <doctest/doctest.h>
+
+using namespace Ethereum;
+
+TEST_CASE("The code cache drops the least recently used entry") {
+    CodeCache cache(2);
+    const auto one = cache.insert(1, {0x01});
+    cache.insert(2, {0x02});
+    CHECK(cache.insert(1, {0xff}) == one);
+
+    // 2 is the least recently used, so it goes although nothing else holds
+    // it, while 1 stays
+    CHECK(cache.find(1) == one);
+    cache.insert(3, {0x03});
+    CHECK(cache.size() == 2);
+    CHECK(cache.find(2) == nullptr);
+    CHECK(cache.find(1) == one);
+
+    // entries still held outlive their eviction
+    cache.insert(4, {0x04});
+    cache.insert(5, {0x05});
+    CHECK(cache.find(1) == nullptr);
+    CHECK(*one == eevm::Code{0x01});
+}
+
+TEST_CASE("Code is stored once per hash") {
+    kv::Store store;
+    tables::AccountsState as;
+    const eevm::Code code = {0x60, 0x00, 0x60, 0x00, 0xf3};
+    const eevm::Address a = 0xa, b = 0xb;
+
+    auto tx = store.create_tx();
+    const auto views = as.accounts.get_views(tx);
+    CodeStore::put(views, a, code);
+    CodeStore::put(views, b, code);
+
+    const auto h = CodeStore::hash(code);
+    CHECK(views.code_hashes->get(a) == h);
+    CHECK(views.code_hashes->get(b) == h);
+    size_t contents = 0;
+    views.code_contents->foreach([&](const uint256_t&, const eevm::Code&) {
+        contents++;
+        return true;
+    });
+    CHECK(contents == 1);
+    CHECK(CodeStore::get(views, a) == CodeStore::get(views, b));
+    CHECK(*CodeStore::get(views, a) == code);
+}
+
+TEST_CASE("Code written per address is read until it is written again") {
+    kv::Store store;
+    tables::AccountsState as;
+    const eevm::Address legacy = 0x1e6, fresh = 0xf4e5;
+    {
+        auto tx = store.create_tx();
+        tx.get_view(as.accounts.codes)->put(legacy, {0x01});
+        REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+    }
+
+    auto tx = store.create_tx();
+    const auto views = as.accounts.get_views(tx);
+    CHECK(CodeStore::exists(views, legacy));
+    CHECK(*CodeStore::get(views, legacy) == eevm::Code{0x01});
+    CHECK(!CodeStore::exists(views, fresh));
+    CHECK(CodeStore::get(views, fresh) == nullptr);
+
+    CodeStore::put(views, legacy, {0x02});
+    CodeStore::put(views, fresh, {0x03});
+    CHECK(!views.codes->get(legacy).has_value());
+    CHECK(*CodeStore::get(views, legacy) == eevm::Code{0x02});
+    CHECK(*CodeStore::get(views, fresh) == eevm::Code{0x03});
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+}
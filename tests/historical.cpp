@@ -0,0 +1,155 @@
+// Copyright (c) 2020 Oxford-Hainan Blockchain Research Institute
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "ethereum/blocks.h"
+#include "ethereum/historical.h"
+
+#include <doctest/doctest.h>
+#include <map>
+
+using namespace Ethereum;
+using tables::AccountField;
+
+// Historical stores by version, each holding the writes of one transaction
+class TestStateCache : public ccf::historical::AbstractStateCache {
+ public:
+    std::map<consensus::Index, ccf::historical::StorePtr> stores;
+
+    ccf::historical::StorePtr get_store_at(consensus::Index idx) override {
+        const auto it = stores.find(idx);
+        return it != stores.end() ? it->second : nullptr;
+    }
+
+    bool drop_request(consensus::Index) override {
+        return true;
+    }
+};
+
+struct Ledger {
+    kv::Store live;
+    tables::AccountsState acc;
+    tables::BlocksState bs;
+    TestStateCache cache;
+
+    // Block b holds the single transaction at version b + 1, so its versions
+    // are (b, b + 1]
+    template <typename F>
+    void add_block(uint64_t b, const tables::AccountWrites& writes, F&& write) {
+        auto store = std::make_shared<kv::Store>();
+        auto hist_tx = store->create_tx();
+        write(acc.accounts.get_views(hist_tx));
+        REQUIRE(hist_tx.commit() == kv::CommitSuccess::OK);
+        cache.stores[b + 1] = store;
+
+        auto tx = live.create_tx();
+        tx.get_view(bs.pending)->put(BlockProducer::NUMBER, b);
+        tx.get_view(bs.versions)->put(b, b);
+        tx.get_view(bs.versions)->put(b + 1, b + 1);
+        BlockProducer(tx, bs).touch(writes);
+        REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+    }
+};
+
+TEST_CASE("Historical reads use the index of the field") {
+    Ledger l;
+    const eevm::Address contract = 0xc0de;
+    const eevm::Address eoa = 0xe0a;
+    const uint256_t code_hash = 0x1234;
+
+    l.add_block(0,
+                {{contract, eoa}, {contract, eoa}, {contract}},
+                [&](const tables::Accounts::Views& v) {
+                    v.balances->put(contract, 0);
+                    v.nonces->put(contract, 1);
+                    v.code_hashes->put(contract, code_hash);
+                    v.balances->put(eoa, 100);
+                    v.nonces->put(eoa, 0);
+                });
+    // the contract's balance and the account's nonce change in every block
+    // after, more blocks than a bounded scan of all writes would look at
+    for (uint64_t b = 1; b <= 8; b++) {
+        l.add_block(b, {{contract}, {eoa}, {}}, [&](const tables::Accounts::Views& v) {
+            v.balances->put(contract, b);
+            v.nonces->put(eoa, b);
+        });
+    }
+
+    HistoricalState hs(l.cache, l.bs);
+    auto tx = l.live.create_tx();
+    auto& accounts = l.acc.accounts;
+
+    const auto code =
+        hs.get<uint256_t>(tx, accounts.code_hashes, AccountField::CODE, contract, 8);
+    REQUIRE(code.has_value());
+    CHECK(code->value() == code_hash);
+
+    const auto no_code = hs.get<uint256_t>(tx, accounts.code_hashes, AccountField::CODE, eoa, 8);
+    REQUIRE(no_code.has_value());
+    CHECK(!no_code->has_value());
+
+    const auto balance = hs.get<uint256_t>(tx, accounts.balances, AccountField::BALANCE, eoa, 8);
+    REQUIRE(balance.has_value());
+    CHECK(balance->value() == 100);
+
+    const auto past =
+        hs.get<uint256_t>(tx, accounts.balances, AccountField::BALANCE, contract, 3);
+    REQUIRE(past.has_value());
+    CHECK(past->value() == 3);
+
+    const auto nonce = hs.get<eevm::Account::Nonce>(
+        tx, accounts.nonces, AccountField::NONCE, eoa, 5);
+    REQUIRE(nonce.has_value());
+    CHECK(nonce->value() == 5);
+
+    // missing stores are reported as still fetching
+    l.cache.stores.erase(1);
+    CHECK(!hs.get<uint256_t>(tx, accounts.code_hashes, AccountField::CODE, contract, 8)
+               .has_value());
+}
+
+TEST_CASE("Historical reads fall back to the index of all fields") {
+    Ledger l;
+    const eevm::Address eoa = 0xe0a;
+
+    l.add_block(0, {}, [&](const tables::Accounts::Views& v) {
+        v.balances->put(eoa, 100);
+        v.nonces->put(eoa, 0);
+    });
+    for (uint64_t b = 1; b <= 8; b++) {
+        l.add_block(b, {}, [&](const tables::Accounts::Views& v) { v.nonces->put(eoa, b); });
+    }
+
+    // blocks recorded before the index was kept per field
+    {
+        auto tx = l.live.create_tx();
+        auto blocks = tx.get_view(l.bs.account_blocks.blocks);
+        for (uint64_t b = 0; b <= 8; b++) {
+            blocks->put({eoa, b}, b);
+        }
+        tx.get_view(l.bs.account_blocks.size)->put(eoa, 9);
+        REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+    }
+
+    HistoricalState hs(l.cache, l.bs);
+    auto tx = l.live.create_tx();
+    const auto balance =
+        hs.get<uint256_t>(tx, l.acc.accounts.balances, AccountField::BALANCE, eoa, 8);
+    REQUIRE(balance.has_value());
+    CHECK(balance->value() == 100);
+
+    const auto code =
+        hs.get<uint256_t>(tx, l.acc.accounts.code_hashes, AccountField::CODE, eoa, 8);
+    REQUIRE(code.has_value());
+    CHECK(!code->has_value());
+}
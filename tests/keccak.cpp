@@ -0,0 +1,82 @@
+// Copyright (c) 2020 Oxford-Hainan Blockchain Research Institute
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "ethereum/keccak.h"
+#include "ethereum/rlp_view.h"
+
+#include <chrono>
+#include <doctest/doctest.h>
+#include <eEVM/rlp.h>
+#include <string>
+#include <vector>
+
+using namespace Ethereum;
+
+TEST_CASE("Test incremental keccak") {
+    const std::vector<uint8_t> policy(10000, 0x5a);
+
+    Keccak256 k;
+    k.update(policy.data(), 3);
+    k.update(policy.data() + 3, policy.size() - 3);
+    CHECK(k.final() == eevm::keccak_256(policy));
+
+    const std::string signature = "transfer(address,uint256)";
+    Keccak256 s;
+    s.update("transfer(");
+    s.update("address,uint256)");
+    CHECK(s.final() == eevm::keccak_256(signature));
+
+    uint8_t words[64] = {};
+    eevm::to_big_endian(uint256_t(1), words);
+    eevm::to_big_endian(uint256_t(2), words + 32);
+    Keccak256 w;
+    w.update_word(1);
+    w.update_word(2);
+    CHECK(w.final() == eevm::keccak_256(words, sizeof(words)));
+}
+
+// Signing digest of a cloak transaction with a policy of the given size,
+// hashed from an assembled encoding and streamed straight into the hasher.
+// Run with --no-skip to print the timings.
+TEST_CASE("Benchmark keccak of policy sized transactions" * doctest::skip()) {
+    using clock = std::chrono::steady_clock;
+    const std::vector<uint8_t> from(20, 0x11), to(20, 0x22);
+    const size_t rounds = 200;
+
+    for (size_t size : {1u << 10, 1u << 14, 1u << 16, 1u << 20}) {
+        const std::vector<uint8_t> policy(size, 0xab);
+        const std::vector<uint8_t> codehash(32, 0xcd);
+
+        auto start = clock::now();
+        eevm::KeccakHash built;
+        for (size_t i = 0; i < rounds; i++) {
+            built = eevm::keccak_256(eevm::rlp::encode(from, to, codehash, policy, i));
+        }
+        const auto build_then_hash = clock::now() - start;
+
+        start = clock::now();
+        eevm::KeccakHash streamed;
+        for (size_t i = 0; i < rounds; i++) {
+            streamed = rlp::keccak_list({from, to, codehash, policy, i});
+        }
+        const auto streaming = clock::now() - start;
+
+        CHECK(built == streamed);
+        using us = std::chrono::microseconds;
+        MESSAGE(size << " bytes: build then hash "
+                     << std::chrono::duration_cast<us>(build_then_hash).count() / rounds
+                     << "us, streaming "
+                     << std::chrono::duration_cast<us>(streaming).count() / rounds << "us");
+    }
+}
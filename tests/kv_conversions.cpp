@@ -114,7 +114,6 @@ Ethereum::BlockHeader make_rand<Ethereum::BlockHeader>() {
     return Ethereum::BlockHeader{make_rand<decltype(Ethereum::BlockHeader::number)>(),
                                  make_rand<decltype(Ethereum::BlockHeader::difficulty)>(),
                                  make_rand<decltype(Ethereum::BlockHeader::gas_limit)>(),
-                                 make_rand<decltype(Ethereum::BlockHeader::gas_used)>(),
                                  make_rand<decltype(Ethereum::BlockHeader::timestamp)>(),
                                  make_rand<decltype(Ethereum::BlockHeader::miner)>(),
                                  make_rand<decltype(Ethereum::BlockHeader::block_hash)>()};
@@ -184,6 +183,63 @@ TEST_CASE("Ethereum::TxResult" * doctest::test_suite("conversions")) {
     require_roundtrip(make_rand<Ethereum::TxResult>());
 }
 
+TEST_CASE("Ethereum::TxResult compact encoding" * doctest::test_suite("conversions")) {
+    const eevm::log::Topic topic =
+        0xddf252ad1be2c89b69c2b068fc378daa952ba7f163c4a11628f55a4df523b3ef_u256;
+    Ethereum::TxResult r{std::nullopt, {}};
+    for (size_t i = 0; i < 10; ++i) {
+        r.logs.push_back({address, {0x1, 0x2}, {topic, i}});
+    }
+
+    // results written before the compact encoding still decode
+    msgpack::sbuffer legacy;
+    msgpack::packer<msgpack::sbuffer> pk(legacy);
+    pk.pack_array(2);
+    pk.pack(uint256_t(0));
+    pk.pack(r.logs);
+    auto oh = msgpack::unpack(legacy.data(), legacy.size());
+    REQUIRE(oh.get().as<Ethereum::TxResult>() == r);
+
+    // repeated addresses and topics are only stored once
+    msgpack::sbuffer compact;
+    msgpack::pack(compact, r);
+    REQUIRE(compact.size() < legacy.size() / 2);
+    auto oh2 = msgpack::unpack(compact.data(), compact.size());
+    REQUIRE(oh2.get().as<Ethereum::TxResult>() == r);
+}
+
+TEST_CASE("Ethereum::StorageKey compact encoding" * doctest::test_suite("conversions")) {
+    const uint256_t slot = 0x290decd9548b62a8d60345a988386fc84ba6bc95484008f6362f93160ef3e563_u256;
+    const Ethereum::StorageKey a{address, slot};
+    const Ethereum::StorageKey b{address, 1};
+    REQUIRE(a.address() == address);
+    REQUIRE(a.slot() == slot);
+    REQUIRE(a != b);
+    REQUIRE(std::hash<Ethereum::StorageKey>{}(a) != std::hash<Ethereum::StorageKey>{}(b));
+
+    require_roundtrip(a, b, Ethereum::StorageKey{});
+    require_roundtrip(Ethereum::StorageValue{0}, Ethereum::StorageValue{slot});
+
+    // keys and values written before the compact encoding still decode
+    msgpack::sbuffer legacy;
+    msgpack::pack(legacy, std::make_pair(address, slot));
+    msgpack::pack(legacy, uint256_t(7));
+    size_t offset = 0;
+    auto key = msgpack::unpack(legacy.data(), legacy.size(), offset);
+    REQUIRE(key.get().as<Ethereum::StorageKey>() == a);
+    auto value = msgpack::unpack(legacy.data(), legacy.size(), offset);
+    REQUIRE(value.get().as<Ethereum::StorageValue>().value == 7);
+
+    msgpack::sbuffer compact;
+    msgpack::pack(compact, a);
+    REQUIRE(compact.size() == Ethereum::StorageKey::SIZE + 2);
+#ifdef COMPACT_STORAGE_VALUES
+    msgpack::sbuffer small;
+    msgpack::pack(small, Ethereum::StorageValue{7});
+    REQUIRE(small.size() == 3);
+#endif
+}
+
 TEST_CASE("Ethereum::BlockHeader" * doctest::test_suite("conversions")) {
     const Ethereum::BlockHeader a{};
     const Ethereum::BlockHeader b{0, 1, 2, 3, 4};
@@ -0,0 +1,70 @@
+// Copyright (c) 2020 Oxford-Hainan Blockchain Research Institute
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "app/metrics.h"
+
+#include <doctest/doctest.h>
+#include <stdexcept>
+#include <string>
+
+using namespace cloak4ccf;
+
+TEST_CASE("Test endpoint metrics") {
+    auto& registry = metrics::Registry::instance();
+    auto& stats = registry.endpoint("test_method");
+    {
+        metrics::Call call(stats);
+        call.ok = true;
+    }
+    { metrics::Call call(stats); }
+
+    CHECK(stats.calls == 2);
+    CHECK(stats.errors == 1);
+
+    const auto text = registry.prometheus();
+    CHECK(text.find("cloak_endpoint_calls_total{method=\"test_method\"} 2\n") !=
+          std::string::npos);
+    CHECK(text.find("cloak_endpoint_errors_total{method=\"test_method\"} 1\n") !=
+          std::string::npos);
+    CHECK(text.find(
+              "cloak_endpoint_latency_seconds_bucket{method=\"test_method\",le=\"+Inf\"} 2\n") !=
+          std::string::npos);
+}
+
+TEST_CASE("Test histogram buckets are cumulative") {
+    metrics::Histogram h;
+    h.observe(50000);      // 50us
+    h.observe(2000000);    // 2ms
+    h.observe(9000000000); // 9s
+
+    std::string text;
+    h.write(text, "h", "phase=\"p\"");
+    CHECK(text.find("h_bucket{phase=\"p\",le=\"0.0001\"} 1\n") != std::string::npos);
+    CHECK(text.find("h_bucket{phase=\"p\",le=\"0.0025\"} 2\n") != std::string::npos);
+    CHECK(text.find("h_bucket{phase=\"p\",le=\"5\"} 2\n") != std::string::npos);
+    CHECK(text.find("h_bucket{phase=\"p\",le=\"+Inf\"} 3\n") != std::string::npos);
+    CHECK(text.find("h_count{phase=\"p\"} 3\n") != std::string::npos);
+}
+
+TEST_CASE("Test timed phases return the result") {
+    auto& phase = metrics::Registry::instance().phase("test_timed");
+    const auto before = phase.count();
+
+    CHECK(CLOAK_TIMED("test_timed", []() { return 42; }) == 42);
+    CLOAK_TIMED("test_timed", []() {});
+    CHECK_THROWS(CLOAK_TIMED("test_timed", []() -> int { throw std::runtime_error("x"); }));
+    CHECK(&CLOAK_PHASE_HISTOGRAM("test_timed") == &phase);
+
+    CHECK(phase.count() == before + 3);
+}
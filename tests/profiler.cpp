@@ -0,0 +1,62 @@
+// Copyright (c) 2020 Oxford-Hainan Blockchain Research Institute
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "ethereum/profiler.h"
+
+#include <doctest/doctest.h>
+
+using namespace Ethereum::profiler;
+
+TEST_CASE("Opcodes are reported by mnemonic") {
+    CHECK(mnemonic(0x00) == "STOP");
+    CHECK(mnemonic(0x54) == "SLOAD");
+    CHECK(mnemonic(0x60) == "PUSH1");
+    CHECK(mnemonic(0x7f) == "PUSH32");
+    CHECK(mnemonic(0x8f) == "DUP16");
+    CHECK(mnemonic(0x90) == "SWAP1");
+    CHECK(mnemonic(0xa4) == "LOG4");
+    CHECK(mnemonic(0xfd) == "REVERT");
+    CHECK(mnemonic(0x0c) == "0x0c");
+}
+
+TEST_CASE("Only sampled calls are traced") {
+    auto& p = Profiler::instance();
+    p.reset();
+    p.set_sample_every(4);
+    p.set_enabled(true);
+
+    const eevm::Address addr = 0xc0de;
+    size_t traced = 0;
+    for (size_t i = 0; i < 8; i++) {
+        CallProbe probe(addr);
+        eevm::Trace trace;
+        traced += probe.traces() ? 1 : 0;
+        probe.finish(trace);
+    }
+    p.record_batch(3, 1);
+    p.set_enabled(false);
+
+    CHECK(traced == 2);
+    const auto profile = p.get();
+    CHECK(profile.sample_every == 4);
+    REQUIRE(profile.contracts.size() == 1);
+    CHECK(profile.contracts[0].calls == 8);
+    CHECK(profile.contracts[0].traced_calls == 2);
+    CHECK(profile.speculative.batches == 1);
+    CHECK(profile.speculative.reexecuted == 1);
+
+    // probes are free while profiling is off
+    CallProbe off(addr);
+    CHECK(!off.traces());
+}
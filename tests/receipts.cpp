@@ -0,0 +1,269 @@
+// Copyright (c) 2020 Oxford-Hainan Blockchain Research Institute
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "ethereum/receipts.h"
+
+#include <doctest/doctest.h>
+#include <vector>
+
+using namespace Ethereum;
+
+struct Results {
+    kv::Store store;
+    tables::ResultsState rs;
+
+    void put(const TxHash& hash, const TxResult& result = {}) {
+        auto tx = store.create_tx();
+        ReceiptStore(tx, rs).put(hash, result);
+        REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+    }
+
+    void set_retention(const ReceiptRetention& r) {
+        auto tx = store.create_tx();
+        ReceiptStore(tx, rs).set_retention(r);
+        REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+    }
+
+    size_t count(const TxHash& from, const TxHash& to) {
+        auto tx = store.create_tx();
+        size_t n = 0;
+        for (auto h = from; h < to; h++) {
+            n += tx.get_view(rs.results)->get(h).has_value() ? 1 : 0;
+        }
+        return n;
+    }
+
+    bool has(const TxHash& hash) {
+        auto tx = store.create_tx();
+        return ReceiptStore::get(tx, rs, hash).has_value();
+    }
+};
+
+TEST_CASE("Retention keeps the window in every shard") {
+    Results r;
+    constexpr auto shards = ReceiptStore::shards;
+
+    // written before any window
+    for (TxHash h = 0; h < 3 * shards; h++) {
+        r.put(h);
+    }
+
+    // a window of 2 per shard drops one untracked result of each at once
+    r.set_retention({2 * shards, false});
+    CHECK(r.count(0, 3 * shards) == 2 * shards);
+
+    // every new result evicts the oldest of its shard
+    for (TxHash h = 100; h < 100 + shards; h++) {
+        r.put(h);
+    }
+    CHECK(r.count(0, 3 * shards) == shards);
+    CHECK(r.count(100, 100 + shards) == shards);
+
+    auto tx = r.store.create_tx();
+    auto retention = tx.get_view(r.rs.retention);
+    CHECK(!retention->get(ReceiptStore::HEAD).has_value());
+    CHECK(retention->get("head.0") == 4);
+    CHECK(retention->get("tail.0") == 2);
+}
+
+TEST_CASE("Retention moves pruned results to the cold table") {
+    Results r;
+    r.set_retention({1, true});
+    r.put(0);
+    r.put(ReceiptStore::shards);
+
+    CHECK(r.count(0, 1) == 0);
+    CHECK(r.has(0));
+    auto tx = r.store.create_tx();
+    CHECK(tx.get_view(r.rs.cold)->get(0).has_value());
+}
+
+TEST_CASE("Retention moves the single sequence into the shards") {
+    Results r;
+    {
+        auto tx = r.store.create_tx();
+        auto order = tx.get_view(r.rs.order);
+        auto retention = tx.get_view(r.rs.retention);
+        for (uint64_t n = 0; n < 4; n++) {
+            tx.get_view(r.rs.results)->put(n, {});
+            order->put(n, n);
+        }
+        retention->put(ReceiptStore::WINDOW, 4);
+        retention->put(ReceiptStore::HEAD, 4);
+        retention->put(ReceiptStore::TAIL, 0);
+        REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+    }
+
+    // the single sequence keeps going until the window is set again
+    r.put(4);
+    CHECK(!r.has(0));
+    CHECK(r.count(1, 5) == 4);
+
+    r.set_retention({2 * ReceiptStore::shards, false});
+    CHECK(r.count(1, 5) == 4);
+    auto tx = r.store.create_tx();
+    auto retention = tx.get_view(r.rs.retention);
+    CHECK(!retention->get(ReceiptStore::HEAD).has_value());
+    CHECK(!retention->get(ReceiptStore::TAIL).has_value());
+    CHECK(retention->get("head.1") == 1);
+    CHECK(tx.get_view(r.rs.order)->get(1) == TxHash(1));
+    CHECK(tx.get_view(r.rs.order)->get(4) == TxHash(4));
+}
+
+static size_t bits(const Bloom& bloom) {
+    size_t n = 0;
+    for (auto b : bloom) {
+        for (; b != 0; b &= b - 1) {
+            n++;
+        }
+    }
+    return n;
+}
+
+TEST_CASE("Blooms hold three bits of the address and of each topic") {
+    const eevm::LogEntry a = {0xa, {}, {0x1, 0x2}};
+    const eevm::LogEntry b = {0xb, {}, {}};
+
+    CHECK(logs::make_bloom({}) == Bloom{});
+    const auto bloom = logs::make_bloom({a});
+    CHECK(bits(logs::make_bloom({b})) > 0);
+    CHECK(bits(logs::make_bloom({b})) <= 3);
+    CHECK(bits(bloom) <= 9);
+    CHECK(logs::bloom_contains(bloom, logs::hash_word(a.address, logs::ADDRESS_SIZE)));
+    CHECK(logs::bloom_contains(bloom, logs::hash_word(0x1, logs::TOPIC_SIZE)));
+    CHECK(logs::bloom_contains(bloom, logs::hash_word(0x2, logs::TOPIC_SIZE)));
+    CHECK(!logs::bloom_contains(bloom, logs::hash_word(b.address, logs::ADDRESS_SIZE)));
+
+    // the bit of each pair is counted from the last byte
+    const auto h = logs::hash_word(b.address, logs::ADDRESS_SIZE);
+    const size_t bit = ((h[0] << 8) | h[1]) & 2047;
+    const auto only_b = logs::make_bloom({b});
+    CHECK((only_b[only_b.size() - 1 - bit / 8] & (1 << (bit % 8))) != 0);
+
+    // the bloom of several logs is the union of theirs
+    auto both = logs::make_bloom({a});
+    const auto other = logs::make_bloom({b});
+    for (size_t i = 0; i < both.size(); i++) {
+        both[i] |= other[i];
+    }
+    CHECK(logs::make_bloom({a, b}) == both);
+
+    LogFilter f;
+    f.addresses = {0xa};
+    f.topics = {{}, {0x2, 0x3}};
+    CHECK(logs::may_match(bloom, f));
+    f.topics = {{0x3}};
+    CHECK(!logs::may_match(bloom, f));
+}
+
+// Results with logs, each in a pseudo-block of its own
+struct Logs {
+    kv::Store store;
+    tables::ResultsState rs;
+    tables::BlocksState bs;
+
+    void add(const TxHash& hash, const std::vector<eevm::LogEntry>& logs) {
+        auto tx = store.create_tx();
+        tx.get_view(bs.pending)->put(BlockProducer::FULL, 1);
+        BlockProducer blocks(tx, bs);
+        ReceiptStore(tx, rs, &blocks).put(hash, {std::nullopt, logs});
+        REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+    }
+
+    void set_retention(const ReceiptRetention& r) {
+        auto tx = store.create_tx();
+        ReceiptStore(tx, rs).set_retention(r);
+        REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+    }
+
+    size_t index_entries() {
+        auto tx = store.create_tx();
+        size_t n = 0;
+        tx.get_view(rs.logs_index)->foreach([&n](const auto&, const auto&) {
+            n++;
+            return true;
+        });
+        tx.get_view(rs.logs_index_size)->foreach([&n](const auto&, const auto&) {
+            n++;
+            return true;
+        });
+        return n;
+    }
+
+    std::vector<TxHash> find(const LogFilter& filter, uint64_t max_blocks = 1000) {
+        auto tx = store.create_tx();
+        std::vector<TxHash> res;
+        for (auto&& l : find_logs(tx, rs, bs, filter, 10000, max_blocks)) {
+            res.push_back(l.transaction_hash);
+        }
+        return res;
+    }
+};
+
+static LogFilter filter(const std::string& from,
+                        const std::string& to,
+                        const std::vector<eevm::Address>& addresses = {},
+                        const std::vector<std::vector<eevm::log::Topic>>& topics = {}) {
+    LogFilter f;
+    f.from_block = from;
+    f.to_block = to;
+    f.addresses = addresses;
+    f.topics = topics;
+    return f;
+}
+
+TEST_CASE("Logs are filtered by block range and topics") {
+    Logs l;
+    l.add(0x10, {{0xa, {}, {0x1}}});      // block 0
+    l.add(0x11, {{0xa, {}, {0x2, 0x3}}}); // block 1
+    l.add(0x12, {{0xb, {}, {0x1, 0x3}}}); // block 2
+    l.add(0x13, {{0xa, {}, {}}});         // block 3, open
+
+    // both the address buckets and ANY_BUCKET are read for the range only
+    CHECK(l.find(filter("earliest", "latest", {0xa})) == std::vector<TxHash>{0x10, 0x11, 0x13});
+    CHECK(l.find(filter("0x1", "0x2", {0xa, 0xb})) == std::vector<TxHash>{0x11, 0x12});
+    CHECK(l.find(filter("0x1", "0x2")) == std::vector<TxHash>{0x11, 0x12});
+    CHECK(l.find(filter("latest", "latest")) == std::vector<TxHash>{0x13});
+    CHECK(l.find(filter("0x2", "0x1")).empty());
+
+    // null positions match anything, lists match any of their topics
+    CHECK(l.find(filter("earliest", "latest", {0xa}, {{0x2}})) == std::vector<TxHash>{0x11});
+    CHECK(l.find(filter("earliest", "latest", {}, {{}, {0x3}})) ==
+          std::vector<TxHash>{0x11, 0x12});
+    CHECK(l.find(filter("earliest", "latest", {}, {{0x1, 0x2}, {0x3}})) ==
+          std::vector<TxHash>{0x11, 0x12});
+    CHECK(l.find(filter("earliest", "latest", {0xb}, {{0x2}})).empty());
+}
+
+TEST_CASE("Log queries over too many blocks are rejected") {
+    Logs l;
+    for (TxHash h = 0; h < 4; h++) {
+        l.add(h, {{0xa, {}, {}}});
+    }
+    CHECK(l.find(filter("0x1", "0x2"), 2).size() == 2);
+    CHECK_THROWS(l.find(filter("0x1", "0x3"), 2));
+    CHECK_THROWS(l.find(filter("earliest", "latest", {0xa}), 2));
+}
+
+TEST_CASE("Pruned results leave no log index entries") {
+    Logs l;
+    l.set_retention({1});
+    for (TxHash h = 0; h < ReceiptStore::shards; h++) {
+        l.add(h * ReceiptStore::shards, {{0xa, {}, {0x1}}});
+    }
+    // one result of the shard is kept, in ANY_BUCKET and the two of 0xa
+    CHECK(l.find(filter("earliest", "latest")) ==
+          std::vector<TxHash>{(ReceiptStore::shards - 1) * ReceiptStore::shards});
+    CHECK(l.index_entries() == 6);
+}
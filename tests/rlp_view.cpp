@@ -0,0 +1,75 @@
+// Copyright (c) 2020 Oxford-Hainan Blockchain Research Institute
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "ethereum/rlp_view.h"
+
+#include <doctest/doctest.h>
+#include <eEVM/rlp.h>
+#include <vector>
+
+using namespace Ethereum;
+
+TEST_CASE("Test RLP views") {
+    const std::vector<uint8_t> to(20, 0x11);
+    const std::vector<uint8_t> small = {0x01};
+    const std::vector<uint8_t> policy(4096, 0xab);
+    const size_t nonce = 7;
+    const uint8_t v = 27;
+    const uint256_t r = (eevm::to_uint256("0xdeadbeef") << 200) + 1;
+
+    const auto encoded = eevm::rlp::encode(nonce, to, small, policy, v, r, size_t(0));
+
+    SUBCASE("Streaming matches encode") {
+        std::vector<uint8_t> streamed;
+        rlp::write_list(
+            [&](const uint8_t* data, size_t size) {
+                streamed.insert(streamed.end(), data, data + size);
+            },
+            {nonce, to, small, policy, v, r, size_t(0)});
+        CHECK(streamed == encoded);
+        CHECK(rlp::keccak_list({nonce, to, small, policy, v, r, size_t(0)}) ==
+              eevm::keccak_256(encoded));
+    }
+
+    SUBCASE("Slices borrow the input") {
+        const auto items = rlp::decode_list(encoded, 7);
+        CHECK(items[0].to_uint<size_t>() == nonce);
+        CHECK(items[1].to_bytes() == to);
+        CHECK(items[2].to_bytes() == small);
+        CHECK(items[3].size == policy.size());
+        CHECK(items[3].data > encoded.data());
+        CHECK(items[3].data + items[3].size <= encoded.data() + encoded.size());
+        CHECK(items[4].to_uint<uint8_t>() == v);
+        CHECK(items[5].to_uint<uint256_t>() == r);
+        CHECK(items[6].to_uint<size_t>() == 0);
+    }
+
+    SUBCASE("Malformed input") {
+        CHECK_THROWS(rlp::decode_list(encoded, 6));
+        auto truncated = encoded;
+        truncated.pop_back();
+        CHECK_THROWS(rlp::decode_list(truncated, 7));
+        CHECK_THROWS(rlp::decode_list(policy, 1));
+        CHECK_THROWS(rlp::decode_list(encoded, 7)[5].to_uint<uint8_t>());
+
+        // a string length that wraps the read position
+        const std::vector<uint8_t> wrapping = {
+            0xcb, 0xbf, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x01, 0x02};
+        CHECK_THROWS(rlp::decode_list(wrapping, 1));
+        // a list length that wraps the end
+        const std::vector<uint8_t> wrapping_list = {
+            0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x01};
+        CHECK_THROWS(rlp::decode_list(wrapping_list, 1));
+    }
+}
@@ -0,0 +1,99 @@
+// Copyright (c) 2020 Oxford-Hainan Blockchain Research Institute
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "app/rpc/sax_params.h"
+
+#include <doctest/doctest.h>
+#include <optional>
+#include <string>
+#include <vector>
+
+using namespace cloak4ccf;
+
+TEST_CASE("Test positional hex params") {
+    const std::string body = R"(["0xf86b01", "latest", "0xabc"])";
+    const auto params = sax::parse(body);
+    REQUIRE(params.items.size() == 3);
+    CHECK(params.bytes(0) == std::vector<uint8_t>{0xf8, 0x6b, 0x01});
+    CHECK(params.at(1).text == "latest");
+    CHECK_THROWS(params.bytes(1));
+    CHECK(params.bytes(2) == std::vector<uint8_t>{0x0a, 0xbc});
+    CHECK_THROWS(params.at(3));
+
+    // the DOM path decodes to the same params
+    const auto from_dom = sax::Params::from_json(nlohmann::json::parse(body));
+    CHECK(from_dom.bytes(0) == params.bytes(0));
+    CHECK(from_dom.at(1).text == params.at(1).text);
+}
+
+// Request bodies go through sax::parse, batch items and msgpack bodies
+// through Params::from_json. Both must agree on every input.
+static std::optional<sax::Params> from_dom(const std::string& body) {
+    try {
+        return sax::Params::from_json(nlohmann::json::parse(body));
+    } catch (const std::logic_error&) {
+        return std::nullopt;
+    }
+}
+
+static std::optional<sax::Params> from_sax(const std::string& body) {
+    try {
+        return sax::parse(body);
+    } catch (const std::logic_error&) {
+        return std::nullopt;
+    }
+}
+
+static std::vector<std::vector<uint8_t>> all_bytes(const sax::Params& params) {
+    std::vector<std::vector<uint8_t>> res;
+    for (auto&& p : params.items) {
+        res.push_back(p.bytes);
+    }
+    return res;
+}
+
+TEST_CASE("Test nested hex params") {
+    const std::string body = R"([["0x01", "0x0203"]])";
+    const auto params = sax::parse(std::vector<uint8_t>(body.begin(), body.end()));
+    REQUIRE(params.items.size() == 2);
+    CHECK(params.bytes(1) == std::vector<uint8_t>{0x02, 0x03});
+
+    for (const std::string& b : {body,
+                                 std::string(R"(["0x01", ["0x0203"], "0x04"])"),
+                                 std::string(R"([[], ["0x01"]])"),
+                                 std::string(R"([])")}) {
+        CAPTURE(b);
+        const auto dom = from_dom(b);
+        const auto sax = from_sax(b);
+        REQUIRE(dom.has_value());
+        REQUIRE(sax.has_value());
+        CHECK(all_bytes(dom.value()) == all_bytes(sax.value()));
+    }
+}
+
+TEST_CASE("Test invalid params") {
+    for (const std::string& b : {std::string(R"({"a": "0x01"})"),
+                                 std::string(R"("0x01")"),
+                                 std::string(R"([1])"),
+                                 std::string(R"([null])"),
+                                 std::string(R"([["0x01", true]])"),
+                                 std::string(R"([{"a": "0x01"}])"),
+                                 std::string(R"([[["0x01"]]])"),
+                                 std::string(R"(["0xzz"])")}) {
+        CAPTURE(b);
+        CHECK(!from_sax(b).has_value());
+        CHECK(!from_dom(b).has_value());
+    }
+    CHECK_THROWS(sax::parse(std::string(R"(["0x01")")));
+}
@@ -0,0 +1,177 @@
+// Copyright (c) 2020 Oxford-Hainan Blockchain Research Institute
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "ethereum/speculative.h"
+
+#include <doctest/doctest.h>
+#include <map>
+#include <vector>
+
+using namespace Ethereum;
+
+// stores 1 + the word at slot 0 back to slot 0
+constexpr auto counter_init_code = "0x6009600c60003960096000f3600054600101600055";
+
+template <typename K, typename V, typename View>
+std::map<K, V> dump(View* view) {
+    std::map<K, V> res;
+    view->foreach([&](const K& k, const V& v) {
+        res.emplace(k, v);
+        return true;
+    });
+    return res;
+}
+
+struct Chain {
+    kv::Store store;
+    tables::AccountsState as;
+    tables::ResultsState rs;
+
+    eevm::Address deploy(const eevm::Address& from) {
+        auto tx = store.create_tx();
+        MessageCall mc;
+        mc.from = from;
+        mc.data = counter_init_code;
+        auto es = EthereumState::make_state(tx, as);
+        const auto addr = EVMC(mc, es, nullptr).execute().second.contract_address.value();
+        REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+        return addr;
+    }
+
+    // Every call in a KV transaction of its own, discarded when it throws, as
+    // eth_sendRawTransaction runs them
+    std::vector<std::optional<TxHash>> sequential(const std::vector<MessageCall>& calls) {
+        std::vector<std::optional<TxHash>> res;
+        for (auto&& call : calls) {
+            auto tx = store.create_tx();
+            auto es = EthereumState::make_state(tx, as);
+            ReceiptStore receipts(tx, rs);
+            try {
+                res.push_back(EVMC(call, es, &receipts).run());
+            } catch (const std::exception&) {
+                res.push_back(std::nullopt);
+                continue;
+            }
+            REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+        }
+        return res;
+    }
+
+    std::vector<speculative::Execution> batch(const std::vector<MessageCall>& calls,
+                                              size_t workers) {
+        auto tx = store.create_tx();
+        ReceiptStore receipts(tx, rs);
+        speculative::SpeculativeExecutor executor(tx, as, {}, nullptr, &store, workers);
+        auto executions = executor.run(calls, receipts);
+        REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+        return executions;
+    }
+
+    uint256_t counter(const eevm::Address& addr) {
+        auto tx = store.create_tx();
+        return tx.get_view(as.storage)->get(StorageKey(addr, 0)).value_or(0);
+    }
+};
+
+static MessageCall call(const eevm::Address& from, const std::optional<eevm::Address>& to) {
+    MessageCall mc;
+    mc.from = from;
+    mc.to = to;
+    if (!to.has_value()) {
+        mc.data = counter_init_code;
+    }
+    return mc;
+}
+
+TEST_CASE("A batch has the outcome of running its transactions in order") {
+    const eevm::Address a = 0xa, b = 0xb, c = 0xc, not_a_contract = 0xdead;
+    Chain seq, spec;
+    const auto counter = seq.deploy(a);
+    REQUIRE(spec.deploy(a) == counter);
+
+    // 2, 4 and 6 conflict with 1 on the counter, 4 with 1 on a's nonce, 5
+    // with 2 on b's nonce, and 3 fails
+    const std::vector<MessageCall> calls = {call(a, counter),
+                                            call(b, counter),
+                                            call(c, not_a_contract),
+                                            call(a, counter),
+                                            call(b, std::nullopt),
+                                            call(c, counter)};
+
+    for (size_t workers : {1, 4}) {
+        CAPTURE(workers);
+        const auto expected = seq.sequential(calls);
+        const auto executions = spec.batch(calls, workers);
+
+        REQUIRE(executions.size() == expected.size());
+        for (size_t i = 0; i < calls.size(); i++) {
+            CAPTURE(i);
+            CHECK(executions[i].error.has_value() == !expected[i].has_value());
+            if (expected[i].has_value()) {
+                CHECK(executions[i].tx_hash == expected[i].value());
+            }
+        }
+        CHECK(executions[1].runs == 2);
+        CHECK(spec.counter(counter) == seq.counter(counter));
+
+        auto s = seq.store.create_tx();
+        auto p = spec.store.create_tx();
+        auto& acc = seq.as.accounts;
+        CHECK(dump<eevm::Address, uint256_t>(s.get_view(acc.balances)) ==
+              dump<eevm::Address, uint256_t>(p.get_view(acc.balances)));
+        CHECK(dump<eevm::Address, eevm::Account::Nonce>(s.get_view(acc.nonces)) ==
+              dump<eevm::Address, eevm::Account::Nonce>(p.get_view(acc.nonces)));
+        CHECK(dump<eevm::Address, uint256_t>(s.get_view(acc.code_hashes)) ==
+              dump<eevm::Address, uint256_t>(p.get_view(acc.code_hashes)));
+        CHECK(dump<StorageKey, uint256_t>(s.get_view(seq.as.storage)) ==
+              dump<StorageKey, uint256_t>(p.get_view(seq.as.storage)));
+
+        for (auto&& hash : expected) {
+            if (!hash.has_value()) {
+                continue;
+            }
+            const auto r = ReceiptStore::get(s, seq.rs, hash.value());
+            const auto q = ReceiptStore::get(p, spec.rs, hash.value());
+            REQUIRE(r.has_value());
+            REQUIRE(q.has_value());
+            CHECK(r->contract_address == q->contract_address);
+            CHECK(r->logs.size() == q->logs.size());
+        }
+    }
+    CHECK(seq.counter(counter) == 8);
+}
+
+TEST_CASE("A batch reads the state of its own transaction") {
+    const eevm::Address a = 0xa;
+    Chain chain;
+    const auto counter = chain.deploy(a);
+
+    auto tx = chain.store.create_tx();
+    tx.get_view(chain.as.storage)->get(StorageKey(counter, 0));
+
+    // committed after tx started, workers opening their own transactions
+    // would see it
+    {
+        auto other = chain.store.create_tx();
+        other.get_view(chain.as.storage)->put(StorageKey(counter, 0), 100);
+        REQUIRE(other.commit() == kv::CommitSuccess::OK);
+    }
+
+    ReceiptStore receipts(tx, chain.rs);
+    speculative::SpeculativeExecutor executor(tx, chain.as, {}, nullptr, &chain.store, 4);
+    const auto executions = executor.run({call(a, counter), call(a, counter)}, receipts);
+    CHECK(!executions[0].error.has_value());
+    CHECK(tx.get_view(chain.as.storage)->get(StorageKey(counter, 0)) == uint256_t(2));
+    CHECK(tx.commit() != kv::CommitSuccess::OK);
+}
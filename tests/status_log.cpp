@@ -0,0 +1,82 @@
+// Copyright (c) 2020 Oxford-Hainan Blockchain Research Institute
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "transaction/status_log.h"
+
+#include <doctest/doctest.h>
+
+using namespace cloak4ccf;
+using evm4ccf::Status;
+
+static evm4ccf::h256 id(uint8_t n) {
+    evm4ccf::h256 h = {};
+    h[31] = n;
+    return h;
+}
+
+TEST_CASE("Watchers read the changes of every shard after their cursor") {
+    kv::Store store;
+    TransactionTables tables;
+    auto tx = store.create_tx();
+    Transaction::StatusLog log(tx, tables);
+    for (uint8_t n = 0; n < 12; n++) {
+        log.append(id(n), Status::PENDING);
+    }
+    log.append(id(1), Status::SYNCED);
+
+    auto out = Transaction::StatusLog::watch(tx, tables, {});
+    CHECK(out.changes.size() == 13);
+    CHECK(!out.truncated);
+    REQUIRE(out.next.size() == Transaction::StatusLog::shards);
+    CHECK(out.next[1] == 3);
+
+    // ids 1 and 11 share a shard, and the changes of 1 keep their order
+    out = Transaction::StatusLog::watch(tx, tables, {{eevm::to_hex_string(id(1))}, {}});
+    REQUIRE(out.changes.size() == 2);
+    CHECK(out.changes[0].status == Status::PENDING);
+    CHECK(out.changes[1].status == Status::SYNCED);
+
+    const auto next = out.next;
+    log.append(id(3), Status::SYNCING);
+    out = Transaction::StatusLog::watch(tx, tables, {{}, next});
+    REQUIRE(out.changes.size() == 1);
+    CHECK(out.changes[0].id == eevm::to_hex_string(id(3)));
+    CHECK(out.next[3] == next[3] + 1);
+
+    CHECK_THROWS(Transaction::StatusLog::watch(tx, tables, {{}, {1}}));
+}
+
+TEST_CASE("Changes logged before sharding are dropped by the shards") {
+    kv::Store store;
+    TransactionTables tables;
+    auto tx = store.create_tx();
+    auto view = tx.get_view(tables.status_log);
+    auto cursors = tx.get_view(tables.status_log_cursors);
+    for (uint64_t seq = 1; seq <= 4; seq++) {
+        view->put(seq, {id(0), Status::PENDING});
+    }
+    cursors->put("first", 1);
+    cursors->put("last", 4);
+
+    Transaction::StatusLog log(tx, tables);
+    log.append(id(1), Status::SYNCED);
+    CHECK(cursors->get("base") == 4);
+    CHECK(!view->get(1).has_value());
+    CHECK(view->get(2).has_value());
+
+    const auto out = Transaction::StatusLog::watch(tx, tables, {});
+    REQUIRE(out.changes.size() == 1);
+    CHECK(out.changes[0].seq == 4 + Transaction::StatusLog::shards + 1);
+}
@@ -0,0 +1,225 @@
+// Copyright (c) 2020 Oxford-Hainan Blockchain Research Institute
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "queue/workertransaction.h"
+
+#include <doctest/doctest.h>
+#include <string>
+#include <vector>
+
+using namespace evm4ccf;
+
+static ByteString word(const uint256_t& v) {
+    ByteString b(abicoder::Type::MAX_BYTE_LENGTH);
+    eevm::to_big_endian(v, b.data());
+    return b;
+}
+
+static uint256_t word(const ByteString& b) {
+    return eevm::from_big_endian(b.data(), b.size());
+}
+
+static policy::Params param(const std::string& name,
+                            const nlohmann::json& type,
+                            const nlohmann::json& owner = nullptr) {
+    policy::Params p;
+    p.name = name;
+    p.structural_type = type;
+    p.owner = owner;
+    return p;
+}
+
+static const nlohmann::json address_type = {{"type", "address"}};
+static const nlohmann::json number_type = {
+    {"type", "number"}, {"bit_size", 256}, {"signed", false}};
+static const nlohmann::json mapping_type = {{"type", "mapping"}, {"depth", 2}};
+
+// A token whose balances are owned by the receiver of a call and whose
+// allowances by its admin
+struct Token {
+    static constexpr size_t ADMIN = 0, TOTAL = 1, SECRET = 2, BALANCES = 3, ALLOWED = 4;
+
+    tls::KeyPairPtr tee_kp = tls::make_key_pair(tls::CurveImpl::secp256k1_bitcoin);
+    tls::KeyPairPtr admin_kp = tls::make_key_pair(tls::CurveImpl::secp256k1_bitcoin);
+    tls::KeyPairPtr to_kp = tls::make_key_pair(tls::CurveImpl::secp256k1_bitcoin);
+    const std::string from = eevm::to_checksum_address(0xf00d);
+    const std::string admin = eevm::to_checksum_address(0xad);
+    const std::string to = eevm::to_checksum_address(0xbeef);
+    CloakPolicyTransaction ct;
+
+    Token() {
+        ct.from = eevm::to_uint256(from);
+        ct.states = {param("admin", address_type, {{"owner", "all"}}),
+                     param("total", number_type, {{"owner", "tee"}}),
+                     param("secret", number_type, {{"owner", "admin"}}),
+                     param("balances", mapping_type, {{"owner", "mapping"}, {"var_pos", 1}}),
+                     param("allowed",
+                           mapping_type,
+                           {{"owner", "mapping"}, {"var_pos", -1}, {"var", "admin"}})};
+        ct.function.name = "transfer";
+        ct.function.inputs = {param("to", address_type)};
+        ct.function.read = {{"balances", {"msg.sender:to"}}};
+        ct.function.mutate = {{"allowed", {"to:msg.sender"}}};
+        ct.set_content({{"to", to}});
+
+        ct.public_keys[admin] = public_key_asn1(admin_kp->get_raw_context());
+        ct.public_keys[to] = public_key_asn1(to_kp->get_raw_context());
+        // the public address states, as they are before decryption
+        ct.old_states = {word(ADMIN), address(admin)};
+    }
+
+    // new_states as get_states returns them, before encryption. Mappings
+    // hold their key count, then the key components and the value of each
+    // key.
+    ByteStrings plain() const {
+        ByteStrings res;
+        for (auto&& state : std::vector<ByteStrings>{
+                 {word(ADMIN), address(admin)},
+                 {word(TOTAL), word(100)},
+                 {word(SECRET), word(7)},
+                 {word(BALANCES), word(1), address(from), address(to), word(50)},
+                 {word(ALLOWED), word(1), address(to), address(from), word(60)}}) {
+            res.insert(res.end(), state.begin(), state.end());
+        }
+        return res;
+    }
+
+    static ByteString address(const std::string& a) {
+        return word(eevm::to_uint256(a));
+    }
+
+    // Decrypts value words with the key of their owner rather than the tee's
+    ByteString open(tls::KeyPairPtr owner_kp, const ByteString& data, const ByteString& tag_iv) {
+        auto&& [tag, iv] = Utils::split_tag_and_iv(tag_iv);
+        auto sealed = data;
+        sealed.insert(sealed.end(), tag.begin(), tag.end());
+        return Utils::decrypt_data(
+            owner_kp, get_der_from_public_key(tee_kp->get_raw_context()), iv, sealed);
+    }
+};
+
+TEST_CASE("Mapping keys resolve against the sender and the inputs") {
+    Token t;
+    const auto keys = t.ct.function.resolve_mapping_keys(t.from);
+    REQUIRE(keys.at("balances").size() == 1);
+    const auto& key = keys.at("balances")[0];
+    CHECK(key.raw == std::vector<std::string>{t.from, t.to});
+    CHECK(key.encoded == ByteStrings{Token::address(t.from), Token::address(t.to)});
+    CHECK(keys.at("allowed")[0].raw == std::vector<std::string>{t.to, t.from});
+}
+
+TEST_CASE("Mapping keys that are not inputs are rejected") {
+    Token t;
+    t.ct.function.read = {{"balances", {"msg.sender:nobody"}}};
+    CHECK_THROWS_AS(t.ct.function.resolve_mapping_keys(t.from), std::logic_error);
+}
+
+TEST_CASE("Mapping values are encrypted for the owner of their key") {
+    Token t;
+    const auto encrypted = t.ct.encrypt_states(t.tee_kp, t.plain());
+    const auto slots = t.ct.layout(encrypted, true);
+    REQUIRE(slots.size() == 5);
+
+    // var_pos 1 picks the second key component, to
+    const auto& balances = slots[Token::BALANCES];
+    const auto b = balances.offset + 2 + balances.depth;
+    CHECK(encrypted[b - 2] == Token::address(t.from));
+    CHECK(encrypted[b - 1] == Token::address(t.to));
+    CHECK(word(encrypted[b + 2]) == eevm::to_uint256(t.to));
+    CHECK(t.open(t.to_kp, encrypted[b], encrypted[b + 1]) == word(50));
+
+    // var_pos -1 picks the address state named by var
+    const auto& allowed = slots[Token::ALLOWED];
+    const auto a = allowed.offset + 2 + allowed.depth;
+    CHECK(word(encrypted[a + 2]) == eevm::to_uint256(t.admin));
+    CHECK(t.open(t.admin_kp, encrypted[a], encrypted[a + 1]) == word(60));
+    CHECK_THROWS(t.open(t.to_kp, encrypted[a], encrypted[a + 1]));
+}
+
+TEST_CASE("State lists are laid out once per state") {
+    using Owner = CloakPolicyTransaction::StateSlot::Owner;
+    Token t;
+
+    const auto plain = t.ct.layout(t.plain(), false);
+    REQUIRE(plain.size() == 5);
+    const std::vector<Owner> owners = {
+        Owner::ALL, Owner::TEE, Owner::IDENTIFIER, Owner::MAPPING, Owner::MAPPING};
+    const std::vector<size_t> offsets = {0, 2, 4, 6, 11};
+    const std::vector<size_t> lengths = {2, 2, 2, 5, 5};
+    for (size_t i = 0; i < plain.size(); i++) {
+        CAPTURE(i);
+        CHECK(plain[i].id == i);
+        CHECK(plain[i].state == &t.ct.states[i]);
+        CHECK(plain[i].owner == owners[i]);
+        CHECK(plain[i].offset == offsets[i]);
+        CHECK(plain[i].length == lengths[i]);
+    }
+    CHECK(plain[Token::ADMIN].type == "address");
+    CHECK(plain[Token::SECRET].owner_name == "admin");
+    CHECK(plain[Token::BALANCES].type == "mapping");
+    CHECK(plain[Token::BALANCES].depth == 2);
+    CHECK(plain[Token::BALANCES].keys == 1);
+
+    // every value of a state that is not public takes the encrypted value,
+    // the tag and iv and the owner
+    const auto encrypted = t.ct.layout(t.ct.encrypt_states(t.tee_kp, t.plain()), true);
+    REQUIRE(encrypted.size() == 5);
+    const std::vector<size_t> encrypted_lengths = {2, 4, 4, 7, 7};
+    for (size_t i = 0; i < encrypted.size(); i++) {
+        CAPTURE(i);
+        CHECK(encrypted[i].length == encrypted_lengths[i]);
+    }
+    CHECK(encrypted.back().offset == 17);
+}
+
+TEST_CASE("Truncated state lists are rejected") {
+    Token t;
+    CHECK_THROWS_AS(t.ct.layout({word(Token::TOTAL)}, false), std::logic_error);
+    CHECK_THROWS_AS(t.ct.layout({word(Token::TOTAL), word(1)}, true), std::logic_error);
+    CHECK_THROWS_AS(t.ct.layout({word(Token::BALANCES)}, false), std::logic_error);
+    CHECK_THROWS_AS(
+        t.ct.layout({word(Token::BALANCES), word(2), word(0), word(0), word(0)}, false),
+        std::logic_error);
+    CHECK_THROWS(t.ct.layout({word(t.ct.states.size())}, false));
+}
+
+TEST_CASE("Encrypted states decrypt to the states of every owner") {
+    Token t;
+    const auto plain = t.plain();
+    t.ct.old_states = t.ct.encrypt_states(t.tee_kp, plain);
+    CHECK(t.ct.decrypt_states(t.tee_kp) == plain);
+}
+
+TEST_CASE("States that were never set decrypt to zero") {
+    Token t;
+    t.ct.old_states = {word(Token::TOTAL), word(0), word(0), word(0)};
+    CHECK(t.ct.decrypt_states(t.tee_kp) == ByteStrings{word(Token::TOTAL), word(0)});
+}
+
+TEST_CASE("Only changes to the payload mark it changed") {
+    Token t;
+    CHECK(t.ct.payload_changed());
+
+    CloakPolicyTransaction stored(t.ct.descriptor(), t.ct.payload(), Status::SYNCING);
+    CHECK(!stored.payload_changed());
+    stored.set_status(Status::SYNCED);
+    CHECK(!stored.payload_changed());
+
+    stored.set_old_states(t.plain());
+    CHECK(stored.payload_changed());
+
+    CloakPolicyTransaction pending(t.ct.descriptor(), t.ct.payload(), Status::PENDING);
+    pending.set_content({{"to", t.to}});
+    CHECK(pending.payload_changed());
+}